@@ -0,0 +1,538 @@
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/completion.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/string.h>
+#include <linux/sched.h>
+
+#include "gpio_fast.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Victor Krasnoshchok");
+MODULE_DESCRIPTION("Bit-banged serial transmitter on GPIO1");
+MODULE_VERSION("0.1");
+
+/*
+ * Whatever is written to /dev/bbtx goes out on GPIO1 pins either as
+ * UART frames (8N1, LSB first, idle high) or as SPI mode 0 (MSB first,
+ * data changes on the falling clock edge, clock idles low).
+ *
+ * A write() is turned into a frame waveform first: the list of
+ * set/clear masks and the time of each store relative to the start of
+ * the frame. Then the waveform is replayed either
+ *  - "loop": byte by byte in a busy-wait loop with local IRQs off (the
+ *    line stays idle between bytes while IRQs are served), or
+ *  - "hrtimer": by a single hrtimer walking the whole frame.
+ * The achieved bit rate (inter-byte gaps included), the signalling
+ * rate while the line is busy and the edge timing error are in
+ * /sys/kernel/debug/bbtx/stats.
+ */
+
+/* P9_12 and P9_15 on BeagleBone Black */
+#define BBTX_DFLT_DATA_PIN (28)
+#define BBTX_DFLT_CLK_PIN (16)
+#define BBTX_DFLT_BIT_RATE (9600)
+
+#define BBTX_MAX_BIT_RATE (1000000)
+#define BBTX_MAX_FRAME (256)
+
+/* UART: start + 8 data + stop edges and the end of the stop bit */
+/* SPI: 2 edges per bit and the return of the clock to idle */
+#define BBTX_MAX_BYTE_SLOTS (17)
+
+typedef enum BBTX_proto_ENT
+{
+    BBTX_PROTO_UART = 0,
+    BBTX_PROTO_SPI
+} BBTX_proto_EN;
+
+typedef enum BBTX_replay_ENT
+{
+    BBTX_REPLAY_LOOP = 0,
+    BBTX_REPLAY_HRTIMER
+} BBTX_replay_EN;
+
+/* One store (or a wait only if both masks are empty) */
+typedef struct BBTX_slot_STCT
+{
+    u64 t_ns;
+    u32 set_mask;
+    u32 clr_mask;
+} BBTX_slot_STC;
+
+typedef struct BBTX_stats_STCT
+{
+    u64 frames;
+    u64 bytes;
+    u64 bits;
+    u64 active_ns;      /* Line busy: the bytes without the gaps */
+    u64 wall_ns;        /* Whole frames, gaps included */
+    u64 edges;
+    u64 err_sum_ns;
+    u64 err_max_ns;
+    u64 last_bits;
+    u64 last_active_ns;
+    u64 last_wall_ns;
+} BBTX_stats_STC;
+
+typedef struct BBTX_ctx_STCT
+{
+    BBTX_slot_STC*    slots;
+    unsigned int      slots_count;
+    unsigned int      byte_slots[BBTX_MAX_FRAME + 1]; /* first slot of each byte */
+    u64               byte_ns;
+
+    /* hrtimer replay */
+    struct hrtimer    timer;
+    struct completion done;
+    unsigned int      next_slot;
+    u64               start_ns;
+
+    BBTX_stats_STC    stats;
+    struct mutex      mtx;
+} BBTX_ctx_STC;
+
+static BBTX_ctx_STC bbtx;
+static struct dentry* bbtx_dbg_dir;
+
+/* **************** Module params ****************** */
+
+static char* proto = "uart";
+module_param(proto, charp, S_IRUGO);
+MODULE_PARM_DESC(proto, "Line protocol: uart (8N1) or spi (mode 0)");
+
+static char* replay = "loop";
+module_param(replay, charp, S_IRUGO);
+MODULE_PARM_DESC(replay, "Waveform replay: loop (IRQs off per byte) or hrtimer");
+
+static unsigned int data_pin = BBTX_DFLT_DATA_PIN;
+module_param(data_pin, uint, S_IRUGO);
+MODULE_PARM_DESC(data_pin, "GPIO1 pin for TX/MOSI");
+
+static unsigned int clk_pin = BBTX_DFLT_CLK_PIN;
+module_param(clk_pin, uint, S_IRUGO);
+MODULE_PARM_DESC(clk_pin, "GPIO1 pin for SCLK (spi only)");
+
+static unsigned int bit_rate = BBTX_DFLT_BIT_RATE;
+module_param(bit_rate, uint, S_IRUGO);
+MODULE_PARM_DESC(bit_rate, "Bits per second");
+
+static BBTX_proto_EN bbtx_proto;
+static BBTX_replay_EN bbtx_replay;
+
+/* **************** Waveform *********************** */
+
+static void bbtx_add_slot(u64 t_ns, u32 set_mask, u32 clr_mask)
+{
+    BBTX_slot_STC* slot = &bbtx.slots[bbtx.slots_count++];
+
+    slot->t_ns = t_ns;
+    slot->set_mask = set_mask;
+    slot->clr_mask = clr_mask;
+}
+
+/* Stores are emitted on level changes only */
+static void bbtx_build_uart_byte(u64 t0_ns, u8 byte, u64 bit_ns)
+{
+    u32 data = BIT(data_pin);
+    bool is_high = true; /* idle */
+    bool bit;
+    int i;
+
+    for (i = 0; i < 10; ++i)
+    {
+        /* start bit, data LSB first, stop bit */
+        bit = (0 == i) ? false : ((9 == i) ? true : (0 != (byte & BIT(i - 1))));
+
+        if (bit != is_high)
+        {
+            bbtx_add_slot(t0_ns + i * bit_ns, bit ? data : 0, bit ? 0 : data);
+            is_high = bit;
+        }
+    }
+
+    bbtx_add_slot(t0_ns + 10 * bit_ns, 0, 0);
+}
+
+static void bbtx_build_spi_byte(u64 t0_ns, u8 byte, u64 bit_ns)
+{
+    u32 data = BIT(data_pin);
+    u32 clk = BIT(clk_pin);
+    u64 half_ns = bit_ns / 2;
+    bool bit;
+    int i;
+
+    for (i = 0; i < 8; ++i)
+    {
+        bit = (0 != (byte & BIT(7 - i)));
+
+        /* Clock low with the new data, then the sampling edge */
+        bbtx_add_slot(t0_ns + 2 * i * half_ns, bit ? data : 0, bit ? clk : (clk | data));
+        bbtx_add_slot(t0_ns + (2 * i + 1) * half_ns, clk, 0);
+    }
+
+    bbtx_add_slot(t0_ns + 16 * half_ns, 0, clk | data);
+}
+
+static void bbtx_build_frame(const u8* buf, size_t len)
+{
+    u64 bit_ns = div_u64(NSEC_PER_SEC, bit_rate);
+    size_t i;
+
+    bbtx.slots_count = 0;
+    bbtx.byte_ns = (BBTX_PROTO_UART == bbtx_proto) ? 10 * bit_ns : 8 * bit_ns;
+
+    for (i = 0; i < len; ++i)
+    {
+        bbtx.byte_slots[i] = bbtx.slots_count;
+
+        if (BBTX_PROTO_UART == bbtx_proto)
+        {
+            bbtx_build_uart_byte(i * bbtx.byte_ns, buf[i], bit_ns);
+        }
+        else
+        {
+            bbtx_build_spi_byte(i * bbtx.byte_ns, buf[i], bit_ns);
+        }
+    }
+
+    bbtx.byte_slots[len] = bbtx.slots_count;
+}
+
+static void bbtx_account_edge(const BBTX_slot_STC* slot, u64 err_ns)
+{
+    /* The end markers of the bytes are waits, not edges */
+    if ((0 == slot->set_mask) && (0 == slot->clr_mask))
+    {
+        return;
+    }
+
+    ++bbtx.stats.edges;
+    bbtx.stats.err_sum_ns += err_ns;
+    bbtx.stats.err_max_ns = max(bbtx.stats.err_max_ns, err_ns);
+}
+
+/* Restores the idle line and the gpio_fast shadow after raw stores */
+static void bbtx_line_idle(void)
+{
+    if (BBTX_PROTO_UART == bbtx_proto)
+    {
+        gpio_fast_update(BIT(data_pin), 0);
+    }
+    else
+    {
+        gpio_fast_update(0, BIT(data_pin) | BIT(clk_pin));
+    }
+}
+
+/* **************** Replay ************************* */
+
+/* Returns the time the line was busy */
+static u64 bbtx_replay_loop(size_t len)
+{
+    const BBTX_slot_STC* slot;
+    unsigned long flags;
+    unsigned int s;
+    u64 active_ns = 0;
+    u64 byte_t0_ns;
+    u64 start_ns;
+    u64 now_ns;
+    size_t i;
+
+    for (i = 0; i < len; ++i)
+    {
+        byte_t0_ns = i * bbtx.byte_ns;
+
+        local_irq_save(flags);
+        start_ns = ktime_get_ns();
+
+        for (s = bbtx.byte_slots[i]; s < bbtx.byte_slots[i + 1]; ++s)
+        {
+            slot = &bbtx.slots[s];
+
+            while ((now_ns = ktime_get_ns()) - start_ns < slot->t_ns - byte_t0_ns)
+            {
+                cpu_relax();
+            }
+
+            __gpio_fast_store(slot->set_mask, slot->clr_mask);
+            bbtx_account_edge(slot, now_ns - start_ns - (slot->t_ns - byte_t0_ns));
+        }
+
+        active_ns += now_ns - start_ns;
+        local_irq_restore(flags);
+
+        cond_resched();
+    }
+
+    return active_ns;
+}
+
+static enum hrtimer_restart bbtx_timer_fn(struct hrtimer* timer)
+{
+    const BBTX_slot_STC* slot;
+    u64 now_ns = ktime_get_ns();
+
+    /* All the stores that are due, a late expiry may cover several */
+    while (bbtx.next_slot < bbtx.slots_count)
+    {
+        slot = &bbtx.slots[bbtx.next_slot];
+
+        if (now_ns - bbtx.start_ns < slot->t_ns)
+        {
+            break;
+        }
+
+        __gpio_fast_store(slot->set_mask, slot->clr_mask);
+        bbtx_account_edge(slot, now_ns - bbtx.start_ns - slot->t_ns);
+        ++bbtx.next_slot;
+    }
+
+    if (bbtx.next_slot == bbtx.slots_count)
+    {
+        complete(&bbtx.done);
+        return HRTIMER_NORESTART;
+    }
+
+    hrtimer_set_expires(timer, ns_to_ktime(bbtx.start_ns + bbtx.slots[bbtx.next_slot].t_ns));
+    return HRTIMER_RESTART;
+}
+
+static u64 bbtx_replay_hrtimer(void)
+{
+    reinit_completion(&bbtx.done);
+    bbtx.next_slot = 0;
+    bbtx.start_ns = ktime_get_ns();
+
+    hrtimer_start(&bbtx.timer, ns_to_ktime(bbtx.start_ns), HRTIMER_MODE_ABS);
+
+    /* The frame cannot be cut in the middle, so no interruptible wait */
+    wait_for_completion(&bbtx.done);
+
+    return ktime_get_ns() - bbtx.start_ns;
+}
+
+/* **************** Char device ******************** */
+
+static ssize_t bbtx_write(struct file* file, const char __user* buf,
+                          size_t count, loff_t* ppos)
+{
+    u8 frame[BBTX_MAX_FRAME];
+    size_t len = min_t(size_t, count, BBTX_MAX_FRAME);
+    u64 active_ns;
+    u64 wall_ns;
+    u64 bits;
+
+    if (0 == len)
+    {
+        return 0;
+    }
+
+    if (0 != copy_from_user(frame, buf, len))
+    {
+        return -EFAULT;
+    }
+
+    if (0 != mutex_lock_interruptible(&bbtx.mtx))
+    {
+        return -ERESTARTSYS;
+    }
+
+    bbtx_build_frame(frame, len);
+
+    wall_ns = ktime_get_ns();
+    if (BBTX_REPLAY_LOOP == bbtx_replay)
+    {
+        active_ns = bbtx_replay_loop(len);
+    }
+    else
+    {
+        active_ns = bbtx_replay_hrtimer();
+    }
+    wall_ns = ktime_get_ns() - wall_ns;
+
+    bbtx_line_idle();
+
+    bits = len * ((BBTX_PROTO_UART == bbtx_proto) ? 10 : 8);
+
+    ++bbtx.stats.frames;
+    bbtx.stats.bytes += len;
+    bbtx.stats.bits += bits;
+    bbtx.stats.active_ns += active_ns;
+    bbtx.stats.wall_ns += wall_ns;
+    bbtx.stats.last_bits = bits;
+    bbtx.stats.last_active_ns = active_ns;
+    bbtx.stats.last_wall_ns = wall_ns;
+
+    mutex_unlock(&bbtx.mtx);
+
+    /* A short write: the rest goes with the next frame */
+    return len;
+}
+
+static const struct file_operations bbtx_fops = {
+        .owner  = THIS_MODULE,
+        .write  = bbtx_write,
+        .llseek = noop_llseek
+};
+
+static struct miscdevice bbtx_misc = {
+        .minor = MISC_DYNAMIC_MINOR,
+        .name  = "bbtx",
+        .fops  = &bbtx_fops,
+        .mode  = 0222
+};
+
+/* ***************** debugfs *********************** */
+
+static u64 bbtx_rate(u64 bits, u64 ns)
+{
+    return (0 != ns) ? div64_u64(bits * NSEC_PER_SEC, ns) : 0;
+}
+
+static int bbtx_stats_show(struct seq_file* s, void* unused)
+{
+    BBTX_stats_STC* st = &bbtx.stats;
+
+    mutex_lock(&bbtx.mtx);
+
+    seq_printf(s, "%s, %s replay, pins: data %u", proto, replay, data_pin);
+    if (BBTX_PROTO_SPI == bbtx_proto)
+    {
+        seq_printf(s, ", clk %u", clk_pin);
+    }
+    seq_printf(s, "\nrequested: %u bit/s\n", bit_rate);
+    seq_printf(s, "frames %llu, bytes %llu\n", st->frames, st->bytes);
+    seq_printf(s, "achieved: %llu bit/s (last frame %llu bit/s)\n",
+               bbtx_rate(st->bits, st->wall_ns),
+               bbtx_rate(st->last_bits, st->last_wall_ns));
+    seq_printf(s, "signalling, gaps left out: %llu bit/s (last frame %llu bit/s)\n",
+               bbtx_rate(st->bits, st->active_ns),
+               bbtx_rate(st->last_bits, st->last_active_ns));
+    seq_printf(s, "edges %llu, timing error avg %llu ns, max %llu ns\n", st->edges,
+               st->edges ? div64_u64(st->err_sum_ns, st->edges) : 0, st->err_max_ns);
+
+    mutex_unlock(&bbtx.mtx);
+    return 0;
+}
+
+static int bbtx_stats_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, bbtx_stats_show, inode->i_private);
+}
+
+/* Any write clears the stats */
+static ssize_t bbtx_stats_write(struct file* file, const char __user* buf,
+                                size_t count, loff_t* ppos)
+{
+    mutex_lock(&bbtx.mtx);
+    memset(&bbtx.stats, 0, sizeof(bbtx.stats));
+    mutex_unlock(&bbtx.mtx);
+
+    return count;
+}
+
+static const struct file_operations bbtx_stats_fops = {
+        .owner   = THIS_MODULE,
+        .open    = bbtx_stats_open,
+        .read    = seq_read,
+        .write   = bbtx_stats_write,
+        .llseek  = seq_lseek,
+        .release = single_release
+};
+
+/* ************************************************* */
+
+static int __init bbtx_init(void)
+{
+    int ret;
+
+    if (0 == strcmp(proto, "uart"))
+    {
+        bbtx_proto = BBTX_PROTO_UART;
+    }
+    else if (0 == strcmp(proto, "spi"))
+    {
+        bbtx_proto = BBTX_PROTO_SPI;
+    }
+    else
+    {
+        printk(KERN_ERR "Unknown protocol %s\n", proto);
+        return -EINVAL;
+    }
+
+    if (0 == strcmp(replay, "loop"))
+    {
+        bbtx_replay = BBTX_REPLAY_LOOP;
+    }
+    else if (0 == strcmp(replay, "hrtimer"))
+    {
+        bbtx_replay = BBTX_REPLAY_HRTIMER;
+    }
+    else
+    {
+        printk(KERN_ERR "Unknown replay mode %s\n", replay);
+        return -EINVAL;
+    }
+
+    if ((data_pin >= GPIO_FAST_BANK_PINS) || (clk_pin >= GPIO_FAST_BANK_PINS) ||
+        ((BBTX_PROTO_SPI == bbtx_proto) && (data_pin == clk_pin)) ||
+        (0 == bit_rate) || (bit_rate > BBTX_MAX_BIT_RATE))
+    {
+        printk(KERN_ERR "Invalid pins or bit rate\n");
+        return -EINVAL;
+    }
+
+    bbtx.slots = kmalloc_array(BBTX_MAX_FRAME * BBTX_MAX_BYTE_SLOTS, sizeof(BBTX_slot_STC), GFP_KERNEL);
+    if (NULL == bbtx.slots)
+    {
+        return -ENOMEM;
+    }
+
+    mutex_init(&bbtx.mtx);
+    init_completion(&bbtx.done);
+    hrtimer_init(&bbtx.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    bbtx.timer.function = bbtx_timer_fn;
+
+    gpio_fast_set_output(BIT(data_pin) | ((BBTX_PROTO_SPI == bbtx_proto) ? BIT(clk_pin) : 0));
+    bbtx_line_idle();
+
+    ret = misc_register(&bbtx_misc);
+    if (0 != ret)
+    {
+        printk(KERN_ERR "Cannot register /dev/bbtx\n");
+        kfree(bbtx.slots);
+        return ret;
+    }
+
+    bbtx_dbg_dir = debugfs_create_dir("bbtx", NULL);
+    debugfs_create_file("stats", S_IRUGO | S_IWUSR, bbtx_dbg_dir, NULL, &bbtx_stats_fops);
+
+    printk(KERN_INFO "Bit-bang TX loaded: %s at %u bit/s, %s replay\n", proto, bit_rate, replay);
+    return 0;
+}
+
+static void __exit bbtx_exit(void)
+{
+    debugfs_remove_recursive(bbtx_dbg_dir);
+    misc_deregister(&bbtx_misc);
+
+    /* No writer is left, the timer is idle */
+    hrtimer_cancel(&bbtx.timer);
+    kfree(bbtx.slots);
+
+    printk(KERN_INFO "Bit-bang TX unloaded\n");
+}
+
+module_init(bbtx_init);
+module_exit(bbtx_exit);
@@ -2,149 +2,550 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/io.h>
-#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/string.h>
+
+#include "gpio_fast.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Victor Krasnoshchok");
-MODULE_DESCRIPTION("Blink a LED");
-MODULE_VERSION("0.2");
-
-/* Misc */
-typedef volatile u32* reg_ptr_t;
-#define BYTE_PTR(x) (x/sizeof(u32))
-#define DEFAULT_IOREMAP_LEN (4096)
-
-/* GPIO muxing & data mapping */
-#define GPIO1_MAP_BASE (0x4804c000)
-#define GPIO1_OE_REG (BYTE_PTR(0x134))
+MODULE_DESCRIPTION("Blink LEDs: hrtimer-driven pattern engine");
+MODULE_VERSION("0.4");
 
-#define GPIO1_DATA_OUT_SET (BYTE_PTR(0x194))
-#define GPIO1_DATA_OUT_CLR (BYTE_PTR(0x190))
-
-/* GPIO muxing constants */
-#define GPIO_OE_OUT (0)
-#define GPIO_PIN_HIGH (1)
-
-/* GPIO LED pins */
+/* GPIO LED pins (GPIO1 bank, mapped by the gpio_fast module) */
 /* On-board USR3 LED */
 #define GPIO_LED_USR3_PIN (24)
 
+/* Default pattern: USR3 lit for 1 s every 2 s, 10 times */
 #define MAX_LED_BLINK_TIMES (10)
-#define LED_LIGHT_INTERVAL_SEC (1 * HZ)
+#define LED_LIGHT_INTERVAL_US (1 * USEC_PER_SEC)
+
+#define LED_MAX_CHANNELS (8)
+#define LED_MAX_STEPS (16)
+#define LED_MIN_PERIOD_US (100)
+#define LED_MAX_PERIOD_US (60 * USEC_PER_SEC)
 
 /* **************************************** */
 
-/* Regs mappings */
-static void __iomem* gpio1_base;
+/*
+ * A channel drives one pin through a sequence of steps. A step is
+ * 'cycles' PWM periods with the given period and duty cycle; the whole
+ * sequence is played 'repeat' times (0 - forever).
+ *
+ * All channels share one hrtimer: each expiry applies the edges that
+ * are due with a single gpio_fast_update() and re-arms the timer at
+ * the nearest next edge. Edges are computed from the absolute start
+ * of the cycle, so a late expiry does not make the pattern drift.
+ */
+typedef struct LED_step_STCT
+{
+    u64          period_ns;
+    u64          on_ns;
+    unsigned int cycles;
+} LED_step_STC;
+
+typedef struct LED_channel_STCT
+{
+    LED_step_STC steps[LED_MAX_STEPS];
+    unsigned int steps_count;
+    unsigned int repeat;
+    unsigned int led_gpio_pin;
+
+    /* Playback state, owned by the timer while the channel is active */
+    bool         is_active;
+    bool         is_led_on;
+    unsigned int curr_step;
+    unsigned int curr_cycle;
+    unsigned int curr_repeat;
+    u64          cycle_start_ns;
+    u64          next_edge_ns;
+
+    u64          edges;
+    u64          late_edges;
+} LED_channel_STC;
 
-/* LED object and timer abstraction */
+/* LED engine: all the channels and the only timer */
 typedef struct LED_control_STCT
 {
 
-    struct timer_list led_timer;
-    unsigned long     led_blink_interval; 
-    unsigned int      led_gpio_pin;
-    unsigned int      led_curr_blink_times;
-    unsigned int      led_max_blink_times;
-    bool              is_led_on;
+    struct hrtimer    led_timer;
+    LED_channel_STC   channels[LED_MAX_CHANNELS];
+    spinlock_t        lock;   /* timer vs. sysfs readers */
+    struct mutex      cfg_mtx; /* sysfs writers */
+    struct kobject*   kobj;
+    u64               expiries;
 
 } LED_control_STC;
 
-LED_control_STC led_usr3_ctl = {
-        .led_blink_interval   = LED_LIGHT_INTERVAL_SEC,
-        .led_gpio_pin         = GPIO_LED_USR3_PIN,
-        .led_curr_blink_times = 0,
-        .led_max_blink_times  = MAX_LED_BLINK_TIMES,
-        .is_led_on            = false
-};
+static LED_control_STC led_ctl;
 
 /* **************************************** */
 
-/* GPIO helpers */
-static void switch_led_on(LED_control_STC* led_ctl_ptr)
+/* Channel playback, called with led_ctl.lock held */
+static void led_channel_start(LED_channel_STC* ch, u64 now_ns)
 {
-       *((reg_ptr_t) gpio1_base + GPIO1_DATA_OUT_SET) |= (GPIO_PIN_HIGH << (led_ctl_ptr->led_gpio_pin));
-       led_ctl_ptr->is_led_on = true;
+    ch->curr_step = 0;
+    ch->curr_cycle = 0;
+    ch->curr_repeat = 0;
+    ch->is_led_on = false;
+    ch->cycle_start_ns = now_ns;
+    ch->next_edge_ns = now_ns;
+    ch->edges = 0;
+    ch->late_edges = 0;
+    ch->is_active = true;
 }
 
-static void switch_led_off(LED_control_STC* led_ctl_ptr)
+/* Moves to the next PWM cycle, returns false when the pattern is over */
+static bool led_channel_next_cycle(LED_channel_STC* ch)
 {
-       *((reg_ptr_t) gpio1_base + GPIO1_DATA_OUT_CLR) |= (GPIO_PIN_HIGH << (led_ctl_ptr->led_gpio_pin));
-       led_ctl_ptr->is_led_on = false;
+    ch->cycle_start_ns += ch->steps[ch->curr_step].period_ns;
+
+    if (++(ch->curr_cycle) < ch->steps[ch->curr_step].cycles)
+    {
+        return true;
+    }
+
+    ch->curr_cycle = 0;
+
+    if (++(ch->curr_step) < ch->steps_count)
+    {
+        return true;
+    }
+
+    ch->curr_step = 0;
+    ++(ch->curr_repeat);
+
+    return (0 == ch->repeat) || (ch->curr_repeat < ch->repeat);
 }
 
-static void timer_handler(struct timer_list* timer_obj)
+/* Applies the due edge of the channel to the set/clear masks */
+static void led_channel_edge(LED_channel_STC* ch, u64 now_ns, u32* set_mask, u32* clr_mask)
 {
-    LED_control_STC* led_ctl_ptr = (LED_control_STC*) timer_obj;
+    const LED_step_STC* step;
+    u32 mask = BIT(ch->led_gpio_pin);
 
-    if (led_ctl_ptr->led_curr_blink_times < led_ctl_ptr->led_max_blink_times)
+    /* More than a period behind: the timer cannot keep up with the pattern */
+    if (now_ns > ch->next_edge_ns + ch->steps[ch->curr_step].period_ns)
     {
-            if (true == led_ctl_ptr->is_led_on)
-            {
-                    switch_led_off(led_ctl_ptr);
-            }
-            else
-            {
-                    switch_led_on(led_ctl_ptr);
-                    /* According to the requirement for the assignment
-                     * the LED must be lit N times and non-lit states
-                     * seem not to be taken into account */
-                    ++(led_ctl_ptr->led_curr_blink_times);
-            }
+        ++(ch->late_edges);
+    }
 
-            mod_timer(&(led_ctl_ptr->led_timer), jiffies + led_ctl_ptr->led_blink_interval);
+    /* The end of the 'on' part of the cycle */
+    if (ch->is_led_on && (ch->next_edge_ns < ch->cycle_start_ns + ch->steps[ch->curr_step].period_ns))
+    {
+        *clr_mask |= mask;
+        *set_mask &= ~mask;
+        ch->is_led_on = false;
+        ch->next_edge_ns = ch->cycle_start_ns + ch->steps[ch->curr_step].period_ns;
+        ++(ch->edges);
+        return;
+    }
+
+    /* The start of a cycle (the first one starts at cycle_start_ns) */
+    if (ch->next_edge_ns != ch->cycle_start_ns)
+    {
+        if (false == led_channel_next_cycle(ch))
+        {
+            *clr_mask |= mask;
+            *set_mask &= ~mask;
+            ch->is_led_on = false;
+            ch->is_active = false;
+            printk(KERN_INFO "All done. The LED on pin %u played its pattern %u times.\n",
+                   ch->led_gpio_pin, ch->repeat);
+            return;
+        }
+    }
+
+    step = &ch->steps[ch->curr_step];
+
+    if (0 != step->on_ns)
+    {
+        *set_mask |= mask;
+        *clr_mask &= ~mask;
+        ch->is_led_on = true;
     }
     else
     {
-            switch_led_off(led_ctl_ptr);
-            printk(KERN_INFO "All done. The LED blinked %d times.\n", led_ctl_ptr->led_max_blink_times);
-            if (0 != del_timer(&(led_ctl_ptr->led_timer)))
-            {
-                    printk(KERN_ERR "Cannot delete LED -associated timer.\n");
-            }
+        *clr_mask |= mask;
+        *set_mask &= ~mask;
+        ch->is_led_on = false;
+    }
+
+    ++(ch->edges);
+
+    /* 100% duty needs no 'off' edge, 0% needs no 'on' edge */
+    if ((0 != step->on_ns) && (step->on_ns < step->period_ns))
+    {
+        ch->next_edge_ns = ch->cycle_start_ns + step->on_ns;
+    }
+    else
+    {
+        ch->next_edge_ns = ch->cycle_start_ns + step->period_ns;
+    }
+}
+
+/* Returns the nearest edge of the active channels, 0 if there is none */
+static u64 led_next_expiry(void)
+{
+    u64 next_ns = 0;
+    int i;
+
+    for (i = 0; i < LED_MAX_CHANNELS; ++i)
+    {
+        if (led_ctl.channels[i].is_active &&
+            ((0 == next_ns) || (led_ctl.channels[i].next_edge_ns < next_ns)))
+        {
+            next_ns = led_ctl.channels[i].next_edge_ns;
+        }
+    }
+
+    return next_ns;
+}
+
+static enum hrtimer_restart timer_handler(struct hrtimer* timer_obj)
+{
+    LED_control_STC* led_ctl_ptr = container_of(timer_obj, LED_control_STC, led_timer);
+    LED_channel_STC* ch;
+    u32 set_mask = 0;
+    u32 clr_mask = 0;
+    u64 now_ns = ktime_get_ns();
+    u64 next_ns;
+    int i;
+
+    spin_lock(&led_ctl_ptr->lock);
+
+    ++(led_ctl_ptr->expiries);
+
+    for (i = 0; i < LED_MAX_CHANNELS; ++i)
+    {
+        ch = &led_ctl_ptr->channels[i];
+
+        if (ch->is_active && (ch->next_edge_ns <= now_ns))
+        {
+            led_channel_edge(ch, now_ns, &set_mask, &clr_mask);
+        }
+    }
+
+    /* One store per direction for all the channels */
+    gpio_fast_update(set_mask, clr_mask);
+
+    next_ns = led_next_expiry();
+
+    spin_unlock(&led_ctl_ptr->lock);
+
+    if (0 == next_ns)
+    {
+        return HRTIMER_NORESTART;
+    }
+
+    hrtimer_set_expires(timer_obj, ns_to_ktime(next_ns));
+    return HRTIMER_RESTART;
+}
+
+/* Called with cfg_mtx held and the timer cancelled */
+static void led_timer_rearm(void)
+{
+    u64 next_ns;
+
+    spin_lock_irq(&led_ctl.lock);
+    next_ns = led_next_expiry();
+    spin_unlock_irq(&led_ctl.lock);
+
+    if (0 != next_ns)
+    {
+        hrtimer_start(&led_ctl.led_timer, ns_to_ktime(next_ns), HRTIMER_MODE_ABS);
+    }
+}
+
+/* Replaces the channel (the pattern restarts from its first step) */
+static int led_channel_program(unsigned int idx, const LED_channel_STC* cfg)
+{
+    LED_channel_STC* ch;
+    int i;
+
+    mutex_lock(&led_ctl.cfg_mtx);
+
+    for (i = 0; i < LED_MAX_CHANNELS; ++i)
+    {
+        if ((i != idx) && led_ctl.channels[i].is_active &&
+            (led_ctl.channels[i].led_gpio_pin == cfg->led_gpio_pin))
+        {
+            mutex_unlock(&led_ctl.cfg_mtx);
+            return -EBUSY;
+        }
+    }
+
+    gpio_fast_set_output(BIT(cfg->led_gpio_pin));
+
+    /* The timer owns the active channels, stop it for the update */
+    hrtimer_cancel(&led_ctl.led_timer);
+
+    spin_lock_irq(&led_ctl.lock);
+
+    ch = &led_ctl.channels[idx];
+    if (ch->is_active && ch->is_led_on)
+    {
+        gpio_fast_clear(BIT(ch->led_gpio_pin));
+    }
+
+    memcpy(ch->steps, cfg->steps, sizeof(ch->steps));
+    ch->steps_count = cfg->steps_count;
+    ch->repeat = cfg->repeat;
+    ch->led_gpio_pin = cfg->led_gpio_pin;
+    led_channel_start(ch, ktime_get_ns());
+
+    spin_unlock_irq(&led_ctl.lock);
+
+    led_timer_rearm();
+
+    mutex_unlock(&led_ctl.cfg_mtx);
+    return 0;
+}
+
+static void led_channel_stop(unsigned int idx)
+{
+    LED_channel_STC* ch = &led_ctl.channels[idx];
+
+    mutex_lock(&led_ctl.cfg_mtx);
+    hrtimer_cancel(&led_ctl.led_timer);
+
+    spin_lock_irq(&led_ctl.lock);
+    if (ch->is_active)
+    {
+        gpio_fast_clear(BIT(ch->led_gpio_pin));
+        ch->is_led_on = false;
+        ch->is_active = false;
+    }
+    spin_unlock_irq(&led_ctl.lock);
+
+    led_timer_rearm();
+    mutex_unlock(&led_ctl.cfg_mtx);
+}
+
+/* ***************** sysfs ************************ */
+
+/*
+ * "echo '<ch> <pin> <repeat> <period_us>:<duty_%>[:<cycles>] ...' >
+ *  /sys/kernel/ledmod/pattern" programs a channel, "echo '<ch> off'"
+ * stops it. "cat /sys/kernel/ledmod/channels" shows the state.
+ */
+static int led_parse_step(const char* tok, LED_step_STC* step)
+{
+    unsigned int period_us = 0;
+    unsigned int duty = 0;
+    unsigned int cycles = 1;
+    int parsed = sscanf(tok, "%u:%u:%u", &period_us, &duty, &cycles);
+
+    if ((parsed < 2) || (period_us < LED_MIN_PERIOD_US) ||
+        (period_us > LED_MAX_PERIOD_US) || (duty > 100) || (0 == cycles))
+    {
+        return -EINVAL;
+    }
+
+    step->period_ns = (u64) period_us * NSEC_PER_USEC;
+    step->on_ns = div_u64(step->period_ns * duty, 100);
+    step->cycles = cycles;
+
+    return 0;
+}
+
+static ssize_t pattern_store(struct kobject* kobj, struct kobj_attribute* attr,
+                             const char* buf, size_t count)
+{
+    LED_channel_STC* cfg;
+    char* cmd;
+    char* cur;
+    char* tok;
+    unsigned int idx;
+    int ret = -EINVAL;
+
+    cmd = kstrndup(buf, count, GFP_KERNEL);
+    cfg = kzalloc(sizeof(*cfg), GFP_KERNEL);
+    if ((NULL == cmd) || (NULL == cfg))
+    {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    cur = strim(cmd);
+
+    tok = strsep(&cur, " ");
+    if ((NULL == tok) || (0 != kstrtouint(tok, 0, &idx)) || (idx >= LED_MAX_CHANNELS))
+    {
+        goto out;
+    }
+
+    tok = strsep(&cur, " ");
+    if (NULL == tok)
+    {
+        goto out;
+    }
+
+    if (0 == strcmp(tok, "off"))
+    {
+        led_channel_stop(idx);
+        ret = count;
+        goto out;
+    }
+
+    if ((0 != kstrtouint(tok, 0, &cfg->led_gpio_pin)) || (cfg->led_gpio_pin >= GPIO_FAST_BANK_PINS))
+    {
+        goto out;
+    }
+
+    tok = strsep(&cur, " ");
+    if ((NULL == tok) || (0 != kstrtouint(tok, 0, &cfg->repeat)))
+    {
+        goto out;
+    }
+
+    while (NULL != (tok = strsep(&cur, " ")))
+    {
+        if ('\0' == *tok)
+        {
+            continue;
+        }
+
+        if ((cfg->steps_count >= LED_MAX_STEPS) ||
+            (0 != led_parse_step(tok, &cfg->steps[cfg->steps_count])))
+        {
+            goto out;
+        }
+
+        ++(cfg->steps_count);
+    }
+
+    if (0 == cfg->steps_count)
+    {
+        goto out;
+    }
+
+    ret = led_channel_program(idx, cfg);
+    if (0 == ret)
+    {
+        ret = count;
+    }
+
+out:
+    kfree(cfg);
+    kfree(cmd);
+    return ret;
+}
+
+static ssize_t channels_show(struct kobject* kobj, struct kobj_attribute* attr, char* buf)
+{
+    const LED_channel_STC* ch;
+    ssize_t len = 0;
+    int i;
+
+    spin_lock_irq(&led_ctl.lock);
+
+    len += scnprintf(buf + len, PAGE_SIZE - len, "timer expiries: %llu\n", led_ctl.expiries);
+
+    for (i = 0; i < LED_MAX_CHANNELS; ++i)
+    {
+        ch = &led_ctl.channels[i];
+
+        if (0 == ch->steps_count)
+        {
+            continue;
+        }
+
+        len += scnprintf(buf + len, PAGE_SIZE - len,
+                         "ch %d: pin %u, %s, step %u/%u, repeat %u/%u, edges %llu, late %llu\n",
+                         i, ch->led_gpio_pin, ch->is_active ? "running" : "stopped",
+                         ch->curr_step + 1, ch->steps_count, ch->curr_repeat, ch->repeat,
+                         ch->edges, ch->late_edges);
     }
+
+    spin_unlock_irq(&led_ctl.lock);
+
+    return len;
 }
 
+static struct kobj_attribute pattern_attr = __ATTR(pattern, S_IWUSR, NULL, pattern_store);
+static struct kobj_attribute channels_attr = __ATTR(channels, S_IRUGO, channels_show, NULL);
+
+static struct attribute* led_attrs[] = {
+        &pattern_attr.attr,
+        &channels_attr.attr,
+        NULL
+};
+
+static const struct attribute_group led_attr_group = {
+        .attrs = led_attrs
+};
+
 /* Module logic */
 
 static int __init led_mod_init(void)
-{    
-       printk(KERN_INFO "LED interface loaded\n");
+{
+       LED_channel_STC* dflt = &led_ctl.channels[0];
+       int ret;
 
-       gpio1_base = ioremap(GPIO1_MAP_BASE, DEFAULT_IOREMAP_LEN);
-       if (NULL == gpio1_base)
-       { 
-               printk(KERN_ERR "Cannot remap GPIO1 area\n");
-               return -EIO; 
+       spin_lock_init(&led_ctl.lock);
+       mutex_init(&led_ctl.cfg_mtx);
+       hrtimer_init(&led_ctl.led_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+       led_ctl.led_timer.function = timer_handler;
+
+       led_ctl.kobj = kobject_create_and_add("ledmod", kernel_kobj);
+       if (NULL == led_ctl.kobj)
+       {
+               printk(KERN_ERR "Cannot create sysfs entry\n");
+               return -ENOMEM;
        }
 
-       *((reg_ptr_t) gpio1_base + GPIO1_OE_REG) &= ~(GPIO_OE_OUT << (led_usr3_ctl.led_gpio_pin));
-       
-       /* Init the timer */
-       timer_setup(&led_usr3_ctl.led_timer, timer_handler, 0); 
-       mod_timer(&led_usr3_ctl.led_timer, jiffies + led_usr3_ctl.led_blink_interval);
-       
+       ret = sysfs_create_group(led_ctl.kobj, &led_attr_group);
+       if (0 != ret)
+       {
+               printk(KERN_ERR "Cannot create sysfs attributes\n");
+               kobject_put(led_ctl.kobj);
+               return ret;
+       }
+
+       printk(KERN_INFO "LED interface loaded\n");
+
+       /* The good old blink: 1 s on, 1 s off, MAX_LED_BLINK_TIMES times */
+       dflt->led_gpio_pin = GPIO_LED_USR3_PIN;
+       dflt->repeat = MAX_LED_BLINK_TIMES;
+       dflt->steps[0].period_ns = 2 * (u64) LED_LIGHT_INTERVAL_US * NSEC_PER_USEC;
+       dflt->steps[0].on_ns = (u64) LED_LIGHT_INTERVAL_US * NSEC_PER_USEC;
+       dflt->steps[0].cycles = 1;
+       dflt->steps_count = 1;
+
+       gpio_fast_set_output(BIT(dflt->led_gpio_pin));
+       led_channel_start(dflt, ktime_get_ns());
+       led_timer_rearm();
+
        return 0;
 }
- 
+
 static void __exit led_mod_exit(void)
-{ 
+{
+       int i;
+
        /* Do cleanup */
-       
-       /* Switch off the LED */
-       switch_led_off(&led_usr3_ctl);
-       if (0 != del_timer(&led_usr3_ctl.led_timer))
-       {
-               printk(KERN_ERR "Cannot delete LED -associated timer.\n");
-       }
-       
-       if (NULL != gpio1_base)
+       sysfs_remove_group(led_ctl.kobj, &led_attr_group);
+       kobject_put(led_ctl.kobj);
+
+       hrtimer_cancel(&led_ctl.led_timer);
+
+       /* Switch off the LEDs */
+       for (i = 0; i < LED_MAX_CHANNELS; ++i)
        {
-               iounmap(gpio1_base);
+               if (led_ctl.channels[i].is_active)
+               {
+                       gpio_fast_clear(BIT(led_ctl.channels[i].led_gpio_pin));
+               }
        }
-       
+
        printk(KERN_INFO "LED interface unloaded\n");
 }
- 
+
 module_init(led_mod_init);
 module_exit(led_mod_exit);
@@ -2,14 +2,13 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/hrtimer.h>
-#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/atomic.h>
 #include <linux/workqueue.h>
+#include <linux/mutex.h>
 
 #define HRT_UPDATE_INTERVAL_MS (1000)
-#define HRT_STOP_MAX_ATTEMPTS (10)
-#define HRT_DELAY_BETWEN_STOP_ATTEMPTS_MS (100)
-
-#define MS_TO_NS(x) ((x) * 1E6L)
 
 typedef struct HRT_timer_desc_STCT
 {
@@ -26,6 +25,47 @@ static HRT_timer_desc_STC hrt_obj = {0};
 static struct workqueue_struct* timed_wq;
 static struct work_struct timed_work;
 
+static bool is_timer_armed;
+static DEFINE_MUTEX(timer_cfg_mtx);
+
+static unsigned int update_interval_ms = HRT_UPDATE_INTERVAL_MS;
+
+/*
+ * Restarts a running timer with the new period, so a long old period
+ * does not delay the change. A timer the handler gave up on stays off.
+ */
+static int update_interval_set(const char* val, const struct kernel_param* kp)
+{
+    unsigned int interval_ms;
+    int ret = kstrtouint(val, 0, &interval_ms);
+
+    if ((0 != ret) || (0 == interval_ms))
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&timer_cfg_mtx);
+
+    WRITE_ONCE(update_interval_ms, interval_ms);
+
+    if ((true == is_timer_armed) && (true == hrt_obj.need_to_restart))
+    {
+        hrtimer_cancel(&hrt_obj.timer_obj);
+        hrtimer_start(&hrt_obj.timer_obj, ms_to_ktime(interval_ms), HRTIMER_MODE_REL);
+    }
+
+    mutex_unlock(&timer_cfg_mtx);
+    return 0;
+}
+
+static const struct kernel_param_ops update_interval_ops = {
+        .set = update_interval_set,
+        .get = param_get_uint
+};
+
+module_param_cb(update_interval_ms, &update_interval_ops, &update_interval_ms, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(update_interval_ms, "Timer period in ms (writable at runtime)");
+
 static void timed_wq_callback(struct work_struct* work)
 {
     struct timespec time_raw;
@@ -38,9 +78,9 @@ static void timed_wq_callback(struct work_struct* work)
 
 static enum hrtimer_restart timer_common_handler(HRT_timer_desc_STC* timer_stc)
 {
-    if (true == timer_stc->need_to_restart)
+    if (true == READ_ONCE(timer_stc->need_to_restart))
     {
-        hrtimer_forward_now(&(timer_stc->timer_obj), MS_TO_NS(HRT_UPDATE_INTERVAL_MS));
+        hrtimer_forward_now(&(timer_stc->timer_obj), ms_to_ktime(READ_ONCE(update_interval_ms)));
         return HRTIMER_RESTART;
     }
 
@@ -74,13 +114,15 @@ static int __init hrt_init(void)
         
     INIT_WORK(&timed_work, timed_wq_callback);
     
-    test_ktime = ktime_set(0, MS_TO_NS(HRT_UPDATE_INTERVAL_MS));
-    
     hrtimer_init((struct hrtimer*) &hrt_obj, CLOCK_REALTIME, HRTIMER_MODE_REL);
     hrt_obj.timer_obj.function = &timer_callback;
     hrt_obj.need_to_restart = true;
     
+    mutex_lock(&timer_cfg_mtx);
+    test_ktime = ms_to_ktime(update_interval_ms);
     hrtimer_start((struct hrtimer*) &hrt_obj, test_ktime, HRTIMER_MODE_REL);
+    is_timer_armed = true;
+    mutex_unlock(&timer_cfg_mtx);
     
     printk(KERN_INFO "HR timer module loaded.\n");
     return 0;
@@ -88,30 +130,29 @@ static int __init hrt_init(void)
 
 static void __exit hrt_exit(void)
 {
-    int stop_attempts = 0;
+    u64 start_ns = ktime_get_ns();
 
     if (NULL != timed_wq)
     {
-
-        hrt_obj.need_to_restart = false;
-
-        while ((-1 == hrtimer_try_to_cancel(&hrt_obj.timer_obj)) &&
-               (stop_attempts < HRT_STOP_MAX_ATTEMPTS))
-        {
-            ++stop_attempts;
-            msleep(HRT_DELAY_BETWEN_STOP_ATTEMPTS_MS);
-        }
-
-        if (stop_attempts >= HRT_STOP_MAX_ATTEMPTS)
-        {
-            printk(KERN_ERR "Failed to stop the HR timer.\n");
-        }
-
-        flush_workqueue(timed_wq);
+        /* update_interval_set() must not restart the timer we cancel */
+        mutex_lock(&timer_cfg_mtx);
+        is_timer_armed = false;
+        mutex_unlock(&timer_cfg_mtx);
+
+        /*
+         * The handler stops re-arming, and hrtimer_cancel() waits for
+         * a running one: the timer is inactive when it returns.
+         */
+        WRITE_ONCE(hrt_obj.need_to_restart, false);
+        hrtimer_cancel(&hrt_obj.timer_obj);
+
+        /* Nothing queues the work anymore */
+        cancel_work_sync(&timed_work);
         destroy_workqueue(timed_wq);
     }
 
-    printk(KERN_INFO "HR timer module unloaded.\n");
+    printk(KERN_INFO "HR timer module unloaded in %llu us.\n",
+           div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC));
 }
 
 module_init(hrt_init);
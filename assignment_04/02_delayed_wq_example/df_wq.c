@@ -2,8 +2,9 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/workqueue.h>
+#include <linux/mutex.h>
 
-#define WQ_UPDATE_INTERVAL (1 * HZ)
+#define WQ_UPDATE_INTERVAL_MS (1000)
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Victor Krasnoshchok");
@@ -13,9 +14,46 @@ MODULE_VERSION("0.1");
 static struct workqueue_struct* timed_wq;
 static struct delayed_work timed_work;
 
+static bool is_work_armed;
+static DEFINE_MUTEX(work_cfg_mtx);
+
+static unsigned int update_interval_ms = WQ_UPDATE_INTERVAL_MS;
+
+/* A new interval re-arms the pending work at once */
+static int update_interval_set(const char* val, const struct kernel_param* kp)
+{
+    unsigned int interval_ms;
+    int ret = kstrtouint(val, 0, &interval_ms);
+
+    if ((0 != ret) || (0 == interval_ms))
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&work_cfg_mtx);
+
+    WRITE_ONCE(update_interval_ms, interval_ms);
+
+    if (true == is_work_armed)
+    {
+        mod_delayed_work(system_wq, &timed_work, msecs_to_jiffies(interval_ms));
+    }
+
+    mutex_unlock(&work_cfg_mtx);
+    return 0;
+}
+
+static const struct kernel_param_ops update_interval_ops = {
+        .set = update_interval_set,
+        .get = param_get_uint
+};
+
+module_param_cb(update_interval_ms, &update_interval_ops, &update_interval_ms, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(update_interval_ms, "Work period in ms (writable at runtime)");
+
 void schedule_work_item(void)
 {
-    if (false == schedule_delayed_work(&timed_work, WQ_UPDATE_INTERVAL))
+    if (false == schedule_delayed_work(&timed_work, msecs_to_jiffies(READ_ONCE(update_interval_ms))))
     {
         printk(KERN_ERR "Failed to schedule a work item. Already scheduled?\n");
     }
@@ -41,7 +79,11 @@ static int __init dfwq_init(void)
     }
         
     INIT_DELAYED_WORK(&timed_work, timed_wq_callback);
+
+    mutex_lock(&work_cfg_mtx);
     schedule_work_item();
+    is_work_armed = true;
+    mutex_unlock(&work_cfg_mtx);
 
     printk(KERN_INFO "DF_WQ timer module loaded.\n");
     return 0;
@@ -51,6 +93,11 @@ static void __exit dfwq_exit(void)
 {
     if (NULL != timed_wq)
     {
+        /* Else a late interval write could requeue the cancelled work */
+        mutex_lock(&work_cfg_mtx);
+        is_work_armed = false;
+        mutex_unlock(&work_cfg_mtx);
+
         cancel_delayed_work_sync(&timed_work);
         flush_workqueue(timed_wq);
         destroy_workqueue(timed_wq);
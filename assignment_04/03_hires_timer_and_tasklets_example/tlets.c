@@ -2,107 +2,768 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/hrtimer.h>
-#include <linux/delay.h>
 #include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/version.h>
+#include <linux/llist.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <uapi/linux/sched/types.h>
 
 #define HRT_UPDATE_INTERVAL_MS (1000)
-#define HRT_STOP_MAX_ATTEMPTS (10)
-#define HRT_DELAY_BETWEN_STOP_ATTEMPTS_MS (100)
 
-#define MS_TO_NS(x) ((x) * 1E6L)
+/* Benchmark limits */
+#define TL_BENCH_MAX_JOBS (64)
+#define TL_BENCH_DEF_JOBS (4)
+
+/* Batched queue: descriptors per CPU and jobs drained per tasklet run */
+#define TL_BATCH_POOL_SIZE (2 * TL_BENCH_MAX_JOBS)
+#define TL_BATCH_DEF_BUDGET (16)
+
+/* Threaded IRQ handlers run as SCHED_FIFO with this priority */
+#define TL_BENCH_THREAD_PRIO (MAX_USER_RT_PRIO / 2)
+
+/* BH workqueues (work items executed in softirq context) appeared in 6.9 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+#define TL_HAVE_BH_WQ
+#endif
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Victor Krasnoshchok");
-MODULE_DESCRIPTION("HRT example");
-MODULE_VERSION("0.1");
+MODULE_DESCRIPTION("Bottom halves benchmark: tasklets vs. threads vs. WQs");
+MODULE_VERSION("0.2");
+
+static unsigned int jobs_per_tick = TL_BENCH_DEF_JOBS;
+module_param(jobs_per_tick, uint, S_IRUGO);
+MODULE_PARM_DESC(jobs_per_tick, "Deferred jobs fired per timer tick for each mechanism (1..64)");
+
+static unsigned int mech_mask = ~0U;
+module_param(mech_mask, uint, S_IRUGO);
+MODULE_PARM_DESC(mech_mask, "Bitmask of benchmarked mechanisms (bit N = N-th row of the stats)");
+
+static unsigned int batch_budget = TL_BATCH_DEF_BUDGET;
+module_param(batch_budget, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(batch_budget, "Max jobs handled by one run of the batched queue tasklet");
+
+/* ************************************************* */
 
-static struct tasklet_struct tasklet_norm;
-static struct tasklet_struct tasklet_norm1;
-static struct tasklet_struct tasklet_norm2;
-static struct tasklet_struct tasklet_norm3;
-static struct tasklet_struct tasklet_hi;
+typedef enum TL_bench_mech_ENT
+{
+    TL_MECH_TASKLET = 0,
+    TL_MECH_TASKLET_HI,
+    TL_MECH_BH_WQ,
+    TL_MECH_THREADED,
+    TL_MECH_WQ,
+    TL_MECH_BATCH,
+    TL_MECH_COUNT
+} TL_bench_mech_EN;
+
+/* Enqueue-to-run latency accumulator. Updated by one context at a time. */
+typedef struct TL_bench_lat_STCT
+{
+    u64 runs;
+    u64 lat_sum_ns;
+    u64 lat_min_ns;
+    u64 lat_max_ns;
+} TL_bench_lat_STC;
+
+/*
+ * One deferred job. A job is never queued twice: the timer skips
+ * (and counts as an overrun) the jobs which have not run since
+ * the previous tick, so the stats of a job are owned by whatever
+ * context is running it and need no locking.
+ */
+typedef struct TL_bench_job_STCT
+{
+    union
+    {
+        struct tasklet_struct tasklet;
+        struct work_struct    work;
+    };
+    TL_bench_lat_STC lat;
+    u64              enqueue_ns;
+    bool             is_pending;
+} TL_bench_job_STC;
+
+typedef struct TL_bench_mech_STCT
+{
+    const char*      name;
+    bool             is_enabled;
+    u64              enqueued;
+    u64              overruns;
+    u64              enqueue_cost_ns;
+    TL_bench_job_STC jobs[TL_BENCH_MAX_JOBS];
+} TL_bench_mech_STC;
+
+static TL_bench_mech_STC bench_mechs[TL_MECH_COUNT] = {
+        [TL_MECH_TASKLET]    = { .name = "tasklet" },
+        [TL_MECH_TASKLET_HI] = { .name = "tasklet_hi" },
+        [TL_MECH_BH_WQ]      = { .name = "bh_workqueue" },
+        [TL_MECH_THREADED]   = { .name = "threaded" },
+        [TL_MECH_WQ]         = { .name = "workqueue" },
+        [TL_MECH_BATCH]      = { .name = "batched" }
+};
+
+/*
+ * Batched deferred jobs: instead of a tasklet per job the timer
+ * pushes small descriptors to a lock-free list of the current CPU
+ * and schedules a single tasklet which drains the list in one pass.
+ * Both the free list and the pending list of a CPU are popped by
+ * one context only (the timer and the drain tasklet respectively),
+ * which is what llist requires.
+ */
+typedef struct TL_batch_desc_STCT
+{
+    struct llist_node node;
+    u64               enqueue_ns;
+} TL_batch_desc_STC;
+
+typedef struct TL_batch_queue_STCT
+{
+    struct llist_head     pending;
+    struct llist_head     free;
+    struct llist_node*    backlog; /* Detached, not handled yet (FIFO) */
+    struct tasklet_struct drain_tasklet;
+    TL_bench_lat_STC      lat;
+    u64                   drains;
+    u64                   budget_hits;
+    u64                   drain_cost_ns;
+    unsigned int          reset_gen;
+    TL_batch_desc_STC     descs[TL_BATCH_POOL_SIZE];
+} TL_batch_queue_STC;
+
+static DEFINE_PER_CPU(TL_batch_queue_STC, batch_queues);
+static atomic_t batch_reset_gen = ATOMIC_INIT(0);
 
 static struct hrtimer timer_obj;
+static bool is_timer_armed;
+static bool is_stopping;
+static DEFINE_MUTEX(timer_cfg_mtx);
+static struct workqueue_struct* bench_wq;
+static struct task_struct* bench_thread;
+static atomic_t bench_thread_kick = ATOMIC_INIT(0);
+static atomic_t bench_reset_req = ATOMIC_INIT(0);
+static u64 bench_start_ns;
+static u64 bench_ticks;
+static struct dentry* bench_dbg_dir;
+
+/* ************************************************* */
+
+static void bench_lat_account(TL_bench_lat_STC* lat, u64 delta_ns)
+{
+    if ((0 == lat->runs) || (delta_ns < lat->lat_min_ns))
+    {
+        lat->lat_min_ns = delta_ns;
+    }
+
+    if (delta_ns > lat->lat_max_ns)
+    {
+        lat->lat_max_ns = delta_ns;
+    }
+
+    lat->lat_sum_ns += delta_ns;
+    ++lat->runs;
+}
 
-static void tl_norm_callback(unsigned long data)
+static void bench_job_run(TL_bench_job_STC* job)
 {
-    printk(KERN_INFO "TASKLET-NR-%lu\n", data);
+    bench_lat_account(&job->lat, ktime_get_ns() - job->enqueue_ns);
+
+    /* Hand the job back to the timer only after the stats are stored */
+    smp_store_release(&job->is_pending, false);
 }
 
-static void tl_hi_callback(unsigned long data)
+static void tl_callback(unsigned long data)
 {
-    (void) data;
-    printk(KERN_INFO "TASKLET-HI\n");
+    bench_job_run((TL_bench_job_STC*) data);
 }
 
-void schedule_tasklets(void)
+static void wq_callback(struct work_struct* work)
 {
-    tasklet_schedule(&tasklet_norm);
-    tasklet_schedule(&tasklet_norm1);
-    tasklet_schedule(&tasklet_norm2);
-    tasklet_schedule(&tasklet_norm3);
-    tasklet_hi_schedule(&tasklet_hi);
+    bench_job_run(container_of(work, TL_bench_job_STC, work));
+}
+
+/*
+ * Stand-in for a threaded IRQ handler: a SCHED_FIFO kthread woken
+ * from the timer, exactly as irq_wake_thread() does for a real one.
+ */
+static int bench_thread_fn(void* data)
+{
+    TL_bench_mech_STC* mech = (TL_bench_mech_STC*) data;
+    int i;
+
+    for (;;)
+    {
+        set_current_state(TASK_INTERRUPTIBLE);
+
+        if (kthread_should_stop())
+        {
+            break;
+        }
+
+        if (0 == atomic_xchg(&bench_thread_kick, 0))
+        {
+            schedule();
+            continue;
+        }
+
+        __set_current_state(TASK_RUNNING);
+
+        for (i = 0; i < TL_BENCH_MAX_JOBS; ++i)
+        {
+            if (smp_load_acquire(&mech->jobs[i].is_pending))
+            {
+                bench_job_run(&mech->jobs[i]);
+            }
+        }
+    }
+
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+static void bench_thread_set_prio(struct task_struct* task)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    sched_set_fifo(task);
+#else
+    struct sched_param param = { .sched_priority = TL_BENCH_THREAD_PRIO };
+
+    sched_setscheduler(task, SCHED_FIFO, &param);
+#endif
+}
+
+/* ************************************************* */
+
+static void batch_drain(unsigned long data)
+{
+    TL_batch_queue_STC* q = (TL_batch_queue_STC*) data;
+    TL_batch_desc_STC* desc;
+    struct llist_node* node;
+    unsigned int budget = max(READ_ONCE(batch_budget), 1U);
+    unsigned int gen = atomic_read(&batch_reset_gen);
+    unsigned int done = 0;
+    u64 start_ns = ktime_get_ns();
+
+    /* The per-CPU counters are reset by their owner */
+    if (gen != q->reset_gen)
+    {
+        memset(&q->lat, 0, sizeof(q->lat));
+        q->drains = 0;
+        q->budget_hits = 0;
+        q->drain_cost_ns = 0;
+        q->reset_gen = gen;
+    }
+
+    while (done < budget)
+    {
+        if (NULL == q->backlog)
+        {
+            q->backlog = llist_reverse_order(llist_del_all(&q->pending));
+
+            if (NULL == q->backlog)
+            {
+                break;
+            }
+        }
+
+        node = q->backlog;
+        q->backlog = node->next;
+
+        desc = llist_entry(node, TL_batch_desc_STC, node);
+        bench_lat_account(&q->lat, ktime_get_ns() - desc->enqueue_ns);
+        llist_add(&desc->node, &q->free);
+        ++done;
+    }
+
+    q->drain_cost_ns += ktime_get_ns() - start_ns;
+    ++q->drains;
+
+    /* Out of budget: let other softirqs run and come back later */
+    if ((NULL != q->backlog) || (false == llist_empty(&q->pending)))
+    {
+        ++q->budget_hits;
+        tasklet_schedule(&q->drain_tasklet);
+    }
+}
+
+static void batch_enqueue_jobs(TL_bench_mech_STC* mech, unsigned int jobs)
+{
+    TL_batch_queue_STC* q = this_cpu_ptr(&batch_queues);
+    TL_batch_desc_STC* desc;
+    struct llist_node* node;
+    unsigned int queued = 0;
+    int i;
+
+    for (i = 0; i < jobs; ++i)
+    {
+        node = llist_del_first(&q->free);
+        if (NULL == node)
+        {
+            ++mech->overruns;
+            continue;
+        }
+
+        desc = llist_entry(node, TL_batch_desc_STC, node);
+        desc->enqueue_ns = ktime_get_ns();
+        llist_add(&desc->node, &q->pending);
+        ++queued;
+    }
+
+    if (0 != queued)
+    {
+        tasklet_schedule(&q->drain_tasklet);
+        mech->enqueued += queued;
+    }
+}
+
+/* Called from the timer context only */
+static void bench_reset(void)
+{
+    TL_bench_job_STC* job;
+    int m;
+    int i;
+
+    for (m = 0; m < TL_MECH_COUNT; ++m)
+    {
+        bench_mechs[m].enqueued = 0;
+        bench_mechs[m].overruns = 0;
+        bench_mechs[m].enqueue_cost_ns = 0;
+
+        for (i = 0; i < TL_BENCH_MAX_JOBS; ++i)
+        {
+            job = &bench_mechs[m].jobs[i];
+
+            /* A pending job is owned by its runner - keep its stats */
+            if (false == smp_load_acquire(&job->is_pending))
+            {
+                memset(&job->lat, 0, sizeof(job->lat));
+            }
+        }
+    }
+
+    atomic_inc(&batch_reset_gen);
+    bench_ticks = 0;
+    bench_start_ns = ktime_get_ns();
+}
+
+static void bench_enqueue_job(TL_bench_mech_EN mech_id, TL_bench_job_STC* job)
+{
+    switch (mech_id)
+    {
+    case TL_MECH_TASKLET:
+        tasklet_schedule(&job->tasklet);
+        break;
+    case TL_MECH_TASKLET_HI:
+        tasklet_hi_schedule(&job->tasklet);
+        break;
+#ifdef TL_HAVE_BH_WQ
+    case TL_MECH_BH_WQ:
+        queue_work(system_bh_wq, &job->work);
+        break;
+#endif
+    case TL_MECH_WQ:
+        queue_work(bench_wq, &job->work);
+        break;
+    default:
+        /* TL_MECH_THREADED: the thread is kicked once per tick */
+        break;
+    }
+}
+
+static void schedule_deferred_jobs(void)
+{
+    TL_bench_mech_STC* mech;
+    TL_bench_job_STC* job;
+    unsigned int jobs = clamp_val(jobs_per_tick, 1, TL_BENCH_MAX_JOBS);
+    u64 start_ns;
+    int m;
+    int i;
+
+    for (m = 0; m < TL_MECH_COUNT; ++m)
+    {
+        mech = &bench_mechs[m];
+
+        if (false == mech->is_enabled)
+        {
+            continue;
+        }
+
+        start_ns = ktime_get_ns();
+
+        if (TL_MECH_BATCH == m)
+        {
+            batch_enqueue_jobs(mech, jobs);
+            mech->enqueue_cost_ns += ktime_get_ns() - start_ns;
+            continue;
+        }
+
+        for (i = 0; i < jobs; ++i)
+        {
+            job = &mech->jobs[i];
+
+            if (smp_load_acquire(&job->is_pending))
+            {
+                ++mech->overruns;
+                continue;
+            }
+
+            /* The thread polls is_pending, so publish the stamp first */
+            job->enqueue_ns = ktime_get_ns();
+            smp_store_release(&job->is_pending, true);
+            bench_enqueue_job(m, job);
+            ++mech->enqueued;
+        }
+
+        if (TL_MECH_THREADED == m)
+        {
+            atomic_set(&bench_thread_kick, 1);
+            wake_up_process(bench_thread);
+        }
+
+        mech->enqueue_cost_ns += ktime_get_ns() - start_ns;
+    }
 }
 
 /* Timer-related stuff */
 
+static unsigned int update_interval_ms = HRT_UPDATE_INTERVAL_MS;
+
+/* The next tick comes one new interval after the write */
+static int update_interval_set(const char* val, const struct kernel_param* kp)
+{
+    unsigned int interval_ms;
+    int ret = kstrtouint(val, 0, &interval_ms);
+
+    if ((0 != ret) || (0 == interval_ms))
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&timer_cfg_mtx);
+
+    WRITE_ONCE(update_interval_ms, interval_ms);
+
+    if (true == is_timer_armed)
+    {
+        hrtimer_cancel(&timer_obj);
+        hrtimer_start(&timer_obj, ms_to_ktime(interval_ms), HRTIMER_MODE_REL);
+    }
+
+    mutex_unlock(&timer_cfg_mtx);
+    return 0;
+}
+
+static const struct kernel_param_ops update_interval_ops = {
+        .set = update_interval_set,
+        .get = param_get_uint
+};
+
+module_param_cb(update_interval_ms, &update_interval_ops, &update_interval_ms, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(update_interval_ms, "Timer period in ms (writable at runtime)");
+
 static enum hrtimer_restart timer_common_handler(struct hrtimer* timer_stc)
 {
-    hrtimer_forward_now(timer_stc, MS_TO_NS(HRT_UPDATE_INTERVAL_MS));
+    if (true == READ_ONCE(is_stopping))
+    {
+        return HRTIMER_NORESTART;
+    }
+
+    hrtimer_forward_now(timer_stc, ms_to_ktime(READ_ONCE(update_interval_ms)));
     return HRTIMER_RESTART;
 }
 
 static enum hrtimer_restart timer_callback(struct hrtimer* timer)
 {
-    schedule_tasklets();
-    printk(KERN_INFO "---------------\n");
+    if (0 != atomic_xchg(&bench_reset_req, 0))
+    {
+        bench_reset();
+    }
+
+    schedule_deferred_jobs();
+    ++bench_ticks;
     return timer_common_handler(timer);
 }
 
+/* ****************** debugfs ********************** */
+
+static void bench_lat_merge(TL_bench_lat_STC* sum, const TL_bench_lat_STC* lat)
+{
+    if (0 == lat->runs)
+    {
+        return;
+    }
+
+    if ((0 == sum->runs) || (lat->lat_min_ns < sum->lat_min_ns))
+    {
+        sum->lat_min_ns = lat->lat_min_ns;
+    }
+
+    sum->lat_max_ns = max(sum->lat_max_ns, lat->lat_max_ns);
+    sum->lat_sum_ns += lat->lat_sum_ns;
+    sum->runs += lat->runs;
+}
+
+static void bench_batch_stats_show(struct seq_file* s, TL_bench_lat_STC* sum)
+{
+    TL_batch_queue_STC* q;
+    u64 drains = 0;
+    u64 budget_hits = 0;
+    u64 drain_cost_ns = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        q = per_cpu_ptr(&batch_queues, cpu);
+        bench_lat_merge(sum, &q->lat);
+        drains += q->drains;
+        budget_hits += q->budget_hits;
+        drain_cost_ns += q->drain_cost_ns;
+    }
+
+    seq_printf(s, "batched: budget %u, drains %llu, budget hits %llu, "
+                  "jobs/drain %llu, drain ns/job %llu\n",
+               batch_budget, drains, budget_hits,
+               drains ? div64_u64(sum->runs, drains) : 0,
+               sum->runs ? div64_u64(drain_cost_ns, sum->runs) : 0);
+}
+
+static int bench_stats_show(struct seq_file* s, void* unused)
+{
+    TL_bench_mech_STC* mech;
+    TL_bench_lat_STC sum;
+    TL_bench_lat_STC batch_sum = { 0 };
+    u64 elapsed_ns = ktime_get_ns() - READ_ONCE(bench_start_ns);
+    int m;
+    int i;
+
+    seq_printf(s, "ticks: %llu, jobs per tick: %u, elapsed: %llu ms\n",
+               bench_ticks, jobs_per_tick, div_u64(elapsed_ns, NSEC_PER_MSEC));
+    if (bench_mechs[TL_MECH_BATCH].is_enabled)
+    {
+        bench_batch_stats_show(s, &batch_sum);
+    }
+
+    seq_printf(s, "%-14s %10s %10s %9s %9s %9s %9s %10s %10s\n",
+               "mechanism", "enqueued", "runs", "overruns",
+               "min_ns", "avg_ns", "max_ns", "jobs/s", "enq_ns/job");
+
+    for (m = 0; m < TL_MECH_COUNT; ++m)
+    {
+        mech = &bench_mechs[m];
+
+        if (false == mech->is_enabled)
+        {
+            seq_printf(s, "%-14s n/a\n", mech->name);
+            continue;
+        }
+
+        if (TL_MECH_BATCH == m)
+        {
+            sum = batch_sum;
+        }
+        else
+        {
+            memset(&sum, 0, sizeof(sum));
+
+            for (i = 0; i < TL_BENCH_MAX_JOBS; ++i)
+            {
+                bench_lat_merge(&sum, &mech->jobs[i].lat);
+            }
+        }
+
+        seq_printf(s, "%-14s %10llu %10llu %9llu %9llu %9llu %9llu %10llu %10llu\n",
+                   mech->name, mech->enqueued, sum.runs, mech->overruns,
+                   sum.lat_min_ns,
+                   sum.runs ? div64_u64(sum.lat_sum_ns, sum.runs) : 0,
+                   sum.lat_max_ns,
+                   elapsed_ns ? div64_u64(sum.runs * NSEC_PER_SEC, elapsed_ns) : 0,
+                   mech->enqueued ? div64_u64(mech->enqueue_cost_ns, mech->enqueued) : 0);
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bench_stats);
+
+static ssize_t bench_reset_write(struct file* file, const char __user* buf,
+                                 size_t count, loff_t* ppos)
+{
+    /* Served by the timer which owns the counters */
+    atomic_set(&bench_reset_req, 1);
+    return count;
+}
+
+static const struct file_operations bench_reset_fops = {
+        .owner = THIS_MODULE,
+        .write = bench_reset_write,
+        .llseek = noop_llseek
+};
+
+/* ************************************************* */
+
+static void bench_jobs_init(void)
+{
+    TL_bench_mech_STC* mech;
+    TL_bench_job_STC* job;
+    int m;
+    int i;
+
+    for (m = 0; m < TL_MECH_COUNT; ++m)
+    {
+        mech = &bench_mechs[m];
+        mech->is_enabled = (0 != (mech_mask & BIT(m)));
+
+        for (i = 0; i < TL_BENCH_MAX_JOBS; ++i)
+        {
+            job = &mech->jobs[i];
+
+            if ((TL_MECH_TASKLET == m) || (TL_MECH_TASKLET_HI == m))
+            {
+                tasklet_init(&job->tasklet, tl_callback, (unsigned long) job);
+            }
+            else
+            {
+                INIT_WORK(&job->work, wq_callback);
+            }
+        }
+    }
+
+#ifndef TL_HAVE_BH_WQ
+    bench_mechs[TL_MECH_BH_WQ].is_enabled = false;
+#endif
+}
+
+static void batch_queues_init(void)
+{
+    TL_batch_queue_STC* q;
+    int cpu;
+    int i;
+
+    for_each_possible_cpu(cpu)
+    {
+        q = per_cpu_ptr(&batch_queues, cpu);
+
+        init_llist_head(&q->pending);
+        init_llist_head(&q->free);
+        q->backlog = NULL;
+
+        for (i = 0; i < TL_BATCH_POOL_SIZE; ++i)
+        {
+            llist_add(&q->descs[i].node, &q->free);
+        }
+
+        tasklet_init(&q->drain_tasklet, batch_drain, (unsigned long) q);
+    }
+}
+
+static void bench_tasklets_kill(void)
+{
+    int cpu;
+    int i;
+
+    for (i = 0; i < TL_BENCH_MAX_JOBS; ++i)
+    {
+        tasklet_kill(&bench_mechs[TL_MECH_TASKLET].jobs[i].tasklet);
+        tasklet_kill(&bench_mechs[TL_MECH_TASKLET_HI].jobs[i].tasklet);
+    }
+
+    for_each_possible_cpu(cpu)
+    {
+        tasklet_kill(&per_cpu_ptr(&batch_queues, cpu)->drain_tasklet);
+    }
+}
+
+/* BH work items live on a system queue which cannot be destroyed */
+static void bench_bh_works_cancel(void)
+{
+#ifdef TL_HAVE_BH_WQ
+    int i;
+
+    for (i = 0; i < TL_BENCH_MAX_JOBS; ++i)
+    {
+        cancel_work_sync(&bench_mechs[TL_MECH_BH_WQ].jobs[i].work);
+    }
+#endif
+}
+
 static int __init hrt_init(void)
 {
     ktime_t test_ktime;
-    
-    tasklet_init(&tasklet_norm, tl_norm_callback, 0); 
-    tasklet_init(&tasklet_norm1, tl_norm_callback, 1); 
-    tasklet_init(&tasklet_norm2, tl_norm_callback, 2); 
-    tasklet_init(&tasklet_norm3, tl_norm_callback, 3); 
-    tasklet_init(&tasklet_hi, tl_hi_callback, 0);
-    
-    test_ktime = ktime_set(0, MS_TO_NS(HRT_UPDATE_INTERVAL_MS));
-    
+
+    bench_jobs_init();
+    batch_queues_init();
+
+    bench_wq = alloc_workqueue("TL_BENCH_WQ", WQ_HIGHPRI, 0);
+    if (NULL == bench_wq)
+    {
+        printk(KERN_ERR "Failed to create the workqueue.\n");
+        return -ENOMEM;
+    }
+
+    bench_thread = kthread_create(bench_thread_fn,
+                                  &bench_mechs[TL_MECH_THREADED],
+                                  "tl_bench_thread");
+    if (IS_ERR(bench_thread))
+    {
+        printk(KERN_ERR "Failed to create the benchmark thread.\n");
+        destroy_workqueue(bench_wq);
+        return PTR_ERR(bench_thread);
+    }
+
+    bench_thread_set_prio(bench_thread);
+    wake_up_process(bench_thread);
+
+    /* The stats are still usable without debugfs, so it is not fatal */
+    bench_dbg_dir = debugfs_create_dir("tlets_bench", NULL);
+    debugfs_create_file("stats", S_IRUGO, bench_dbg_dir, NULL, &bench_stats_fops);
+    debugfs_create_file("reset", S_IWUSR, bench_dbg_dir, NULL, &bench_reset_fops);
+
+    bench_start_ns = ktime_get_ns();
     hrtimer_init(&timer_obj, CLOCK_REALTIME, HRTIMER_MODE_REL);
     timer_obj.function = &timer_callback;
-    
+
+    mutex_lock(&timer_cfg_mtx);
+    test_ktime = ms_to_ktime(update_interval_ms);
     hrtimer_start(&timer_obj, test_ktime, HRTIMER_MODE_REL);
-    
+    is_timer_armed = true;
+    mutex_unlock(&timer_cfg_mtx);
+
     printk(KERN_INFO "TL timer module loaded.\n");
     return 0;
 }
 
+/*
+ * Teardown goes from the producers to the consumers: the timer first,
+ * then the thread, tasklets & works it feeds. No step needs a retry.
+ */
 static void __exit hrt_exit(void)
 {
-    int stop_attempts = 0;
+    u64 start_ns = ktime_get_ns();
 
-    while ((-1 == hrtimer_try_to_cancel(&timer_obj)) &&
-           (stop_attempts < HRT_STOP_MAX_ATTEMPTS))
-    {
-        ++stop_attempts;
-        msleep(HRT_DELAY_BETWEN_STOP_ATTEMPTS_MS);
-    }
+    /* From here on an interval write only stores the value */
+    mutex_lock(&timer_cfg_mtx);
+    is_timer_armed = false;
+    mutex_unlock(&timer_cfg_mtx);
 
-    if (stop_attempts >= HRT_STOP_MAX_ATTEMPTS)
-    {
-        printk(KERN_ERR "Failed to stop the HR timer.\n");
-    }
+    /* hrtimer_cancel() waits for a running handler, which won't re-arm */
+    WRITE_ONCE(is_stopping, true);
+    hrtimer_cancel(&timer_obj);
+
+    debugfs_remove_recursive(bench_dbg_dir);
 
-    tasklet_kill(&tasklet_norm);
-    tasklet_kill(&tasklet_norm1);
-    tasklet_kill(&tasklet_norm2);
-    tasklet_kill(&tasklet_norm3);
-    tasklet_kill(&tasklet_hi);
+    kthread_stop(bench_thread);
+    bench_tasklets_kill();
+    bench_bh_works_cancel();
+    destroy_workqueue(bench_wq);
 
-    printk(KERN_INFO "HR timer module unloaded.\n");
+    printk(KERN_INFO "HR timer module unloaded in %llu us.\n",
+           div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC));
 }
 
 module_init(hrt_init);
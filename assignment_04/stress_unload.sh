@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+# Load/unload stress for the timer examples: each module is loaded with
+# a 1 ms period, left running for a while and removed, so the unload
+# races a timer that is about to fire.
+#
+# The run fails if an exit handler did not complete (its "unloaded"
+# message is missing) or if anything oopsed or warned meanwhile. A
+# timer or work that fires after the exit runs freed module code, so
+# it shows up as an oops.
+#
+# Usage: stress_unload.sh [iterations] [run time in s]
+# Run as root after building the modules in their directories.
+
+ITERATIONS=${1:-100}
+RUN_TIME=${2:-0.2}
+DIR=$(cd "$(dirname "$0")" && pwd)
+
+MODULES="
+$DIR/01_hires_timer_and_wq_example/hrt.ko
+$DIR/02_delayed_wq_example/df_wq.ko
+$DIR/03_hires_timer_and_tasklets_example/tlets.ko
+"
+
+now_us()
+{
+    echo $(( $(date +%s%N) / 1000 ))
+}
+
+# The kernel log from the given marker on
+log_since()
+{
+    dmesg | sed -n "/$1/,\$p"
+}
+
+run_mark="stress_unload: start $$"
+echo "$run_mark" > /dev/kmsg
+failed=0
+
+for ko in $MODULES; do
+    if [ ! -f "$ko" ]; then
+        echo "Skipping $ko: not built"
+        continue
+    fi
+
+    name=$(basename "$ko" .ko)
+    mod_mark="stress_unload: $name $$"
+    echo "$mod_mark" > /dev/kmsg
+
+    max_us=0
+    total_us=0
+    i=0
+
+    while [ $i -lt "$ITERATIONS" ]; do
+        insmod "$ko" update_interval_ms=1 || exit 1
+        sleep "$RUN_TIME"
+
+        start=$(now_us)
+        rmmod "$name" || exit 1
+        took=$(( $(now_us) - start ))
+
+        total_us=$(( total_us + took ))
+        [ $took -gt $max_us ] && max_us=$took
+        i=$(( i + 1 ))
+    done
+
+    echo "$name: $ITERATIONS unloads, avg $(( total_us / ITERATIONS )) us, max $max_us us"
+
+    unloads=$(log_since "$mod_mark" | grep -c "module unloaded")
+    if [ "$unloads" -ne "$ITERATIONS" ]; then
+        echo "FAIL: $name logged $unloads of $ITERATIONS unloads"
+        failed=1
+    fi
+done
+
+if log_since "$run_mark" | grep -E "Oops|BUG:|WARNING:|Call Trace"; then
+    echo "FAIL: the kernel log has errors"
+    failed=1
+fi
+
+[ $failed -eq 0 ] && echo "PASS"
+exit $failed
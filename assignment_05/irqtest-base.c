@@ -0,0 +1,666 @@
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/interrupt.h>
+#include <linux/gpio.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/atomic.h>
+#include <linux/slab.h>
+#include <linux/cache.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+
+#include "gpio_fast.h"
+#include "irqtest.h"
+
+#define GPIO2_8 (32 + 32 + 8)
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Victor Krasnoshchok");
+MODULE_DESCRIPTION("IRQ example");
+MODULE_VERSION("0.3");
+
+/* ************************************************* */
+
+/* GPIO LED pins (GPIO1 bank, mapped by the gpio_fast module) */
+/* On-board USR3 LED */
+#define GPIO_LED_USR3_PIN (24)
+
+/* Software injector limits */
+#define IRQ_INJECT_MAX_COUNT (1000000)
+
+#define IRQ_EDGES_MASK (IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING)
+
+/* ************************************************* */
+
+static int gpios[IRQTEST_MAX_PINS] = { GPIO2_8 };
+static unsigned int gpios_count = 1;
+module_param_array(gpios, int, &gpios_count, S_IRUGO);
+MODULE_PARM_DESC(gpios, "Monitored GPIOs (default - S2 button, GPIO2_8)");
+
+static unsigned int edges[IRQTEST_MAX_PINS] = { IRQ_EDGES_MASK };
+static unsigned int edges_count = 1;
+module_param_array(edges, uint, &edges_count, S_IRUGO);
+MODULE_PARM_DESC(edges, "Edges per pin: 1 - rising, 2 - falling, 3 - both; the last one applies to the rest");
+
+static int loopback_gpio = -1;
+module_param(loopback_gpio, int, S_IRUGO);
+MODULE_PARM_DESC(loopback_gpio, "Output GPIO wired to the first pin, used by the injector (-1 - none)");
+
+/*
+ * Per-pin state. dev_id of a pin's IRQ points to its entry, so the
+ * handler cost does not depend on the number of pins. Handlers of
+ * different pins run on different CPUs: one cache line per pin.
+ */
+typedef struct IRQ_pin_STCT
+{
+    unsigned int          index;
+    int                   gpio;
+    int                   irq;
+    unsigned long         trigger;
+    bool                  is_injecting; /* The handler is called by the injector */
+
+    struct tasklet_struct tasklet;
+    struct work_struct    work;
+
+    /* Trigger (or handler entry) time of the oldest unserved edge */
+    atomic64_t            bh_ns;
+
+    /* Written by the handler of the pin only */
+    u64                   edges;
+    u64                   last_edge_ns;
+
+    /* Rate estimation, owned by the debugfs reader */
+    u64                   snap_edges;
+    u64                   snap_ns;
+} ____cacheline_aligned_in_smp IRQ_pin_STC;
+
+static IRQ_pin_STC* pins;
+static unsigned int pins_count;
+
+static struct workqueue_struct* irq_wq;
+static struct dentry* irq_dbg_dir;
+
+/* Serializes IRQ (re)registration, injections and the stats snapshots */
+static DEFINE_MUTEX(irq_cfg_mtx);
+static IRQ_mode_EN irq_mode = IRQ_MODE_TASKLET;
+static bool is_irq_requested = false;
+
+/*
+ * When the edge was generated; known for loopback injections only
+ * (0 otherwise).
+ */
+static atomic64_t irq_trigger_ns = ATOMIC64_INIT(0);
+
+/* ************* USR LED helpers ******************* */
+
+/*
+ * The bottom halves of all the pins toggle USR3. gpio_fast leaves the
+ * serialization of one pin to its owner: unlocked, two toggles could
+ * land their SET/CLR stores in the opposite order of the shadow update.
+ */
+static DEFINE_SPINLOCK(led_lock);
+
+/* GPIO helpers. Safe from any bottom half (tasklet, work or IRQ thread) */
+static void toggle_led(void)
+{
+    spin_lock_bh(&led_lock);
+    gpio_fast_toggle(BIT(GPIO_LED_USR3_PIN));
+    spin_unlock_bh(&led_lock);
+}
+
+/* ***************** IRQ Stuff ******************** */
+
+/* Common part of all the bottom halves: the LED shows activity on any pin */
+static void irq_bottom_half(IRQ_pin_STC* pin)
+{
+    u64 irq_ns = atomic64_xchg(&pin->bh_ns, 0);
+
+    if (0 != irq_ns)
+    {
+        irq_lat_account(READ_ONCE(irq_mode), IRQ_LAT_TO_BH, ktime_get_ns() - irq_ns);
+    }
+
+    printk_ratelimited(KERN_INFO "*%u\n", pin->index);
+    toggle_led();
+}
+
+static void irq_tl_callback(unsigned long data)
+{
+    irq_bottom_half((IRQ_pin_STC*) data);
+}
+
+static void irq_work_callback(struct work_struct* work)
+{
+    irq_bottom_half(container_of(work, IRQ_pin_STC, work));
+}
+
+static irqreturn_t irq_thread_fn(int irq, void* dev_id)
+{
+    irq_bottom_half((IRQ_pin_STC*) dev_id);
+    return IRQ_HANDLED;
+}
+
+/*
+ * Hardirq part, common for all the modes: timestamp and queue the
+ * edge. Returns true if the bottom half has to be run.
+ */
+static bool irq_top_half(IRQ_pin_STC* pin)
+{
+    u64 timestamp_ns = ktime_get_ns();
+    u64 trigger_ns = atomic64_xchg(&irq_trigger_ns, 0);
+    int level = gpio_get_value(pin->gpio);
+    u16 flags = pin->is_injecting ? IRQ_EVENT_INJECTED : 0;
+
+    if (0 != trigger_ns)
+    {
+        irq_lat_account(irq_mode, IRQ_LAT_TO_HANDLER, timestamp_ns - trigger_ns);
+    }
+    else
+    {
+        trigger_ns = timestamp_ns;
+    }
+
+    ++pin->edges;
+    pin->last_edge_ns = timestamp_ns;
+
+    /* Every edge is queued, the bottom half runs on the rising ones only */
+    if (irq_events_capture(pin->index, timestamp_ns, level, flags) && (0 != level))
+    {
+        /* Keep the oldest unserved edge if the bottom half is late */
+        atomic64_cmpxchg(&pin->bh_ns, 0, trigger_ns);
+        return true;
+    }
+
+    return false;
+}
+
+static irqreturn_t irq_test_handler(int irq, void* dev_id)
+{
+    IRQ_pin_STC* pin = (IRQ_pin_STC*) dev_id;
+
+    (void) irq;
+
+    if (irq_top_half(pin))
+    {
+        if (IRQ_MODE_WORKQUEUE == irq_mode)
+        {
+            queue_work(irq_wq, &pin->work);
+        }
+        else
+        {
+            tasklet_schedule(&pin->tasklet);
+        }
+    }
+
+    return IRQ_HANDLED;
+}
+
+static irqreturn_t irq_primary_handler(int irq, void* dev_id)
+{
+    (void) irq;
+
+    return irq_top_half((IRQ_pin_STC*) dev_id) ? IRQ_WAKE_THREAD : IRQ_HANDLED;
+}
+
+/* ************ IRQ (re)registration *************** */
+
+/* Called with irq_cfg_mtx held */
+static void irq_free_pins(unsigned int count)
+{
+    IRQ_pin_STC* pin;
+    unsigned int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        pin = &pins[i];
+
+        /* Waits for the handler and the IRQ thread */
+        free_irq(pin->irq, (void*) pin);
+
+        tasklet_kill(&pin->tasklet);
+        flush_work(&pin->work);
+        atomic64_set(&pin->bh_ns, 0);
+    }
+}
+
+/* Called with irq_cfg_mtx held */
+static int irq_setup(IRQ_mode_EN mode)
+{
+    IRQ_pin_STC* pin;
+    unsigned int i;
+    int ret = 0;
+
+    irq_mode = mode;
+
+    for (i = 0; i < pins_count; ++i)
+    {
+        pin = &pins[i];
+
+        if (IRQ_MODE_THREADED == mode)
+        {
+            ret = request_threaded_irq(pin->irq, irq_primary_handler, irq_thread_fn,
+                                       IRQF_SHARED | pin->trigger, "irqtest", (void*) pin);
+        }
+        else
+        {
+            ret = request_irq(pin->irq, irq_test_handler,
+                              IRQF_SHARED | pin->trigger, "irqtest", (void*) pin);
+        }
+
+        if (0 != ret)
+        {
+            printk(KERN_ERR "Failed to request IRQ %d of GPIO %d (%s mode).\n",
+                   pin->irq, pin->gpio, irq_mode_name(mode));
+            irq_free_pins(i);
+            return ret;
+        }
+    }
+
+    is_irq_requested = true;
+    return 0;
+}
+
+/* Called with irq_cfg_mtx held */
+static void irq_teardown(void)
+{
+    if (false == is_irq_requested)
+    {
+        return;
+    }
+
+    irq_free_pins(pins_count);
+    is_irq_requested = false;
+}
+
+static int irq_mode_set(const char* val, const struct kernel_param* kp)
+{
+    IRQ_mode_EN prev_mode;
+    int mode;
+    int ret = 0;
+
+    for (mode = 0; mode < IRQ_MODE_COUNT; ++mode)
+    {
+        if (sysfs_streq(val, irq_mode_name(mode)))
+        {
+            break;
+        }
+    }
+
+    if (IRQ_MODE_COUNT == mode)
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&irq_cfg_mtx);
+
+    /* Before the module init just remember the mode */
+    if ((true == is_irq_requested) && (mode != irq_mode))
+    {
+        prev_mode = irq_mode;
+
+        irq_teardown();
+        ret = irq_setup(mode);
+        if (0 != ret)
+        {
+            /* Try to keep the IRQs alive with the previous mode */
+            irq_setup(prev_mode);
+        }
+    }
+    else
+    {
+        irq_mode = mode;
+    }
+
+    mutex_unlock(&irq_cfg_mtx);
+    return ret;
+}
+
+static int irq_mode_get(char* buf, const struct kernel_param* kp)
+{
+    return sprintf(buf, "%s\n", irq_mode_name(READ_ONCE(irq_mode)));
+}
+
+static const struct kernel_param_ops irq_mode_ops = {
+        .set = irq_mode_set,
+        .get = irq_mode_get
+};
+
+module_param_cb(irq_mode, &irq_mode_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irq_mode, "Bottom half: tasklet, threaded or workqueue (writable at runtime)");
+
+/* ************* Software injector ***************** */
+
+/*
+ * "echo <count> [interval_us] [pin] > /sys/kernel/debug/irqtest/inject"
+ * runs the handler of the pin <count> times exactly as the IRQ core
+ * would: with the line disabled (so the handler is not reentered and
+ * the events ring keeps its single producer) and local interrupts off.
+ *
+ * If loopback_gpio is wired to the first pin, the injector toggles
+ * it instead, so the edges go through the real IRQ path and the
+ * IRQ-to-handler latency can be measured.
+ */
+static void irq_inject_one(IRQ_pin_STC* pin)
+{
+    unsigned long irq_flags;
+    irqreturn_t ret;
+
+    if ((loopback_gpio >= 0) && (0 == pin->index))
+    {
+        atomic64_set(&irq_trigger_ns, ktime_get_ns());
+        gpio_set_value(loopback_gpio, !gpio_get_value(loopback_gpio));
+        return;
+    }
+
+    disable_irq(pin->irq);
+    local_irq_save(irq_flags);
+
+    pin->is_injecting = true;
+    if (IRQ_MODE_THREADED == irq_mode)
+    {
+        ret = irq_primary_handler(pin->irq, (void*) pin);
+    }
+    else
+    {
+        ret = irq_test_handler(pin->irq, (void*) pin);
+    }
+    pin->is_injecting = false;
+
+    if (IRQ_WAKE_THREAD == ret)
+    {
+        irq_wake_thread(pin->irq, (void*) pin);
+    }
+
+    local_irq_restore(irq_flags);
+    enable_irq(pin->irq);
+}
+
+static void irq_inject(IRQ_pin_STC* pin, unsigned int count, unsigned int interval_us)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        irq_inject_one(pin);
+
+        if (0 != interval_us)
+        {
+            usleep_range(interval_us, interval_us + 1);
+        }
+        else
+        {
+            cond_resched();
+        }
+    }
+}
+
+static ssize_t irq_inject_write(struct file* file, const char __user* buf,
+                                size_t count, loff_t* ppos)
+{
+    char cmd[32] = { 0 };
+    unsigned int inject_count = 0;
+    unsigned int interval_us = 0;
+    unsigned int pin_idx = 0;
+
+    if (0 != copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+    {
+        return -EFAULT;
+    }
+
+    if ((sscanf(cmd, "%u %u %u", &inject_count, &interval_us, &pin_idx) < 1) ||
+        (inject_count > IRQ_INJECT_MAX_COUNT) || (pin_idx >= pins_count))
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&irq_cfg_mtx);
+
+    if (true == is_irq_requested)
+    {
+        irq_inject(&pins[pin_idx], inject_count, interval_us);
+    }
+
+    mutex_unlock(&irq_cfg_mtx);
+    return count;
+}
+
+static const struct file_operations irq_inject_fops = {
+        .owner  = THIS_MODULE,
+        .write  = irq_inject_write,
+        .llseek = noop_llseek
+};
+
+/* ****************** Pin stats ******************** */
+
+/* Rates are averaged over the interval since the previous read */
+static int irq_pins_show(struct seq_file* s, void* unused)
+{
+    IRQ_events_stats_STC ev_stats;
+    IRQ_pin_STC* pin;
+    u64 now_ns = ktime_get_ns();
+    u64 edges;
+    u64 rate;
+    u64 total_rate = 0;
+    u64 total_edges = 0;
+    unsigned int i;
+
+    mutex_lock(&irq_cfg_mtx);
+
+    seq_printf(s, "mode: %s\n", irq_mode_name(irq_mode));
+    seq_printf(s, "%4s %5s %5s %5s %12s %12s %12s %10s\n", "pin", "gpio", "irq",
+               "trig", "edges", "captured", "bounced", "rate/s");
+
+    for (i = 0; i < pins_count; ++i)
+    {
+        pin = &pins[i];
+        edges = READ_ONCE(pin->edges);
+        rate = (now_ns > pin->snap_ns) ?
+               div64_u64((edges - pin->snap_edges) * NSEC_PER_SEC, now_ns - pin->snap_ns) : 0;
+
+        pin->snap_edges = edges;
+        pin->snap_ns = now_ns;
+
+        irq_events_get_stats(i, &ev_stats);
+
+        seq_printf(s, "%4u %5d %5d %5lu %12llu %12llu %12llu %10llu\n",
+                   i, pin->gpio, pin->irq, pin->trigger, edges,
+                   ev_stats.captured, ev_stats.bounced, rate);
+
+        total_edges += edges;
+        total_rate += rate;
+    }
+
+    seq_printf(s, "total: %llu edges, %llu edges/s\n", total_edges, total_rate);
+
+    mutex_unlock(&irq_cfg_mtx);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(irq_pins);
+
+/* ************************************************* */
+
+static void irq_pins_release(unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        gpio_free(pins[i].gpio);
+    }
+
+    kfree(pins);
+    pins = NULL;
+}
+
+static int irq_pins_init(void)
+{
+    IRQ_pin_STC* pin;
+    unsigned int i;
+    int ret;
+
+    if ((0 == gpios_count) || (0 == edges_count))
+    {
+        return -EINVAL;
+    }
+
+    pins = kcalloc(gpios_count, sizeof(*pins), GFP_KERNEL);
+    if (NULL == pins)
+    {
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < gpios_count; ++i)
+    {
+        pin = &pins[i];
+
+        pin->index = i;
+        pin->gpio = gpios[i];
+        pin->trigger = edges[min(i, edges_count - 1)] & IRQ_EDGES_MASK;
+        pin->snap_ns = ktime_get_ns();
+        atomic64_set(&pin->bh_ns, 0);
+        tasklet_init(&pin->tasklet, irq_tl_callback, (unsigned long) pin);
+        INIT_WORK(&pin->work, irq_work_callback);
+
+        if ((0 == pin->trigger) || (0 != gpio_request(pin->gpio, "irqtest_pins")))
+        {
+            printk(KERN_ERR "Failed to request GPIO %d.\n", pin->gpio);
+            ret = -EIO;
+            goto err_release;
+        }
+
+        gpio_direction_input(pin->gpio);
+
+        pin->irq = gpio_to_irq(pin->gpio);
+        if (pin->irq < 0)
+        {
+            gpio_free(pin->gpio);
+            ret = pin->irq;
+            goto err_release;
+        }
+
+        printk(KERN_INFO "GPIO %d -> IRQ num: %d\n", pin->gpio, pin->irq);
+    }
+
+    pins_count = gpios_count;
+    return 0;
+
+err_release:
+    irq_pins_release(i);
+    return ret;
+}
+
+static int __init test_irq_init(void)
+{
+    int ret;
+
+    printk(KERN_INFO "IRQ test module loaded.\n");
+
+    /* Auxiliary stuff: init GPIO bound to USR LED3 */
+    gpio_fast_set_output(BIT(GPIO_LED_USR3_PIN));
+
+    /* Pins, bottom halves & IRQ setup */
+
+    ret = irq_pins_init();
+    if (0 != ret)
+    {
+        return ret;
+    }
+
+    irq_dbg_dir = debugfs_create_dir("irqtest", NULL);
+    irq_lat_init(irq_dbg_dir);
+
+    ret = irq_events_init(irq_dbg_dir, pins_count);
+    if (0 != ret)
+    {
+        goto err_pins_release;
+    }
+
+    irq_wq = alloc_workqueue("irqtest_wq", WQ_HIGHPRI, 0);
+    if (NULL == irq_wq)
+    {
+        printk(KERN_ERR "Failed to create the workqueue.\n");
+        ret = -ENOMEM;
+        goto err_events_exit;
+    }
+
+    ret = irq_la_init(irq_dbg_dir);
+    if (0 != ret)
+    {
+        goto err_destroy_wq;
+    }
+
+    if (loopback_gpio >= 0)
+    {
+        if (0 != gpio_request(loopback_gpio, "irqtest_loopback"))
+        {
+            printk(KERN_ERR "Failed to request the loopback GPIO.\n");
+            ret = -EIO;
+            goto err_la_exit;
+        }
+
+        gpio_direction_output(loopback_gpio, 0);
+    }
+
+    mutex_lock(&irq_cfg_mtx);
+    ret = irq_setup(irq_mode);
+    mutex_unlock(&irq_cfg_mtx);
+
+    if (0 != ret)
+    {
+        goto err_loopback_free;
+    }
+
+    debugfs_create_file("inject", S_IWUSR, irq_dbg_dir, NULL, &irq_inject_fops);
+    debugfs_create_file("pins", S_IRUGO, irq_dbg_dir, NULL, &irq_pins_fops);
+
+    return 0;
+
+err_loopback_free:
+    if (loopback_gpio >= 0)
+    {
+        gpio_free(loopback_gpio);
+    }
+err_la_exit:
+    irq_la_exit();
+err_destroy_wq:
+    destroy_workqueue(irq_wq);
+err_events_exit:
+    irq_events_exit();
+err_pins_release:
+    debugfs_remove_recursive(irq_dbg_dir);
+    irq_pins_release(pins_count);
+    return ret;
+}
+
+static void __exit test_irq_exit(void)
+{
+    /* No injections past this point */
+    debugfs_remove_recursive(irq_dbg_dir);
+
+    mutex_lock(&irq_cfg_mtx);
+    irq_teardown();
+    mutex_unlock(&irq_cfg_mtx);
+
+    if (loopback_gpio >= 0)
+    {
+        gpio_free(loopback_gpio);
+    }
+
+    irq_la_exit();
+    destroy_workqueue(irq_wq);
+    irq_events_exit();
+    irq_pins_release(pins_count);
+
+    printk(KERN_INFO "IRQ test module unloaded.\n");
+}
+
+module_init(test_irq_init);
+module_exit(test_irq_exit);
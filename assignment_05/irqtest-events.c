@@ -0,0 +1,278 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kfifo.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/cache.h>
+#include <linux/seq_file.h>
+
+#include "irqtest.h"
+
+#define IRQ_EVENTS_DEF_RING_LEN (256)
+
+static unsigned int ring_len = IRQ_EVENTS_DEF_RING_LEN;
+module_param(ring_len, uint, S_IRUGO);
+MODULE_PARM_DESC(ring_len, "Capacity of the events ring of each pin (rounded up to a power of 2)");
+
+static unsigned int debounce_us = 0;
+module_param(debounce_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(debounce_us, "Edges closer than this to the last accepted one are dropped (0 - off)");
+
+/* ************************************************* */
+
+/*
+ * kfifo is lock-free for one producer and one consumer: the IRQ
+ * handler of the pin is the only producer and readers are serialized
+ * by events_read_mtx. Queues are written from different CPUs, hence
+ * a cache line each.
+ */
+typedef struct IRQ_events_queue_STCT
+{
+    DECLARE_KFIFO_PTR(ring, IRQ_event_STC);
+
+    /* Producer state & stats, written from the IRQ handler only */
+    u64                  last_edge_ns;
+    bool                 has_last_edge;
+    u32                  seq;
+    IRQ_events_stats_STC stats;
+} ____cacheline_aligned_in_smp IRQ_events_queue_STC;
+
+static IRQ_events_queue_STC* queues;
+static unsigned int queues_count;
+static unsigned int read_cursor; /* Next queue to read, round-robin */
+
+static DECLARE_WAIT_QUEUE_HEAD(events_wq);
+static DEFINE_MUTEX(events_read_mtx);
+
+/* ************************************************* */
+
+bool irq_events_capture(unsigned int pin, u64 timestamp_ns, int level, u16 flags)
+{
+    IRQ_events_queue_STC* q = &queues[pin];
+    IRQ_event_STC event;
+    u64 debounce_ns = (u64) READ_ONCE(debounce_us) * NSEC_PER_USEC;
+
+    if ((true == q->has_last_edge) && ((timestamp_ns - q->last_edge_ns) < debounce_ns))
+    {
+        ++q->stats.bounced;
+        return false;
+    }
+
+    q->has_last_edge = true;
+    q->last_edge_ns = timestamp_ns;
+
+    event.timestamp_ns = timestamp_ns;
+    event.seq = q->seq++;
+    event.pin = pin;
+    event.level = !!level;
+    event.flags = flags;
+
+    /* Never block the handler: a full ring shows up as a seq gap */
+    if (0 == kfifo_put(&q->ring, event))
+    {
+        ++q->stats.dropped;
+    }
+    else
+    {
+        ++q->stats.captured;
+    }
+
+    wake_up_interruptible(&events_wq);
+    return true;
+}
+
+void irq_events_get_stats(unsigned int pin, IRQ_events_stats_STC* stats)
+{
+    *stats = queues[pin].stats;
+}
+
+static bool irq_events_available(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < queues_count; ++i)
+    {
+        if (false == kfifo_is_empty(&queues[i].ring))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* ************** Char device ********************** */
+
+/* Called with events_read_mtx held */
+static ssize_t irq_events_copy_out(char __user* buf, size_t count)
+{
+    IRQ_events_queue_STC* q;
+    unsigned int copied;
+    size_t total = 0;
+    unsigned int i;
+    int ret;
+
+    for (i = 0; (i < queues_count) && (total < count); ++i)
+    {
+        q = &queues[read_cursor];
+        read_cursor = (read_cursor + 1) % queues_count;
+
+        ret = kfifo_to_user(&q->ring, buf + total, count - total, &copied);
+        if (0 != ret)
+        {
+            return (0 != total) ? total : ret;
+        }
+
+        total += copied;
+    }
+
+    return total;
+}
+
+static ssize_t irq_events_read(struct file* file, char __user* buf,
+                               size_t count, loff_t* ppos)
+{
+    ssize_t ret;
+
+    if (count < sizeof(IRQ_event_STC))
+    {
+        return -EINVAL;
+    }
+
+    if (0 != mutex_lock_interruptible(&events_read_mtx))
+    {
+        return -ERESTARTSYS;
+    }
+
+    while (false == irq_events_available())
+    {
+        mutex_unlock(&events_read_mtx);
+
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+
+        if (0 != wait_event_interruptible(events_wq, irq_events_available()))
+        {
+            return -ERESTARTSYS;
+        }
+
+        if (0 != mutex_lock_interruptible(&events_read_mtx))
+        {
+            return -ERESTARTSYS;
+        }
+    }
+
+    /* Whole records only; they are ordered per pin, not globally */
+    ret = irq_events_copy_out(buf, rounddown(count, sizeof(IRQ_event_STC)));
+    mutex_unlock(&events_read_mtx);
+
+    return ret;
+}
+
+static __poll_t irq_events_poll(struct file* file, poll_table* wait)
+{
+    poll_wait(file, &events_wq, wait);
+
+    if (false == irq_events_available())
+    {
+        return 0;
+    }
+
+    return EPOLLIN | EPOLLRDNORM;
+}
+
+static const struct file_operations irq_events_fops = {
+        .owner  = THIS_MODULE,
+        .read   = irq_events_read,
+        .poll   = irq_events_poll,
+        .llseek = noop_llseek
+};
+
+static struct miscdevice irq_events_dev = {
+        .minor = MISC_DYNAMIC_MINOR,
+        .name  = "irqtest",
+        .fops  = &irq_events_fops
+};
+
+/* ***************** debugfs *********************** */
+
+static int irq_events_stats_show(struct seq_file* s, void* unused)
+{
+    IRQ_events_queue_STC* q;
+    unsigned int i;
+
+    seq_printf(s, "debounce: %u us\n", debounce_us);
+    seq_printf(s, "%4s %12s %12s %12s %12s\n", "pin", "captured", "dropped", "bounced", "queued");
+
+    for (i = 0; i < queues_count; ++i)
+    {
+        q = &queues[i];
+        seq_printf(s, "%4u %12llu %12llu %12llu %7u/%-4u\n", i,
+                   q->stats.captured, q->stats.dropped, q->stats.bounced,
+                   kfifo_len(&q->ring), kfifo_size(&q->ring));
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(irq_events_stats);
+
+/* ************************************************* */
+
+static void irq_events_free_queues(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < queues_count; ++i)
+    {
+        kfifo_free(&queues[i].ring);
+    }
+
+    kfree(queues);
+    queues = NULL;
+    queues_count = 0;
+}
+
+int irq_events_init(struct dentry* dbg_dir, unsigned int pins_count)
+{
+    int ret;
+
+    queues = kcalloc(pins_count, sizeof(*queues), GFP_KERNEL);
+    if (NULL == queues)
+    {
+        return -ENOMEM;
+    }
+
+    for (queues_count = 0; queues_count < pins_count; ++queues_count)
+    {
+        ret = kfifo_alloc(&queues[queues_count].ring, ring_len, GFP_KERNEL);
+        if (0 != ret)
+        {
+            printk(KERN_ERR "Failed to allocate the events ring.\n");
+            irq_events_free_queues();
+            return ret;
+        }
+    }
+
+    ret = misc_register(&irq_events_dev);
+    if (0 != ret)
+    {
+        printk(KERN_ERR "Failed to register the events device.\n");
+        irq_events_free_queues();
+        return ret;
+    }
+
+    debugfs_create_file("events", S_IRUGO, dbg_dir, NULL, &irq_events_stats_fops);
+    return 0;
+}
+
+void irq_events_exit(void)
+{
+    misc_deregister(&irq_events_dev);
+    irq_events_free_queues();
+}
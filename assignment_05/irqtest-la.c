@@ -0,0 +1,276 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/version.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "irqtest.h"
+#include "gpio_fast.h"
+
+#define IRQ_LA_DEF_RATE_HZ (50000)
+#define IRQ_LA_MAX_RATE_HZ (500000)
+#define IRQ_LA_DEF_RING_KB (1024)
+
+static unsigned int la_rate_hz = IRQ_LA_DEF_RATE_HZ;
+module_param(la_rate_hz, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(la_rate_hz, "Logic analyzer sampling rate, applied on the next start");
+
+static unsigned int la_mask = 0xffffffff;
+module_param(la_mask, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(la_mask, "GPIO1 pins sampled by the logic analyzer, applied on the next start");
+
+static unsigned int la_ring_kb = IRQ_LA_DEF_RING_KB;
+module_param(la_ring_kb, uint, S_IRUGO);
+MODULE_PARM_DESC(la_ring_kb, "Size of the capture ring in KiB (rounded up to a power of 2)");
+
+/* ************************************************* */
+
+/*
+ * The sampler owns the ring: records are overwritten in a circle and
+ * the head is published with a release store after the record is
+ * complete. The buffer is shared with userspace as is, see irqtest.h
+ * for the layout.
+ */
+typedef struct IRQ_la_STCT
+{
+    struct hrtimer      timer;
+    ktime_t             period;
+    void*               buf;      /* header page + records */
+    size_t              buf_size;
+    IRQ_la_header_STC*  hdr;
+    IRQ_la_record_STC*  records;
+    u32                 records_mask;
+
+    /* Sampler state */
+    bool                is_running;
+    u32                 mask;
+    u32                 last_levels;
+    u32                 run;
+    u32                 head;
+    u64                 samples;
+
+    struct mutex        ctl_mtx;
+} IRQ_la_STC;
+
+static IRQ_la_STC la;
+
+/* ************************************************* */
+
+static void irq_la_put(u64 timestamp_ns, u32 levels, u32 run)
+{
+    IRQ_la_record_STC* rec = &la.records[la.head & la.records_mask];
+
+    rec->timestamp_ns = timestamp_ns;
+    rec->levels = levels;
+    rec->run = run;
+
+    smp_store_release(&la.hdr->head, ++la.head);
+}
+
+static enum hrtimer_restart irq_la_timer_fn(struct hrtimer* timer)
+{
+    u64 periods = hrtimer_forward_now(timer, la.period);
+    u32 levels = gpio_fast_read_in() & la.mask;
+
+    /* A late expiry skips samples: they still count in the run */
+    la.run += periods;
+    la.samples += periods;
+
+    if (periods > 1)
+    {
+        WRITE_ONCE(la.hdr->missed, la.hdr->missed + periods - 1);
+    }
+
+    if (levels != la.last_levels)
+    {
+        irq_la_put(ktime_get_ns(), levels, la.run);
+        la.last_levels = levels;
+        la.run = 0;
+    }
+
+    return READ_ONCE(la.is_running) ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+/* Called with ctl_mtx held */
+static void irq_la_start(void)
+{
+    unsigned int rate_hz = clamp(la_rate_hz, 1U, (unsigned int) IRQ_LA_MAX_RATE_HZ);
+
+    la.period = ns_to_ktime(div_u64(NSEC_PER_SEC, rate_hz));
+    la.mask = la_mask;
+    la.head = 0;
+    la.run = 0;
+    la.samples = 0;
+
+    la.hdr->sample_ns = ktime_to_ns(la.period);
+    la.hdr->mask = la.mask;
+    la.hdr->missed = 0;
+    smp_store_release(&la.hdr->head, 0);
+
+    /* The first record is the initial state of the pins */
+    la.last_levels = gpio_fast_read_in() & la.mask;
+    la.hdr->start_ns = ktime_get_ns();
+    irq_la_put(la.hdr->start_ns, la.last_levels, 0);
+
+    WRITE_ONCE(la.is_running, true);
+    hrtimer_start(&la.timer, la.period, HRTIMER_MODE_REL);
+}
+
+/* Called with ctl_mtx held */
+static void irq_la_stop(void)
+{
+    WRITE_ONCE(la.is_running, false);
+    hrtimer_cancel(&la.timer);
+}
+
+/* ****************** mmap device ****************** */
+
+static int irq_la_mmap(struct file* file, struct vm_area_struct* vma)
+{
+    /* The ring is written by the sampler only */
+    if (0 != (vma->vm_flags & VM_WRITE))
+    {
+        return -EPERM;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    return remap_vmalloc_range(vma, la.buf, vma->vm_pgoff);
+}
+
+static const struct file_operations irq_la_dev_fops = {
+        .owner  = THIS_MODULE,
+        .mmap   = irq_la_mmap,
+        .llseek = noop_llseek
+};
+
+static struct miscdevice irq_la_dev = {
+        .minor = MISC_DYNAMIC_MINOR,
+        .name  = "irqtest_la",
+        .fops  = &irq_la_dev_fops,
+        .mode  = 0444
+};
+
+/* ***************** debugfs *********************** */
+
+static int irq_la_show(struct seq_file* s, void* unused)
+{
+    u32 head;
+
+    mutex_lock(&la.ctl_mtx);
+
+    head = smp_load_acquire(&la.hdr->head);
+
+    seq_printf(s, "state: %s\n", la.is_running ? "running" : "stopped");
+    seq_printf(s, "sample period: %llu ns, mask 0x%08x\n", la.hdr->sample_ns, la.hdr->mask);
+    seq_printf(s, "samples %llu, missed %llu\n", la.samples, READ_ONCE(la.hdr->missed));
+    seq_printf(s, "records %u, ring %u records\n", head, la.hdr->records_count);
+
+    mutex_unlock(&la.ctl_mtx);
+    return 0;
+}
+
+static int irq_la_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, irq_la_show, inode->i_private);
+}
+
+/* "start" restarts the capture from an empty ring, "stop" freezes it */
+static ssize_t irq_la_write(struct file* file, const char __user* buf,
+                            size_t count, loff_t* ppos)
+{
+    char cmd[16] = { 0 };
+
+    if (0 != copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+    {
+        return -EFAULT;
+    }
+
+    mutex_lock(&la.ctl_mtx);
+
+    if (sysfs_streq(cmd, "start"))
+    {
+        irq_la_stop();
+        irq_la_start();
+    }
+    else if (sysfs_streq(cmd, "stop"))
+    {
+        irq_la_stop();
+    }
+    else
+    {
+        count = -EINVAL;
+    }
+
+    mutex_unlock(&la.ctl_mtx);
+    return count;
+}
+
+static const struct file_operations irq_la_fops = {
+        .owner   = THIS_MODULE,
+        .open    = irq_la_open,
+        .read    = seq_read,
+        .write   = irq_la_write,
+        .llseek  = seq_lseek,
+        .release = single_release
+};
+
+/* ************************************************* */
+
+int irq_la_init(struct dentry* dbg_dir)
+{
+    size_t ring_size = roundup_pow_of_two(max(la_ring_kb, 1U) * 1024UL);
+    int ret;
+
+    BUILD_BUG_ON(sizeof(IRQ_la_header_STC) > IRQ_LA_RECORDS_OFFSET);
+
+    la.buf_size = IRQ_LA_RECORDS_OFFSET + ring_size;
+    la.buf = vmalloc_user(la.buf_size);
+    if (NULL == la.buf)
+    {
+        printk(KERN_ERR "Failed to allocate the capture ring.\n");
+        return -ENOMEM;
+    }
+
+    la.hdr = la.buf;
+    la.records = la.buf + IRQ_LA_RECORDS_OFFSET;
+    la.hdr->records_count = ring_size / sizeof(IRQ_la_record_STC);
+    la.records_mask = la.hdr->records_count - 1;
+
+    mutex_init(&la.ctl_mtx);
+    hrtimer_init(&la.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    la.timer.function = irq_la_timer_fn;
+
+    ret = misc_register(&irq_la_dev);
+    if (0 != ret)
+    {
+        printk(KERN_ERR "Failed to register the capture device.\n");
+        vfree(la.buf);
+        return ret;
+    }
+
+    debugfs_create_file("la", S_IRUGO | S_IWUSR, dbg_dir, NULL, &irq_la_fops);
+    return 0;
+}
+
+void irq_la_exit(void)
+{
+    /* debugfs is gone already, nobody can restart the sampler */
+    irq_la_stop();
+
+    /* An open mapping holds a module reference, so the ring is unused */
+    misc_deregister(&irq_la_dev);
+    vfree(la.buf);
+}
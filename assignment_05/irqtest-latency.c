@@ -0,0 +1,183 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/percpu.h>
+
+#include "irqtest.h"
+
+/* Bucket N counts the intervals in [2^(N-1), 2^N) ns, the last one - the rest */
+#define IRQ_LAT_BUCKETS (32)
+
+typedef struct IRQ_lat_hist_STCT
+{
+    u64 buckets[IRQ_LAT_BUCKETS];
+    u64 samples;
+    u64 sum_ns;
+    u64 min_ns;
+    u64 max_ns;
+} IRQ_lat_hist_STC;
+
+/* Pins are served on several CPUs at once, so the histograms are per-CPU */
+typedef struct IRQ_lat_hists_STCT
+{
+    IRQ_lat_hist_STC hist[IRQ_MODE_COUNT][IRQ_LAT_STAGE_COUNT];
+} IRQ_lat_hists_STC;
+
+static DEFINE_PER_CPU(IRQ_lat_hists_STC, lat_hists);
+
+static const char* const irq_mode_names[IRQ_MODE_COUNT] = {
+        [IRQ_MODE_TASKLET]   = "tasklet",
+        [IRQ_MODE_THREADED]  = "threaded",
+        [IRQ_MODE_WORKQUEUE] = "workqueue"
+};
+
+static const char* const irq_stage_names[IRQ_LAT_STAGE_COUNT] = {
+        [IRQ_LAT_TO_HANDLER] = "irq-to-handler",
+        [IRQ_LAT_TO_BH]      = "irq-to-bottom-half"
+};
+
+/* ************************************************* */
+
+const char* irq_mode_name(IRQ_mode_EN mode)
+{
+    return (mode < IRQ_MODE_COUNT) ? irq_mode_names[mode] : "unknown";
+}
+
+void irq_lat_account(IRQ_mode_EN mode, IRQ_lat_stage_EN stage, u64 delta_ns)
+{
+    IRQ_lat_hist_STC* hist = &get_cpu_ptr(&lat_hists)->hist[mode][stage];
+
+    ++hist->buckets[min(fls64(delta_ns), IRQ_LAT_BUCKETS - 1)];
+
+    if ((0 == hist->samples) || (delta_ns < hist->min_ns))
+    {
+        hist->min_ns = delta_ns;
+    }
+
+    if (delta_ns > hist->max_ns)
+    {
+        hist->max_ns = delta_ns;
+    }
+
+    hist->sum_ns += delta_ns;
+    ++hist->samples;
+
+    put_cpu_ptr(&lat_hists);
+}
+
+/* ***************** debugfs *********************** */
+
+static void irq_lat_hist_show(struct seq_file* s, const IRQ_lat_hist_STC* hist)
+{
+    int i;
+
+    seq_printf(s, "  samples %llu, min %llu ns, avg %llu ns, max %llu ns\n",
+               hist->samples, hist->min_ns,
+               hist->samples ? div64_u64(hist->sum_ns, hist->samples) : 0,
+               hist->max_ns);
+
+    for (i = 0; i < IRQ_LAT_BUCKETS; ++i)
+    {
+        if (0 == hist->buckets[i])
+        {
+            continue;
+        }
+
+        if (i < (IRQ_LAT_BUCKETS - 1))
+        {
+            seq_printf(s, "  < %10llu ns: %llu\n", BIT_ULL(i), hist->buckets[i]);
+        }
+        else
+        {
+            seq_printf(s, "  >=%10llu ns: %llu\n", BIT_ULL(i - 1), hist->buckets[i]);
+        }
+    }
+}
+
+static void irq_lat_hist_merge(IRQ_lat_hist_STC* sum, IRQ_mode_EN mode, IRQ_lat_stage_EN stage)
+{
+    const IRQ_lat_hist_STC* hist;
+    int cpu;
+    int i;
+
+    memset(sum, 0, sizeof(*sum));
+
+    for_each_possible_cpu(cpu)
+    {
+        hist = &per_cpu_ptr(&lat_hists, cpu)->hist[mode][stage];
+
+        if (0 == hist->samples)
+        {
+            continue;
+        }
+
+        for (i = 0; i < IRQ_LAT_BUCKETS; ++i)
+        {
+            sum->buckets[i] += hist->buckets[i];
+        }
+
+        if ((0 == sum->samples) || (hist->min_ns < sum->min_ns))
+        {
+            sum->min_ns = hist->min_ns;
+        }
+
+        sum->max_ns = max(sum->max_ns, hist->max_ns);
+        sum->sum_ns += hist->sum_ns;
+        sum->samples += hist->samples;
+    }
+}
+
+static int irq_lat_show(struct seq_file* s, void* unused)
+{
+    IRQ_lat_hist_STC sum;
+    int mode;
+    int stage;
+
+    for (mode = 0; mode < IRQ_MODE_COUNT; ++mode)
+    {
+        for (stage = 0; stage < IRQ_LAT_STAGE_COUNT; ++stage)
+        {
+            irq_lat_hist_merge(&sum, mode, stage);
+            seq_printf(s, "%s, %s:\n", irq_mode_names[mode], irq_stage_names[stage]);
+            irq_lat_hist_show(s, &sum);
+        }
+    }
+
+    return 0;
+}
+
+static int irq_lat_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, irq_lat_show, inode->i_private);
+}
+
+/* Any write clears the histograms */
+static ssize_t irq_lat_write(struct file* file, const char __user* buf,
+                             size_t count, loff_t* ppos)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        memset(per_cpu_ptr(&lat_hists, cpu), 0, sizeof(IRQ_lat_hists_STC));
+    }
+
+    return count;
+}
+
+static const struct file_operations irq_lat_fops = {
+        .owner   = THIS_MODULE,
+        .open    = irq_lat_open,
+        .read    = seq_read,
+        .write   = irq_lat_write,
+        .llseek  = seq_lseek,
+        .release = single_release
+};
+
+void irq_lat_init(struct dentry* dbg_dir)
+{
+    debugfs_create_file("latency", S_IRUGO | S_IWUSR, dbg_dir, NULL, &irq_lat_fops);
+}
@@ -0,0 +1,95 @@
+#ifndef __IRQTEST_H
+#define __IRQTEST_H
+
+#include <linux/types.h>
+#include <linux/debugfs.h>
+
+/* IRQ_event_STC flags */
+#define IRQ_EVENT_INJECTED (1) /* Produced by the software injector */
+
+/* Max number of monitored pins */
+#define IRQTEST_MAX_PINS (128)
+
+/* One captured edge as it is delivered to userspace via /dev/irqtest */
+typedef struct IRQ_event_STCT
+{
+    u64 timestamp_ns; /* ktime_get_ns() taken in the hardirq handler */
+    u32 seq;          /* Accepted edges of the pin, a gap means lost events */
+    u8  pin;          /* Index of the pin in the "gpios" parameter */
+    u8  level;        /* Pin level sampled in the handler */
+    u16 flags;
+} IRQ_event_STC;
+
+/* Per-pin queue counters */
+typedef struct IRQ_events_stats_STCT
+{
+    u64 captured;
+    u64 dropped;
+    u64 bounced;
+} IRQ_events_stats_STC;
+
+/*
+ * Event queues (one per pin) & char device. irq_events_capture()
+ * must be called from the IRQ handler of the pin only: each ring
+ * has a single producer. Returns false if the edge was filtered out
+ * by the debounce logic.
+ */
+int  irq_events_init(struct dentry* dbg_dir, unsigned int pins_count);
+void irq_events_exit(void);
+bool irq_events_capture(unsigned int pin, u64 timestamp_ns, int level, u16 flags);
+void irq_events_get_stats(unsigned int pin, IRQ_events_stats_STC* stats);
+
+/* Bottom half flavours, selected with the "irq_mode" parameter */
+typedef enum IRQ_mode_ENT
+{
+    IRQ_MODE_TASKLET = 0,
+    IRQ_MODE_THREADED,
+    IRQ_MODE_WORKQUEUE,
+    IRQ_MODE_COUNT
+} IRQ_mode_EN;
+
+/* Measured intervals */
+typedef enum IRQ_lat_stage_ENT
+{
+    IRQ_LAT_TO_HANDLER = 0, /* Trigger -> hardirq handler entry */
+    IRQ_LAT_TO_BH,          /* Trigger -> bottom half entry */
+    IRQ_LAT_STAGE_COUNT
+} IRQ_lat_stage_EN;
+
+/* Latency histograms (log2 buckets), kept per CPU */
+void irq_lat_init(struct dentry* dbg_dir);
+void irq_lat_account(IRQ_mode_EN mode, IRQ_lat_stage_EN stage, u64 delta_ns);
+const char* irq_mode_name(IRQ_mode_EN mode);
+
+/*
+ * Logic analyzer: GPIO1 data-in sampled from an hrtimer, changes only
+ * are stored (run-length encoded) to a ring that /dev/irqtest_la maps
+ * read-only: the header page, then the records from
+ * IRQ_LA_RECORDS_OFFSET. The ring is overwritten in a circle; readers
+ * load 'head' with acquire semantics and consider a record valid if
+ * 'head' has not advanced past it by a whole ring after it was copied.
+ */
+#define IRQ_LA_RECORDS_OFFSET (4096)
+
+typedef struct IRQ_la_header_STCT
+{
+    u32 head;          /* Records written since the start, wraps */
+    u32 records_count; /* Ring capacity, a power of 2 */
+    u32 mask;          /* Sampled pins */
+    u32 reserved;
+    u64 sample_ns;     /* Sampling period */
+    u64 start_ns;      /* ktime_get_ns() of the first record */
+    u64 missed;        /* Samples skipped by late timer expiries */
+} IRQ_la_header_STC;
+
+typedef struct IRQ_la_record_STCT
+{
+    u64 timestamp_ns;  /* ktime_get_ns() of the sample with the change */
+    u32 levels;        /* Masked GPIO1 data-in */
+    u32 run;           /* Samples the previous levels lasted */
+} IRQ_la_record_STC;
+
+int  irq_la_init(struct dentry* dbg_dir);
+void irq_la_exit(void);
+
+#endif
@@ -1,99 +1,911 @@
 #include <linux/module.h>
 #include <linux/kthread.h>
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/cpumask.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/string.h>
 
 MODULE_AUTHOR("Victor Krasnoshchok");
 MODULE_DESCRIPTION("Kthreads sync. sample");
 MODULE_LICENSE("GPL");
 
 #define WORKERS_COUNT (4)
-#define SHARED_VAR_UPDATE_INT_S (10 * HZ)
+#define WORKERS_MAX (32)
+#define SHARED_VAR_UPDATE_INT_S (10)
 
+/* Pool management defaults */
+#define POOL_MANAGE_PERIOD_MS (100)
+#define POOL_GROW_THRESHOLD (8)
+#define POOL_IDLE_TIMEOUT_MS (5000)
+#define POOL_MAX_SUBMIT (100000)
+
+/* Readers benchmark limits */
+#define BENCH_MAX_DURATION_MS (10000)
+#define BENCH_MAX_STEPS (6) /* 1, 2, 4 ... 32 readers */
+#define BENCH_WRITE_PERIOD_US (100)
+
+/*
+ * Workers serve a shared queue of jobs (one job - one update of
+ * the shared state). The pool is managed:
+ *  - it never goes below the number of online CPUs (up to max_workers);
+ *  - it grows by one worker per management pass while the queue is
+ *    deeper than grow_threshold;
+ *  - workers idle for longer than idle_timeout_ms are stopped while
+ *    the pool is above its minimum;
+ *  - each worker has a home CPU; when the CPU goes offline its workers
+ *    are migrated to another online CPU.
+ * Jobs come from a periodic producer (WORKERS_COUNT jobs every
+ * update_interval_s) and from debugfs "submit".
+ *
+ * A job updates the shared state, a multi-word snapshot, in one of
+ * the "sync_mode" flavours: under a mutex, a seqlock or RCU (copy,
+ * rcu_assign_pointer() and kfree_rcu() of the old copy).
+ */
 struct worker_struct_s {
 	struct task_struct *worker_thread;
 	unsigned int       thread_id;
-	struct completion  comp_obj;
+	int                cpu;
+
+	/* Written by the worker, read by the manager & debugfs */
+	bool               is_busy;
+	unsigned long      last_active;  /* jiffies */
+	u64                started_ns;
+	u64                busy_ns;
+	u64                jobs_done;
 };
 
-static struct worker_struct_s workers[WORKERS_COUNT];
+static struct worker_struct_s workers[WORKERS_MAX];
 
 /*
- * "Volatile" specifier is used here just to show
- * synchronization using not an atomic operations
- * but more "traditional" mutex obj.
- *
- * checkpatch.pl will complain here.
+ * A slot is in use while its worker_thread is set. Pool changes
+ * (manager, hotplug callbacks, init/exit) are serialized by pool_mtx.
+ */
+static unsigned int workers_running;
+static bool is_pool_ready;
+static DEFINE_MUTEX(pool_mtx);
+
+static atomic_t queue_depth = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(jobs_wq);
+
+static struct delayed_work pool_manage_work;
+static struct delayed_work producer_work;
+static enum cpuhp_state pool_cpuhp_state;
+static struct dentry *pool_dbg_dir;
+
+/* Pool stats */
+static atomic64_t jobs_submitted = ATOMIC64_INIT(0);
+static u64 pool_grows;
+static u64 pool_shrinks;
+static u64 pool_migrations;
+static u64 retired_jobs_done;
+
+static unsigned int max_workers = WORKERS_MAX;
+static unsigned int grow_threshold = POOL_GROW_THRESHOLD;
+static unsigned int idle_timeout_ms = POOL_IDLE_TIMEOUT_MS;
+static unsigned int update_interval_s = SHARED_VAR_UPDATE_INT_S;
+
+enum sync_mode_e {
+	SYNC_MODE_MUTEX = 0,
+	SYNC_MODE_SEQLOCK,
+	SYNC_MODE_RCU,
+	SYNC_MODE_COUNT
+};
+
+static const char * const sync_mode_names[SYNC_MODE_COUNT] = {
+	[SYNC_MODE_MUTEX]   = "mutex",
+	[SYNC_MODE_SEQLOCK] = "seqlock",
+	[SYNC_MODE_RCU]     = "rcu",
+};
+
+static unsigned int sync_mode = SYNC_MODE_MUTEX;
+
+/*
+ * The shared state. 'check' is derived from the other fields, so a
+ * reader can tell a torn snapshot.
  */
-static volatile unsigned int shared_var;
+struct shared_state_s {
+	u64             version;
+	u64             value;
+	u64             updated_ns;
+	u64             check;
+	struct rcu_head rcu;
+};
 
+/* One copy per flavour: the mode may be switched at any time */
+static struct shared_state_s mtx_state;
 static DEFINE_MUTEX(sh_var_access_mtx);
 
-static int worker_proc(void *arg)
+static struct shared_state_s seq_state;
+static DEFINE_SEQLOCK(state_seqlock);
+
+static struct shared_state_s __rcu *rcu_state;
+static DEFINE_MUTEX(rcu_update_mtx);
+
+static void pool_kick_manager(void);
+
+/* ------------------------- Jobs ----------------------------- */
+
+static void jobs_submit(unsigned int count)
 {
-	struct worker_struct_s *self = (struct worker_struct_s *) arg;
-	unsigned long local_copy = 0;
+	atomic64_add(count, &jobs_submitted);
 
-	set_current_state(TASK_INTERRUPTIBLE);
+	if (atomic_add_return(count, &queue_depth) > READ_ONCE(grow_threshold))
+		pool_kick_manager();
 
-	while (!kthread_should_stop()) {
+	if (count > 1)
+		wake_up_interruptible_all(&jobs_wq);
+	else
+		wake_up_interruptible(&jobs_wq);
+}
+
+/* -------------------- Shared state ------------------------- */
+
+static void state_advance(struct shared_state_s *st, unsigned int writer_id)
+{
+	++st->version;
+	st->value += writer_id + 1;
+	st->updated_ns = ktime_get_ns();
+	st->check = st->version ^ st->value ^ st->updated_ns;
+}
+
+static int state_update(unsigned int mode, unsigned int writer_id, u64 *version)
+{
+	struct shared_state_s *new_st, *old_st;
+
+	switch (mode) {
+	case SYNC_MODE_SEQLOCK:
+		write_seqlock(&state_seqlock);
+		state_advance(&seq_state, writer_id);
+		*version = seq_state.version;
+		write_sequnlock(&state_seqlock);
+		break;
+
+	case SYNC_MODE_RCU:
+		new_st = kmalloc(sizeof(*new_st), GFP_KERNEL);
+		if (!new_st)
+			return -ENOMEM;
+
+		mutex_lock(&rcu_update_mtx);
+		old_st = rcu_dereference_protected(rcu_state,
+				lockdep_is_held(&rcu_update_mtx));
+		*new_st = *old_st;
+		state_advance(new_st, writer_id);
+		*version = new_st->version;
+		rcu_assign_pointer(rcu_state, new_st);
+		mutex_unlock(&rcu_update_mtx);
+
+		kfree_rcu(old_st, rcu);
+		break;
+
+	default:
+		mutex_lock(&sh_var_access_mtx);
+		state_advance(&mtx_state, writer_id);
+		*version = mtx_state.version;
+		mutex_unlock(&sh_var_access_mtx);
+		break;
+	}
+
+	return 0;
+}
+
+/* Returns false if the snapshot is torn */
+static bool state_read(unsigned int mode, struct shared_state_s *snap)
+{
+	const struct shared_state_s *st;
+	unsigned int seq;
+
+	switch (mode) {
+	case SYNC_MODE_SEQLOCK:
+		do {
+			seq = read_seqbegin(&state_seqlock);
+			*snap = seq_state;
+		} while (read_seqretry(&state_seqlock, seq));
+		break;
+
+	case SYNC_MODE_RCU:
+		rcu_read_lock();
+		st = rcu_dereference(rcu_state);
+		*snap = *st;
+		rcu_read_unlock();
+		break;
+
+	default:
 		mutex_lock(&sh_var_access_mtx);
-		local_copy = ++shared_var;
+		*snap = mtx_state;
 		mutex_unlock(&sh_var_access_mtx);
+		break;
+	}
+
+	return snap->check == (snap->version ^ snap->value ^ snap->updated_ns);
+}
+
+static void job_run(struct worker_struct_s *self)
+{
+	u64 local_copy = 0;
+
+	if (!state_update(READ_ONCE(sync_mode), self->thread_id, &local_copy))
+		pr_info_ratelimited("Thread %d : %llu\n", self->thread_id,
+				    local_copy);
+}
+
+static int worker_proc(void *arg)
+{
+	struct worker_struct_s *self = (struct worker_struct_s *) arg;
+	u64 start_ns;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(jobs_wq,
+					 atomic_read(&queue_depth) > 0 ||
+					 kthread_should_stop());
 
-		pr_info("Thread %d : %lu\n", self->thread_id, local_copy);
+		if (atomic_dec_if_positive(&queue_depth) < 0)
+			continue;
 
-		schedule_timeout_interruptible(SHARED_VAR_UPDATE_INT_S);
+		WRITE_ONCE(self->is_busy, true);
+		start_ns = ktime_get_ns();
+
+		job_run(self);
+
+		WRITE_ONCE(self->busy_ns, self->busy_ns + ktime_get_ns() - start_ns);
+		WRITE_ONCE(self->jobs_done, self->jobs_done + 1);
+		WRITE_ONCE(self->last_active, jiffies);
+		WRITE_ONCE(self->is_busy, false);
 	}
 
-	complete(&self->comp_obj);
 	pr_info("Thread %d: completed.\n", self->thread_id);
 	return 0;
 }
 
-static void threads_pool_cleanup(void)
+static void producer_proc(struct work_struct *work)
+{
+	jobs_submit(WORKERS_COUNT);
+	schedule_delayed_work(&producer_work,
+			      READ_ONCE(update_interval_s) * HZ);
+}
+
+/* ------------------------- Pool ----------------------------- */
+
+/* Online CPU with the fewest workers, called with pool_mtx held */
+static int pool_pick_cpu(void)
+{
+	unsigned int load, best_load = UINT_MAX;
+	int cpu, best_cpu = cpumask_first(cpu_online_mask);
+	unsigned int i;
+
+	for_each_online_cpu(cpu) {
+		load = 0;
+		for (i = 0; i < WORKERS_MAX; ++i)
+			if (workers[i].worker_thread && workers[i].cpu == cpu)
+				++load;
+
+		if (load < best_load) {
+			best_load = load;
+			best_cpu = cpu;
+		}
+	}
+
+	return best_cpu;
+}
+
+/* Called with pool_mtx held */
+static int pool_worker_start(void)
+{
+	struct worker_struct_s *w = NULL;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < WORKERS_MAX; ++i) {
+		if (!workers[i].worker_thread) {
+			w = &workers[i];
+			break;
+		}
+	}
+
+	if (!w)
+		return -ENOSPC;
+
+	w->thread_id = i;
+	w->cpu = pool_pick_cpu();
+	w->is_busy = false;
+	w->last_active = jiffies;
+	w->started_ns = ktime_get_ns();
+	w->busy_ns = 0;
+	w->jobs_done = 0;
+
+	w->worker_thread = kthread_create(worker_proc, (void *) w,
+					  "worker-%d", i);
+	if (IS_ERR(w->worker_thread)) {
+		pr_err("Failed to instantiate thread %d.\n", i);
+		ret = PTR_ERR(w->worker_thread);
+		w->worker_thread = NULL;
+		return ret;
+	}
+
+	/* Not kthread_bind(): the worker must stay movable on hotplug */
+	set_cpus_allowed_ptr(w->worker_thread, cpumask_of(w->cpu));
+	wake_up_process(w->worker_thread);
+
+	pr_info("Thread %d created on CPU %d.\n", i, w->cpu);
+	++workers_running;
+	return 0;
+}
+
+/* Called with pool_mtx held */
+static void pool_worker_stop(struct worker_struct_s *w)
+{
+	/*
+	 * Waits for the thread to exit, also when it is stopped before
+	 * worker_proc() ever ran.
+	 */
+	kthread_stop(w->worker_thread);
+
+	retired_jobs_done += w->jobs_done;
+	w->worker_thread = NULL;
+	--workers_running;
+}
+
+static unsigned int pool_min_size(void)
 {
+	return min(num_online_cpus(), READ_ONCE(max_workers));
+}
+
+/* Called with pool_mtx held */
+static void pool_manage(void)
+{
+	unsigned long timeout = msecs_to_jiffies(READ_ONCE(idle_timeout_ms));
+	unsigned int min_size = pool_min_size();
+	unsigned int max_size = READ_ONCE(max_workers);
+	struct worker_struct_s *w;
 	int i;
 
-	for (i = 0; i < WORKERS_COUNT; ++i) {
-		if (!IS_ERR(workers[i].worker_thread)) {
-			kthread_stop(workers[i].worker_thread);
-			wait_for_completion_interruptible(&workers[i].comp_obj);
+	while (workers_running < min_size)
+		if (pool_worker_start())
+			return;
+
+	for (i = WORKERS_MAX - 1; i >= 0 && workers_running > max_size; --i) {
+		if (workers[i].worker_thread) {
+			pool_worker_stop(&workers[i]);
+			++pool_shrinks;
 		}
 	}
 
+	if (atomic_read(&queue_depth) > READ_ONCE(grow_threshold) &&
+	    workers_running < max_size) {
+		if (!pool_worker_start())
+			++pool_grows;
+		return;
+	}
+
+	if (workers_running <= min_size)
+		return;
+
+	/* One idle worker per pass: shrink gradually */
+	for (i = 0; i < WORKERS_MAX; ++i) {
+		w = &workers[i];
+
+		if (w->worker_thread && !READ_ONCE(w->is_busy) &&
+		    time_after(jiffies, READ_ONCE(w->last_active) + timeout)) {
+			pool_worker_stop(w);
+			++pool_shrinks;
+			break;
+		}
+	}
+}
+
+static void pool_manage_proc(struct work_struct *work)
+{
+	mutex_lock(&pool_mtx);
+
+	if (is_pool_ready) {
+		pool_manage();
+		schedule_delayed_work(&pool_manage_work,
+				      msecs_to_jiffies(POOL_MANAGE_PERIOD_MS));
+	}
+
+	mutex_unlock(&pool_mtx);
+}
+
+static void pool_kick_manager(void)
+{
+	mod_delayed_work(system_wq, &pool_manage_work, 0);
+}
+
+/* --------------------- CPU hotplug -------------------------- */
+
+static int pool_cpu_online(unsigned int cpu)
+{
+	/* The manager grows the pool and the new worker lands on this CPU */
+	pool_kick_manager();
+	return 0;
+}
+
+static int pool_cpu_offline(unsigned int cpu)
+{
+	int target = cpumask_any_but(cpu_online_mask, cpu);
+	unsigned int i;
+
+	mutex_lock(&pool_mtx);
+
+	for (i = 0; i < WORKERS_MAX; ++i) {
+		if (!workers[i].worker_thread || workers[i].cpu != cpu ||
+		    target >= nr_cpu_ids)
+			continue;
+
+		workers[i].cpu = target;
+		set_cpus_allowed_ptr(workers[i].worker_thread,
+				     cpumask_of(target));
+		++pool_migrations;
+	}
+
+	mutex_unlock(&pool_mtx);
+
+	/* Extra workers are trimmed by the manager once they go idle */
+	return 0;
+}
+
+/* ---------------------- Runtime tuning ---------------------- */
+
+static int max_workers_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int count;
+	int ret;
+
+	ret = kstrtouint(val, 0, &count);
+	if (ret || !count || count > WORKERS_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(max_workers, count);
+
+	mutex_lock(&pool_mtx);
+	if (is_pool_ready)
+		pool_kick_manager();
+	mutex_unlock(&pool_mtx);
+
+	return 0;
+}
+
+static const struct kernel_param_ops max_workers_ops = {
+	.set = max_workers_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(max_workers, &max_workers_ops, &max_workers, 0644);
+MODULE_PARM_DESC(max_workers, "Upper limit of the worker pool (1..32)");
+
+module_param(grow_threshold, uint, 0644);
+MODULE_PARM_DESC(grow_threshold, "Queue depth above which the pool grows");
+
+module_param(idle_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(idle_timeout_ms, "Workers idle for longer are stopped (down to the online CPUs count)");
+
+static int update_interval_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int interval_s;
+	int ret;
+
+	ret = kstrtouint(val, 0, &interval_s);
+	if (ret || !interval_s)
+		return -EINVAL;
+
+	mutex_lock(&pool_mtx);
+
+	WRITE_ONCE(update_interval_s, interval_s);
+
+	/* Do not wait for the old period to expire */
+	if (is_pool_ready)
+		mod_delayed_work(system_wq, &producer_work, interval_s * HZ);
+
+	mutex_unlock(&pool_mtx);
+	return 0;
+}
+
+static const struct kernel_param_ops update_interval_ops = {
+	.set = update_interval_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(update_interval_s, &update_interval_ops, &update_interval_s,
+		0644);
+MODULE_PARM_DESC(update_interval_s, "Period of the job producer, s");
+
+static int sync_mode_set(const char *val, const struct kernel_param *kp)
+{
+	int mode = sysfs_match_string(sync_mode_names, val);
+
+	if (mode < 0)
+		return mode;
+
+	WRITE_ONCE(sync_mode, mode);
+	return 0;
+}
+
+static int sync_mode_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%s\n", sync_mode_names[READ_ONCE(sync_mode)]);
+}
+
+static const struct kernel_param_ops sync_mode_ops = {
+	.set = sync_mode_set,
+	.get = sync_mode_get,
+};
+
+module_param_cb(sync_mode, &sync_mode_ops, NULL, 0644);
+MODULE_PARM_DESC(sync_mode, "Shared state protection: mutex, seqlock or rcu");
+
+/* --------------------- Readers benchmark -------------------- */
+
+/*
+ * "echo <max_readers> <duration_ms> > read_bench" runs, for each
+ * flavour and for 1, 2, 4 ... max_readers reader threads, one writer
+ * updating the state every BENCH_WRITE_PERIOD_US and the readers
+ * taking snapshots in a loop. "cat read_bench" shows reads/s.
+ */
+struct bench_thread_s {
+	struct task_struct *task;
+	unsigned int       mode;
+	u64                ops;  /* reads or writes */
+	u64                torn;
+};
+
+struct bench_result_s {
+	unsigned int readers;
+	u64          reads_per_s;
+	u64          writes;
+	u64          torn;
+};
+
+static struct bench_thread_s bench_readers[WORKERS_MAX];
+static struct bench_thread_s bench_writer;
+static struct bench_result_s bench_results[SYNC_MODE_COUNT][BENCH_MAX_STEPS];
+static unsigned int bench_steps;
+static DEFINE_MUTEX(bench_mtx);
+
+static int bench_reader_proc(void *arg)
+{
+	struct bench_thread_s *self = arg;
+	struct shared_state_s snap;
+
+	while (!kthread_should_stop()) {
+		if (!state_read(self->mode, &snap))
+			++self->torn;
+
+		if (!(++self->ops & 0x3ff))
+			cond_resched();
+	}
+
+	return 0;
+}
+
+static int bench_writer_proc(void *arg)
+{
+	struct bench_thread_s *self = arg;
+	u64 version;
+
+	while (!kthread_should_stop()) {
+		if (!state_update(self->mode, 0, &version))
+			++self->ops;
+
+		usleep_range(BENCH_WRITE_PERIOD_US, BENCH_WRITE_PERIOD_US + 10);
+	}
+
+	return 0;
+}
+
+static void bench_stop_threads(unsigned int readers)
+{
+	unsigned int i;
+
+	for (i = 0; i < readers; ++i)
+		if (!IS_ERR_OR_NULL(bench_readers[i].task))
+			kthread_stop(bench_readers[i].task);
+
+	if (!IS_ERR_OR_NULL(bench_writer.task))
+		kthread_stop(bench_writer.task);
+}
+
+static int bench_run_step(unsigned int mode, unsigned int readers,
+			  unsigned int duration_ms, struct bench_result_s *res)
+{
+	unsigned int i;
+	u64 reads = 0;
+
+	memset(bench_readers, 0, sizeof(bench_readers));
+	memset(&bench_writer, 0, sizeof(bench_writer));
+
+	bench_writer.mode = mode;
+	bench_writer.task = kthread_run(bench_writer_proc, &bench_writer,
+					"sync_bench_wr");
+	if (IS_ERR(bench_writer.task))
+		return PTR_ERR(bench_writer.task);
+
+	for (i = 0; i < readers; ++i) {
+		bench_readers[i].mode = mode;
+		bench_readers[i].task = kthread_run(bench_reader_proc,
+						    &bench_readers[i],
+						    "sync_bench_rd-%u", i);
+		if (IS_ERR(bench_readers[i].task)) {
+			bench_stop_threads(i);
+			return PTR_ERR(bench_readers[i].task);
+		}
+	}
+
+	msleep(duration_ms);
+	bench_stop_threads(readers);
+
+	res->readers = readers;
+	res->writes = bench_writer.ops;
+	res->torn = 0;
+
+	for (i = 0; i < readers; ++i) {
+		reads += bench_readers[i].ops;
+		res->torn += bench_readers[i].torn;
+	}
+
+	res->reads_per_s = div_u64(reads * MSEC_PER_SEC, duration_ms);
+	return 0;
+}
+
+static int bench_show(struct seq_file *s, void *unused)
+{
+	struct bench_result_s *res;
+	unsigned int mode, step;
+
+	mutex_lock(&bench_mtx);
+
+	if (!bench_steps)
+		seq_puts(s, "no results yet\n");
+
+	for (mode = 0; mode < SYNC_MODE_COUNT && bench_steps; ++mode) {
+		seq_printf(s, "%s:\n", sync_mode_names[mode]);
+
+		for (step = 0; step < bench_steps; ++step) {
+			res = &bench_results[mode][step];
+			seq_printf(s, "  %2u readers: %12llu reads/s, %8llu writes, %llu torn\n",
+				   res->readers, res->reads_per_s, res->writes,
+				   res->torn);
+		}
+	}
+
+	mutex_unlock(&bench_mtx);
+	return 0;
+}
+
+static int bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bench_show, inode->i_private);
+}
+
+static ssize_t bench_write(struct file *file, const char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	char cmd[32] = { 0 };
+	unsigned int max_readers, duration_ms, readers;
+	unsigned int mode, step;
+	int ret = 0;
+
+	if (copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+		return -EFAULT;
+
+	if (sscanf(cmd, "%u %u", &max_readers, &duration_ms) != 2 ||
+	    !max_readers || max_readers > WORKERS_MAX ||
+	    !duration_ms || duration_ms > BENCH_MAX_DURATION_MS)
+		return -EINVAL;
+
+	mutex_lock(&bench_mtx);
+
+	bench_steps = 0;
+
+	for (mode = 0; mode < SYNC_MODE_COUNT && !ret; ++mode) {
+		step = 0;
+
+		for (readers = 1; !ret; readers *= 2) {
+			readers = min(readers, max_readers);
+			ret = bench_run_step(mode, readers, duration_ms,
+					     &bench_results[mode][step++]);
+
+			if (readers == max_readers)
+				break;
+		}
+
+		bench_steps = step;
+	}
+
+	if (ret)
+		bench_steps = 0;
+
+	mutex_unlock(&bench_mtx);
+	return ret ? ret : count;
+}
+
+static const struct file_operations bench_fops = {
+	.owner   = THIS_MODULE,
+	.open    = bench_open,
+	.read    = seq_read,
+	.write   = bench_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* ------------------------- debugfs -------------------------- */
+
+static int pool_stats_show(struct seq_file *s, void *unused)
+{
+	struct worker_struct_s *w;
+	u64 jobs_done = 0;
+	u64 now_ns = ktime_get_ns();
+	u64 lifetime_ns;
+	unsigned int i;
+
+	mutex_lock(&pool_mtx);
+
+	for (i = 0; i < WORKERS_MAX; ++i)
+		if (workers[i].worker_thread)
+			jobs_done += READ_ONCE(workers[i].jobs_done);
+
+	seq_printf(s, "workers: %u (min %u, max %u), online CPUs: %u\n",
+		   workers_running, pool_min_size(), max_workers,
+		   num_online_cpus());
+	seq_printf(s, "queue depth: %d (grow threshold %u)\n",
+		   atomic_read(&queue_depth), grow_threshold);
+	seq_printf(s, "jobs: submitted %lld, done %llu\n",
+		   (long long) atomic64_read(&jobs_submitted),
+		   jobs_done + retired_jobs_done);
+	seq_printf(s, "grows %llu, shrinks %llu, migrations %llu\n",
+		   pool_grows, pool_shrinks, pool_migrations);
+
+	seq_printf(s, "%6s %4s %12s %6s\n", "worker", "cpu", "jobs", "util");
+
+	for (i = 0; i < WORKERS_MAX; ++i) {
+		w = &workers[i];
+		if (!w->worker_thread)
+			continue;
+
+		lifetime_ns = now_ns - w->started_ns;
+
+		/* Utilization: share of the worker lifetime spent in jobs */
+		seq_printf(s, "%6u %4d %12llu %5llu%%\n", w->thread_id, w->cpu,
+			   READ_ONCE(w->jobs_done),
+			   lifetime_ns ?
+			   div64_u64(READ_ONCE(w->busy_ns) * 100, lifetime_ns) : 0);
+	}
+
+	mutex_unlock(&pool_mtx);
+	return 0;
+}
+
+static int pool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pool_stats_show, inode->i_private);
+}
+
+static const struct file_operations pool_stats_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pool_stats_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* "echo N > submit" queues N jobs at once */
+static ssize_t pool_submit_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	unsigned int jobs;
+	int ret;
+
+	ret = kstrtouint_from_user(buf, count, 0, &jobs);
+	if (ret)
+		return ret;
+
+	if (!jobs || jobs > POOL_MAX_SUBMIT)
+		return -EINVAL;
+
+	jobs_submit(jobs);
+	return count;
+}
+
+static const struct file_operations pool_submit_fops = {
+	.owner = THIS_MODULE,
+	.write = pool_submit_write,
+};
+
+/* ------------------------------------------------------------ */
+
+static void threads_pool_cleanup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < WORKERS_MAX; ++i)
+		if (workers[i].worker_thread)
+			pool_worker_stop(&workers[i]);
+
 	pr_info("Threads pool cleanup done.\n");
 }
 
 static int __init sync_sample_init(void)
 {
-	int i;
+	int ret;
+
+	INIT_DELAYED_WORK(&pool_manage_work, pool_manage_proc);
+	INIT_DELAYED_WORK(&producer_work, producer_proc);
 
-	for (i = 0; i < WORKERS_COUNT; ++i) {
-		init_completion(&workers[i].comp_obj);
-		workers[i].thread_id = i;
+	RCU_INIT_POINTER(rcu_state, kzalloc(sizeof(struct shared_state_s),
+					    GFP_KERNEL));
+	if (!rcu_access_pointer(rcu_state))
+		return -ENOMEM;
 
-		workers[i].worker_thread =
-			kthread_run(worker_proc,
-				(void *) &workers[i],
-				"worker-%d", i);
+	mutex_lock(&pool_mtx);
 
-		if (IS_ERR(workers[i].worker_thread)) {
-			pr_err("Failed to instantiate thread %d.\n", i);
-			goto err_init_cleanup;
+	while (workers_running < pool_min_size()) {
+		ret = pool_worker_start();
+		if (ret) {
+			threads_pool_cleanup();
+			mutex_unlock(&pool_mtx);
+			kfree(rcu_access_pointer(rcu_state));
+			return ret;
 		}
+	}
+
+	is_pool_ready = true;
+	mutex_unlock(&pool_mtx);
 
-		pr_info("Thread %d created.\n", i);
+	ret = cpuhp_setup_state_nocalls(CPUHP_AP_ONLINE_DYN, "synctest:online",
+					pool_cpu_online, pool_cpu_offline);
+	if (ret < 0) {
+		pr_err("Failed to register CPU hotplug callbacks.\n");
+		goto err_pool_stop;
 	}
+	pool_cpuhp_state = ret;
+
+	pool_dbg_dir = debugfs_create_dir("synctest", NULL);
+	debugfs_create_file("pool", 0444, pool_dbg_dir, NULL, &pool_stats_fops);
+	debugfs_create_file("submit", 0200, pool_dbg_dir, NULL, &pool_submit_fops);
+	debugfs_create_file("read_bench", 0644, pool_dbg_dir, NULL, &bench_fops);
+
+	schedule_delayed_work(&pool_manage_work,
+			      msecs_to_jiffies(POOL_MANAGE_PERIOD_MS));
+	schedule_delayed_work(&producer_work, 0);
 
 	return 0;
 
-err_init_cleanup:
+err_pool_stop:
+	mutex_lock(&pool_mtx);
+	is_pool_ready = false;
 	threads_pool_cleanup();
-	return -1;
+	mutex_unlock(&pool_mtx);
+	kfree(rcu_access_pointer(rcu_state));
+	return ret;
 }
 
 static void __exit sync_sample_exit(void)
 {
+	debugfs_remove_recursive(pool_dbg_dir);
+	cpuhp_remove_state_nocalls(pool_cpuhp_state);
+
+	mutex_lock(&pool_mtx);
+	is_pool_ready = false;
+	mutex_unlock(&pool_mtx);
+
+	cancel_delayed_work_sync(&producer_work);
+	cancel_delayed_work_sync(&pool_manage_work);
+
+	mutex_lock(&pool_mtx);
 	threads_pool_cleanup();
+	mutex_unlock(&pool_mtx);
+
+	/* No readers & writers left; older copies go with kfree_rcu() */
+	kfree(rcu_access_pointer(rcu_state));
 }
 
 module_init(sync_sample_init);
@@ -6,42 +6,147 @@
 #include <linux/platform_device.h>
 #include <linux/hrtimer.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
+#include <linux/cache.h>
+#include <linux/debugfs.h>
+#include <linux/miscdevice.h>
 #include <asm/io.h>
 
+#include "platform_test-msgpool.h"
+#include "platform_test-codec.h"
+#include "platform_test-filter.h"
+#include "platform_test-txq.h"
+#include "platform_test-trace.h"
+#include "platform_test-busypoll.h"
+
 #define DRV_NAME  "plat_dummy"
 
 #define MEM_SIZE		(4096)
+#define PLAT_MAX_PAYLOAD	(4 * MEM_SIZE) /* Carried by an LZ4 frame */
 #define REG_SIZE		(4 * 4 * 4)
-#define DEVICE_POLLING_TIME_MS	(500)
+#define DEVICE_POLLING_TIME_MS	(500) /* Default of "poll_time_ms" */
 
 #define PLAT_IO_FLAGS_REG	(0) /* Offset of flags register */
 #define PLAT_RD_SIZE_REG	(4) /* Offset of RD size */
 #define PLAT_WR_SIZE_REG	(8) /* Offset of RW size */
+#define PLAT_WR_CREDITS_REG	(12) /* WR windows userspace can take, see below */
+#define PLAT_WR_SENT_REG	(16) /* WR windows sent so far, set by the driver */
 
 /*
- * --------------------
- * 31.........| 1 | 0 | offset
- * --------------------
- * | reserved | w | r |
- * --------------------
+ * ------------------------------------
+ * 31.........| 5 | 4 | 3 | 2 | 1 | 0 | offset
+ * ----------------------------------------
+ * | reserved | f | c | W | R | w | r |
+ * ----------------------------------------
  *  r = RD buffer ready
  *  w = WR buffer ready
+ *  R = RD buffer holds an LZ4 frame (set by userspace with r)
+ *  W = WR buffer holds an LZ4 frame (set by the driver with w)
+ *  c = userspace decodes LZ4 frames
+ *  f = userspace grants WR credits
+ *
+ * Flow control: with f set, the driver only fills the WR window while
+ * PLAT_WR_CREDITS_REG is ahead of PLAT_WR_SENT_REG. Both are wrapping
+ * counters of windows; userspace keeps the credits at the sent count
+ * it has seen plus the number of messages it still has room for.
  */
 
 #define PLAT_RD_DATA_READY	(1) /* RD buffer ready - 000...01 */
 #define PLAT_WR_DATA_READY	(2) /* WR buffer ready - 000...10 */
+#define PLAT_RD_LZ4_FRAME	(4)
+#define PLAT_WR_LZ4_FRAME	(8)
+#define PLAT_USR_LZ4_CAPABLE	(16)
+#define PLAT_USR_WR_CREDITS	(32)
+
+#define MAX_DUMMY_PLAT_THREADS	(2) /* Data processing threads, default of "max_threads" */
+
+#define PLAT_RX_QUEUE_MAX	(64) /* Received messages kept, the oldest are dropped */
+
+/*
+ * Data directions of the device. Each one is polled by its own work
+ * and has its own lock and stats, see platform_test-channel.h.
+ */
+enum plat_dummy_channel_id {
+	PLAT_CH_RD,	/* usr -> krn */
+	PLAT_CH_WR,	/* krn -> usr */
+	PLAT_CH_COUNT
+};
 
-#define MAX_DUMMY_PLAT_THREADS	(2) /* Data processing threads */
+struct plat_dummy_device;
+struct plat_dummy_channel;
+struct plat_dummy_net;
+struct plat_ring;
+
+struct plat_dummy_channel_ops {
+	const char	*name;
+	/* Called once per poll period, returns bytes moved (0 if idle) */
+	u32		(*poll)(struct plat_dummy_channel *ch);
+};
+
+/*
+ * Everything a channel's work touches lives in the channel, and each
+ * channel has a cache line of its own, so works of different channels
+ * running on different CPUs share neither lock nor data.
+ */
+struct plat_dummy_channel {
+	struct plat_dummy_device		*dev;
+	const struct plat_dummy_channel_ops	*ops;
+	void __iomem				*buf;
+	struct delayed_work			work;
+	struct work_struct			bench_work;
+	unsigned int				bench_loops;
+	u64					bench_ns;
+
+	/* Serializes the polls of the channel, protects the stats */
+	struct mutex				lock;
+	u64					polls;
+	u64					transfers;
+	u64					bytes;
+	u64					busy_ns;
+	int					last_cpu;
+
+	/* Busy-poll mode: the kicked channel is polled from this jiffy */
+	unsigned long				kick_due;
+} ____cacheline_aligned;
 
 struct plat_dummy_device {
-	void __iomem		*rd_buf;
-	void __iomem		*wr_buf;
 	void __iomem		*regs;
-	struct mutex            status_mtx;
-	struct delayed_work	plat_rd_work;
-	struct delayed_work	plat_wr_work;
 	struct workqueue_struct *data_process_wq;
-	u64 js_poll_time;
+	unsigned long		js_poll_time;
+
+	struct dentry		*dbg_dir;
+	struct plat_msgpool	msgpool;
+	struct plat_dummy_codec	codec;
+	struct plat_dummy_filter filter;
+	struct plat_dummy_txq	txq;
+	struct plat_dummy_trace	trace;
+	struct plat_dummy_busypoll busypoll;
+	struct plat_dummy_net	*net;	/* NULL without the netdev frontend */
+
+	/* Async I/O rings, see platform_test-ring.h */
+	struct miscdevice	ring_misc;
+	bool			has_ring;
+	unsigned long		ring_busy;
+	struct plat_ring	*ring;	/* NULL until set up by userspace */
+
+	/* Messages received from userspace, oldest first */
+	struct list_head	rx_queue;
+	spinlock_t		rx_lock;
+	unsigned int		rx_queued;
+	u64			rx_dropped;
+
+	/*
+	 * The flags register is shared by all channels: the lock covers
+	 * its read-modify-write only. Taken from BH context by the
+	 * network frontend.
+	 */
+	spinlock_t		flags_lock ____cacheline_aligned;
+	u32			wr_sent;	/* Under flags_lock */
+	atomic64_t		wr_credit_stalls;
+
+	struct plat_dummy_channel channels[PLAT_CH_COUNT];
 };
 
 #endif
@@ -0,0 +1,574 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform_test-trace.h"
+
+/*
+ * Replays a traffic capture of the plat_dummy driver.
+ *
+ * Build: gcc -O2 -o plat_replay plat_replay.c -lpthread
+ *
+ * Capture:
+ *   echo start > /sys/kernel/debug/plat_dummy/trace_ctl
+ *   ... production load ...
+ *   echo stop > /sys/kernel/debug/plat_dummy/trace_ctl
+ *   cat /sys/kernel/debug/plat_dummy/trace[0-9]* > load.trace
+ *
+ * Replay: plat_replay [-m] [-e] [-o result] [-b baseline] load.trace...
+ *
+ * RD records are played as userspace would: a window of the recorded
+ * size is written and flagged ready, the latency is the time until
+ * the driver releases it. WR records are generated in the driver
+ * through the "tx" debugfs file, the latency is the time until the
+ * window is ready; the tool then takes it. LZ4 frames are replayed
+ * as raw windows of the frame size, so the decoder is not exercised.
+ *
+ *  -m  at maximum speed instead of the recorded timing
+ *  -e  against a RAM-backed emulation of the device instead of
+ *      /dev/mem, e.g. to measure the tool itself
+ *  -o  stores the results, to compare another driver build with -b
+ */
+
+#define OUT_BUF_BASE	0x9f200000	/* RD window of the driver */
+#define IN_BUF_BASE	0x9f201000	/* WR window of the driver */
+#define REG_BASE	0x9f202000
+
+#define WIN_SIZE	(4096)
+#define REG_COUNT	(5)
+
+#define FLAGS_REG	(0)
+#define RD_SIZE_REG	(1)
+#define WR_SIZE_REG	(2)
+
+#define RD_DATA_READY	(1)
+#define WR_DATA_READY	(2)
+
+#define TX_DEBUGFS	"/sys/kernel/debug/plat_dummy/tx"
+#define TX_CLASS	(1)		/* Bulk, see platform_test-txq.h */
+
+#define WAIT_TIMEOUT_NS	(1000000000ULL)
+
+#define EMU_QUEUE	(256)
+
+struct emu_dev {
+	uint32_t		regs[REG_COUNT];
+	uint8_t			rd[WIN_SIZE];
+	uint8_t			wr[WIN_SIZE];
+	uint8_t			scratch[WIN_SIZE];
+
+	/* WR messages requested by the replay */
+	uint32_t		queue[EMU_QUEUE];
+	unsigned int		head;
+	unsigned int		tail;
+	int			stop;
+	pthread_t		thread;
+};
+
+struct target {
+	volatile uint32_t	*regs;
+	volatile uint8_t	*rd;
+	volatile uint8_t	*wr;
+	int			tx_fd;
+	struct emu_dev		*emu;
+};
+
+struct dir_stats {
+	unsigned long		msgs;
+	unsigned long long	bytes;
+	unsigned long		timeouts;
+	unsigned long long	*lat_ns;
+};
+
+static struct plat_trace_rec *recs;
+static size_t nr_recs;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t flags_load(struct target *t)
+{
+	return __atomic_load_n(&t->regs[FLAGS_REG], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Polls for the flag to be set or clear. The CPU is given up on each
+ * round: the board has a single core and the driver needs it too.
+ */
+static int wait_flag(struct target *t, uint32_t flag, int is_set,
+		     unsigned long long start)
+{
+	while (!(flags_load(t) & flag) != !is_set) {
+		if (now_ns() - start > WAIT_TIMEOUT_NS)
+			return -1;
+		sched_yield();
+	}
+
+	return 0;
+}
+
+/* ------------------------- trace files --------------------------- */
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const struct plat_trace_rec *ra = a, *rb = b;
+
+	if (ra->timestamp_ns != rb->timestamp_ns)
+		return ra->timestamp_ns < rb->timestamp_ns ? -1 : 1;
+	return 0;
+}
+
+/* The per-CPU files may be given one by one or concatenated */
+static int load_trace(const char *path)
+{
+	struct plat_trace_rec rec;
+	FILE *f = fopen(path, "rb");
+	size_t cap = nr_recs;
+
+	if (!f) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (nr_recs == cap) {
+			cap = cap ? cap * 2 : 4096;
+			recs = realloc(recs, cap * sizeof(*recs));
+			if (!recs) {
+				fclose(f);
+				return -1;
+			}
+		}
+		recs[nr_recs++] = rec;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/* ---------------------------- emulation -------------------------- */
+
+/* Plays the driver side of the handshake from RAM */
+static void *emu_thread(void *arg)
+{
+	struct emu_dev *emu = arg;
+	uint32_t flags, size;
+
+	while (!__atomic_load_n(&emu->stop, __ATOMIC_RELAXED)) {
+		flags = __atomic_load_n(&emu->regs[FLAGS_REG],
+					__ATOMIC_ACQUIRE);
+
+		if (flags & RD_DATA_READY) {
+			size = emu->regs[RD_SIZE_REG];
+			memcpy(emu->scratch, emu->rd,
+			       size < WIN_SIZE ? size : WIN_SIZE);
+			__atomic_fetch_and(&emu->regs[FLAGS_REG],
+					   ~RD_DATA_READY, __ATOMIC_RELEASE);
+		}
+
+		if (!(flags & WR_DATA_READY) &&
+		    emu->tail != __atomic_load_n(&emu->head,
+						 __ATOMIC_ACQUIRE)) {
+			size = emu->queue[emu->tail % EMU_QUEUE];
+			memset(emu->wr, 'A' + TX_CLASS, size);
+			emu->regs[WR_SIZE_REG] = size;
+			__atomic_store_n(&emu->tail, emu->tail + 1,
+					 __ATOMIC_RELEASE);
+			__atomic_fetch_or(&emu->regs[FLAGS_REG],
+					  WR_DATA_READY, __ATOMIC_RELEASE);
+		}
+
+		sched_yield();
+	}
+
+	return NULL;
+}
+
+static int emu_open(struct target *t)
+{
+	struct emu_dev *emu = calloc(1, sizeof(*emu));
+
+	if (!emu)
+		return -1;
+
+	t->emu = emu;
+	t->regs = emu->regs;
+	t->rd = emu->rd;
+	t->wr = emu->wr;
+
+	return pthread_create(&emu->thread, NULL, emu_thread, emu) ? -1 : 0;
+}
+
+static void emu_close(struct target *t)
+{
+	__atomic_store_n(&t->emu->stop, 1, __ATOMIC_RELAXED);
+	pthread_join(t->emu->thread, NULL);
+	free(t->emu);
+}
+
+/* ----------------------------- device ---------------------------- */
+
+static int dev_open(struct target *t)
+{
+	int fd = open("/dev/mem", O_RDWR | O_SYNC);
+
+	if (fd < 0) {
+		printf("Can't open /dev/mem\n");
+		return -1;
+	}
+
+	t->rd = mmap(0, WIN_SIZE, PROT_WRITE, MAP_SHARED, fd, OUT_BUF_BASE);
+	t->wr = mmap(0, WIN_SIZE, PROT_READ, MAP_SHARED, fd, IN_BUF_BASE);
+	t->regs = mmap(0, REG_COUNT * sizeof(uint32_t),
+		       PROT_READ | PROT_WRITE, MAP_SHARED, fd, REG_BASE);
+	close(fd);
+
+	if (t->rd == MAP_FAILED || t->wr == MAP_FAILED ||
+	    t->regs == MAP_FAILED) {
+		printf("Can't mmap the device\n");
+		return -1;
+	}
+
+	t->tx_fd = open(TX_DEBUGFS, O_WRONLY);
+	if (t->tx_fd < 0) {
+		printf("Can't open %s, WR records are skipped\n", TX_DEBUGFS);
+		return 0;
+	}
+
+	return 0;
+}
+
+/* ----------------------------- replay ---------------------------- */
+
+static int send_rd(struct target *t, uint32_t size,
+		   unsigned long long *lat_ns)
+{
+	unsigned long long start;
+	uint32_t i;
+
+	/* The previous message may still be in the window */
+	if (wait_flag(t, RD_DATA_READY, 0, now_ns()))
+		return -1;
+
+	for (i = 0; i < size; i++)
+		t->rd[i] = (uint8_t) i;
+	t->regs[RD_SIZE_REG] = size;
+
+	start = now_ns();
+	__atomic_fetch_or(&t->regs[FLAGS_REG], RD_DATA_READY,
+			  __ATOMIC_RELEASE);
+
+	if (wait_flag(t, RD_DATA_READY, 0, start))
+		return -1;
+
+	*lat_ns = now_ns() - start;
+	return 0;
+}
+
+static int request_wr(struct target *t, uint32_t len)
+{
+	struct emu_dev *emu = t->emu;
+	char cmd[32];
+
+	if (emu) {
+		if (emu->head - __atomic_load_n(&emu->tail,
+						__ATOMIC_ACQUIRE) >= EMU_QUEUE)
+			return -1;
+		emu->queue[emu->head % EMU_QUEUE] = len;
+		__atomic_store_n(&emu->head, emu->head + 1, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	if (t->tx_fd < 0)
+		return -1;
+
+	snprintf(cmd, sizeof(cmd), "%d 1 %u", TX_CLASS, len);
+	return write(t->tx_fd, cmd, strlen(cmd)) < 0 ? -1 : 0;
+}
+
+/* Windows of other senders (e.g. the dummy message) are taken too */
+static int take_wr(struct target *t, uint32_t len,
+		   unsigned long long *lat_ns, unsigned long *foreign)
+{
+	unsigned long long start = now_ns();
+
+	if (request_wr(t, len))
+		return -1;
+
+	for (;;) {
+		if (wait_flag(t, WR_DATA_READY, 1, start))
+			return -1;
+
+		if (t->regs[WR_SIZE_REG] == len) {
+			*lat_ns = now_ns() - start;
+			__atomic_fetch_and(&t->regs[FLAGS_REG], ~WR_DATA_READY,
+					   __ATOMIC_RELEASE);
+			return 0;
+		}
+
+		(*foreign)++;
+		__atomic_fetch_and(&t->regs[FLAGS_REG], ~WR_DATA_READY,
+				   __ATOMIC_RELEASE);
+	}
+}
+
+static void sleep_until(unsigned long long ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+/* ----------------------------- results --------------------------- */
+
+static int lat_cmp(const void *a, const void *b)
+{
+	unsigned long long la = *(const unsigned long long *) a;
+	unsigned long long lb = *(const unsigned long long *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+struct result {
+	char	key[32];
+	double	val;
+};
+
+static struct result results[32];
+static int nr_results;
+
+static void result_add(const char *key, double val)
+{
+	snprintf(results[nr_results].key, sizeof(results[0].key), "%s", key);
+	results[nr_results++].val = val;
+}
+
+static void dir_report(const char *name, struct dir_stats *st)
+{
+	unsigned long long sum = 0;
+	unsigned long i, n = st->msgs;
+	char key[32];
+
+	qsort(st->lat_ns, n, sizeof(*st->lat_ns), lat_cmp);
+	for (i = 0; i < n; i++)
+		sum += st->lat_ns[i];
+
+	printf("%s: %lu msgs, %llu bytes, %lu timeouts\n", name, n, st->bytes,
+	       st->timeouts);
+	if (!n)
+		return;
+
+	printf("    latency us: avg %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+	       sum / 1000.0 / n, st->lat_ns[n / 2] / 1000.0,
+	       st->lat_ns[n * 99 / 100] / 1000.0, st->lat_ns[n - 1] / 1000.0);
+
+#define ADD(what, val) \
+	do { \
+		snprintf(key, sizeof(key), "%s_%s", name, what); \
+		result_add(key, val); \
+	} while (0)
+
+	ADD("msgs", n);
+	ADD("lat_avg_us", sum / 1000.0 / n);
+	ADD("lat_p50_us", st->lat_ns[n / 2] / 1000.0);
+	ADD("lat_p99_us", st->lat_ns[n * 99 / 100] / 1000.0);
+	ADD("lat_max_us", st->lat_ns[n - 1] / 1000.0);
+#undef ADD
+}
+
+static void results_save(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	int i;
+
+	if (!f) {
+		fprintf(stderr, "Can't write %s\n", path);
+		return;
+	}
+
+	for (i = 0; i < nr_results; i++)
+		fprintf(f, "%s %f\n", results[i].key, results[i].val);
+	fclose(f);
+}
+
+static void results_compare(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char key[32];
+	double base;
+	int i;
+
+	if (!f) {
+		fprintf(stderr, "Can't read %s\n", path);
+		return;
+	}
+
+	printf("\n%-16s %12s %12s %9s\n", "", "baseline", "this run", "delta");
+
+	while (fscanf(f, "%31s %lf", key, &base) == 2) {
+		for (i = 0; i < nr_results; i++) {
+			if (strcmp(results[i].key, key))
+				continue;
+
+			printf("%-16s %12.1f %12.1f", key, base,
+			       results[i].val);
+			if (base)
+				printf(" %+8.1f%%",
+				       (results[i].val - base) * 100 / base);
+			printf("\n");
+		}
+	}
+
+	fclose(f);
+}
+
+/* ------------------------------------------------------------------ */
+
+int main(int argc, char **argv)
+{
+	struct target t = { .tx_fd = -1 };
+	struct dir_stats st[2] = { 0 };
+	const char *out = NULL, *baseline = NULL;
+	unsigned long long start, elapsed, lat, bytes;
+	unsigned long late = 0, foreign = 0;
+	int max_speed = 0, emulate = 0;
+	size_t i;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "meo:b:")) != -1) {
+		switch (opt) {
+		case 'm':
+			max_speed = 1;
+			break;
+		case 'e':
+			emulate = 1;
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-m] [-e] [-o result] "
+				"[-b baseline] trace...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "No trace given\n");
+		return 1;
+	}
+
+	for (; optind < argc; optind++)
+		if (load_trace(argv[optind]))
+			return 1;
+
+	if (!nr_recs) {
+		fprintf(stderr, "The trace is empty\n");
+		return 1;
+	}
+
+	qsort(recs, nr_recs, sizeof(*recs), rec_cmp);
+
+	st[PLAT_TRACE_RD].lat_ns = calloc(nr_recs, sizeof(lat));
+	st[PLAT_TRACE_WR].lat_ns = calloc(nr_recs, sizeof(lat));
+	if (!st[PLAT_TRACE_RD].lat_ns || !st[PLAT_TRACE_WR].lat_ns)
+		return 1;
+
+	if (emulate ? emu_open(&t) : dev_open(&t))
+		return 1;
+
+	printf("Replaying %zu records over %.3f s%s%s\n", nr_recs,
+	       (recs[nr_recs - 1].timestamp_ns - recs[0].timestamp_ns) / 1e9,
+	       max_speed ? ", maximum speed" : "",
+	       emulate ? ", emulated device" : "");
+
+	start = now_ns();
+
+	for (i = 0; i < nr_recs; i++) {
+		struct plat_trace_rec *rec = &recs[i];
+		struct dir_stats *ds;
+		uint32_t size;
+
+		if (rec->dir > PLAT_TRACE_WR || (rec->flags & PLAT_TRACE_BAD))
+			continue;
+
+		if (!max_speed) {
+			unsigned long long due = start + rec->timestamp_ns -
+						 recs[0].timestamp_ns;
+
+			if (now_ns() > due)
+				late++;
+			else
+				sleep_until(due);
+		}
+
+		ds = &st[rec->dir];
+
+		if (rec->dir == PLAT_TRACE_RD) {
+			size = rec->size < WIN_SIZE ? rec->size : WIN_SIZE;
+			ret = send_rd(&t, size, &lat);
+		} else {
+			if (!emulate && t.tx_fd < 0)
+				continue;
+			size = rec->len < WIN_SIZE ? rec->len : WIN_SIZE;
+			ret = take_wr(&t, size, &lat, &foreign);
+		}
+
+		if (ret) {
+			ds->timeouts++;
+			continue;
+		}
+
+		ds->lat_ns[ds->msgs++] = lat;
+		ds->bytes += size;
+	}
+
+	elapsed = now_ns() - start;
+
+	if (emulate)
+		emu_close(&t);
+
+	bytes = st[PLAT_TRACE_RD].bytes + st[PLAT_TRACE_WR].bytes;
+
+	printf("elapsed %.3f s, %.1f KB/s, %.0f msgs/s, %lu late, "
+	       "%lu foreign WR\n", elapsed / 1e9, bytes * 1e6 / elapsed,
+	       (st[PLAT_TRACE_RD].msgs + st[PLAT_TRACE_WR].msgs) * 1e9 /
+	       elapsed, late, foreign);
+
+	result_add("elapsed_ms", elapsed / 1e6);
+	result_add("throughput_kbps", bytes * 1e6 / elapsed);
+	result_add("timeouts", st[PLAT_TRACE_RD].timeouts +
+		   st[PLAT_TRACE_WR].timeouts);
+	dir_report("rd", &st[PLAT_TRACE_RD]);
+	dir_report("wr", &st[PLAT_TRACE_WR]);
+
+	if (out)
+		results_save(out);
+	if (baseline)
+		results_compare(baseline);
+
+	return 0;
+}
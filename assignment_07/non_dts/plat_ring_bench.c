@@ -0,0 +1,368 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform_test-ring.h"
+
+/*
+ * Message rate through the plat_dummy submission/completion rings.
+ *
+ * Build: gcc -O2 -o plat_ring_bench plat_ring_bench.c -lpthread
+ *
+ * Usage: plat_ring_bench [-m nop|send] [-n msgs] [-b batch] [-l len]
+ *                        [-t speedup]
+ *
+ * The same messages are pushed twice: first one per syscall (batch of
+ * 1, a PLAT_RING_IOC_WAKEUP for each, as a write() per message would
+ * do), then in batches. The run fails if the batched rate is not at
+ * least "speedup" times the first one (default 10 for nop, 1 for send).
+ *
+ *  -m nop   completes in the driver without a window: the cost of the
+ *           rings and of waking the driver, i.e. the small message
+ *           rate the interface itself sustains (default)
+ *  -m send  goes through the WR window, which a thread takes over
+ *           /dev/mem as userspace would: one message per window, so
+ *           the handshake bounds both runs
+ */
+
+#define RING_DEV	"/dev/plat_dummy_ring"
+
+#define IN_BUF_BASE	0x9f201000	/* WR window of the driver */
+#define REG_BASE	0x9f202000
+
+#define WIN_SIZE	(4096)
+#define REG_COUNT	(5)
+
+#define FLAGS_REG	(0)
+#define WR_DATA_READY	(2)
+
+#define WAIT_TIMEOUT_NS	(1000000000ULL)
+
+struct ring {
+	int			fd;
+	struct plat_ring_params	p;
+	struct plat_ring_hdr	*hdr;
+	struct plat_ring_sqe	*sqes;
+	struct plat_ring_cqe	*cqes;
+	uint8_t			*data;
+
+	/* Our side of the indexes */
+	uint32_t		sq_tail;
+	uint32_t		cq_head;
+
+	unsigned long		wakeups;
+	unsigned long		errors;
+};
+
+struct peer {
+	volatile uint32_t	*regs;
+	int			stop;
+	unsigned long		windows;
+	pthread_t		thread;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ----------------------------- rings ----------------------------- */
+
+static int ring_open(struct ring *r, uint32_t entries, uint32_t data_size)
+{
+	void *map;
+
+	memset(r, 0, sizeof(*r));
+
+	r->fd = open(RING_DEV, O_RDWR);
+	if (r->fd < 0) {
+		printf("Can't open %s: %s\n", RING_DEV, strerror(errno));
+		return -1;
+	}
+
+	r->p.sq_entries = entries;
+	r->p.data_size = data_size;
+	r->p.eventfd = -1;
+
+	if (ioctl(r->fd, PLAT_RING_IOC_SETUP, &r->p)) {
+		printf("Ring setup failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	map = mmap(0, r->p.mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   r->fd, 0);
+	if (map == MAP_FAILED) {
+		printf("Can't mmap the rings\n");
+		return -1;
+	}
+
+	r->hdr = map;
+	r->sqes = (void *) ((uint8_t *) map + r->p.sqes_off);
+	r->cqes = (void *) ((uint8_t *) map + r->p.cqes_off);
+	r->data = (uint8_t *) map + r->p.data_off;
+	return 0;
+}
+
+static void ring_close(struct ring *r)
+{
+	munmap(r->hdr, r->p.mmap_size);
+	close(r->fd);
+}
+
+static void ring_submit(struct ring *r, unsigned int n, uint8_t opcode,
+			uint32_t len)
+{
+	struct plat_ring_sqe *sqe;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		sqe = &r->sqes[r->sq_tail & (r->p.sq_entries - 1)];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = opcode;
+		sqe->len = len;
+		sqe->data_off = (uint64_t) i * len;
+		sqe->user_data = r->sq_tail;
+		r->sq_tail++;
+	}
+
+	/* Pairs with the barrier between NEED_WAKEUP and the tail check */
+	__atomic_store_n(&r->hdr->sq.tail, r->sq_tail, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&r->hdr->flags, __ATOMIC_RELAXED) &
+	    PLAT_RING_NEED_WAKEUP) {
+		ioctl(r->fd, PLAT_RING_IOC_WAKEUP);
+		r->wakeups++;
+	}
+}
+
+/* The CPU is given up on each empty round, the driver may need it */
+static int ring_reap(struct ring *r, unsigned int n)
+{
+	unsigned long long start = now_ns();
+	struct plat_ring_cqe *cqe;
+	uint32_t tail;
+
+	while (n) {
+		tail = __atomic_load_n(&r->hdr->cq.tail, __ATOMIC_ACQUIRE);
+
+		if (tail == r->cq_head) {
+			if (now_ns() - start > WAIT_TIMEOUT_NS)
+				return -1;
+			sched_yield();
+			continue;
+		}
+
+		for (; r->cq_head != tail && n; r->cq_head++, n--) {
+			cqe = &r->cqes[r->cq_head & (r->p.cq_entries - 1)];
+			if (cqe->res < 0)
+				r->errors++;
+		}
+
+		__atomic_store_n(&r->hdr->cq.head, r->cq_head,
+				 __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+/* Returns the ns the messages took, 0 on a timeout */
+static unsigned long long ring_run(struct ring *r, unsigned long msgs,
+				   unsigned int batch, uint8_t opcode,
+				   uint32_t len)
+{
+	unsigned long long start = now_ns();
+	unsigned int n;
+
+	r->wakeups = 0;
+	r->errors = 0;
+
+	while (msgs) {
+		n = msgs < batch ? msgs : batch;
+
+		ring_submit(r, n, opcode, len);
+		if (ring_reap(r, n))
+			return 0;
+
+		msgs -= n;
+	}
+
+	return now_ns() - start;
+}
+
+/* ----------------------------- peer ------------------------------ */
+
+/* Takes every WR window the driver fills */
+static void *peer_thread(void *arg)
+{
+	struct peer *peer = arg;
+
+	while (!__atomic_load_n(&peer->stop, __ATOMIC_RELAXED)) {
+		if (__atomic_load_n(&peer->regs[FLAGS_REG], __ATOMIC_ACQUIRE) &
+		    WR_DATA_READY) {
+			__atomic_fetch_and(&peer->regs[FLAGS_REG],
+					   ~WR_DATA_READY, __ATOMIC_RELEASE);
+			peer->windows++;
+		}
+
+		sched_yield();
+	}
+
+	return NULL;
+}
+
+static int peer_start(struct peer *peer)
+{
+	int fd = open("/dev/mem", O_RDWR | O_SYNC);
+
+	if (fd < 0) {
+		printf("Can't open /dev/mem\n");
+		return -1;
+	}
+
+	peer->regs = mmap(0, REG_COUNT * sizeof(uint32_t),
+			  PROT_READ | PROT_WRITE, MAP_SHARED, fd, REG_BASE);
+	close(fd);
+
+	if (peer->regs == MAP_FAILED) {
+		printf("Can't mmap the device\n");
+		return -1;
+	}
+
+	return pthread_create(&peer->thread, NULL, peer_thread, peer) ? -1 : 0;
+}
+
+static void peer_stop(struct peer *peer)
+{
+	__atomic_store_n(&peer->stop, 1, __ATOMIC_RELAXED);
+	pthread_join(peer->thread, NULL);
+	munmap((void *) peer->regs, REG_COUNT * sizeof(uint32_t));
+}
+
+/* ----------------------------------------------------------------- */
+
+static double report(const char *name, struct ring *r, unsigned long msgs,
+		     unsigned long long ns)
+{
+	double rate = msgs * 1e9 / ns;
+
+	printf("%-10s %8lu msgs in %8.1f ms: %10.0f msgs/s, %.3f wakeups/msg, %lu errors\n",
+	       name, msgs, ns / 1e6, rate, (double) r->wakeups / msgs,
+	       r->errors);
+	return rate;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-m nop|send] [-n msgs] [-b batch] [-l len] [-t speedup]\n",
+	       prog);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long msgs = 100000;
+	unsigned int batch = 64;
+	uint32_t len = 64;
+	double target = 0, single, batched;
+	uint8_t opcode = PLAT_RING_OP_NOP;
+	unsigned long long ns;
+	struct peer peer = { 0 };
+	struct ring r;
+	char name[32];
+	int opt, ret = 1;
+
+	while ((opt = getopt(argc, argv, "m:n:b:l:t:")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (!strcmp(optarg, "send")) {
+				opcode = PLAT_RING_OP_SEND;
+			} else if (strcmp(optarg, "nop")) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			msgs = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			target = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	/* The window handshake bounds SEND: batching must not slow it down */
+	if (!target)
+		target = opcode == PLAT_RING_OP_SEND ? 1 : 10;
+
+	if (!msgs || !batch || batch > PLAT_RING_MAX_ENTRIES || !len ||
+	    len > WIN_SIZE) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* A NOP carries no data, a SEND of each batch slot has its own */
+	if (ring_open(&r, batch, opcode == PLAT_RING_OP_SEND ?
+		      batch * len : 0))
+		return 1;
+
+	memset(r.data, 'R', r.p.data_size);
+
+	if (opcode == PLAT_RING_OP_SEND && peer_start(&peer))
+		goto out;
+
+	printf("%s, %u bytes, rings of %u/%u entries\n",
+	       opcode == PLAT_RING_OP_SEND ? "SEND" : "NOP",
+	       opcode == PLAT_RING_OP_SEND ? len : 0,
+	       r.p.sq_entries, r.p.cq_entries);
+
+	ns = ring_run(&r, msgs, 1, opcode, len);
+	if (!ns) {
+		printf("Timed out waiting for completions\n");
+		goto out_peer;
+	}
+	single = report("batch 1", &r, msgs, ns);
+
+	ns = ring_run(&r, msgs, batch, opcode, len);
+	if (!ns) {
+		printf("Timed out waiting for completions\n");
+		goto out_peer;
+	}
+	snprintf(name, sizeof(name), "batch %u", batch);
+	batched = report(name, &r, msgs, ns);
+
+	printf("speedup %.1fx, target %.1fx: %s\n", batched / single, target,
+	       batched >= single * target ? "PASS" : "FAIL");
+	ret = batched >= single * target ? 0 : 1;
+
+out_peer:
+	if (opcode == PLAT_RING_OP_SEND) {
+		peer_stop(&peer);
+		printf("WR windows taken: %lu\n", peer.windows);
+	}
+out:
+	ring_close(&r);
+	return ret;
+}
@@ -3,10 +3,18 @@
 #include <linux/platform_device.h>
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/cpumask.h>
+#include <linux/seq_file.h>
 #include <asm/io.h>
 
 #include "dummy_dev.h"
 #include "platform_test-utils.h"
+#include "platform_test-channel.h"
+#include "platform_test-net.h"
+#include "platform_test-ring.h"
+#include "platform_test-xform.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Victor Krasnoshchok <militant.daos@gmail.com>");
@@ -34,101 +42,365 @@ static const dma_addr_t reg_base	= 0x9f202000;
 
 static struct platform_device *pdev;
 
+/*
+ * The bound device for the runtime tuning callbacks below,
+ * plat_cfg_mtx serializes them with probe/remove.
+ */
+static struct plat_dummy_device *plat_dev;
+static DEFINE_MUTEX(plat_cfg_mtx);
+
+static unsigned int poll_time_ms = DEVICE_POLLING_TIME_MS;
+static unsigned int max_threads = MAX_DUMMY_PLAT_THREADS;
+static int busy_poll_cpu = -1;
+
+static int poll_time_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int ms;
+	int ret;
+
+	ret = kstrtouint(val, 0, &ms);
+	if (ret || !ms)
+		return -EINVAL;
+
+	mutex_lock(&plat_cfg_mtx);
+
+	poll_time_ms = ms;
+
+	if (plat_dev) {
+		struct plat_dummy_channel *ch;
+
+		WRITE_ONCE(plat_dev->js_poll_time, msecs_to_jiffies(ms));
+
+		/* Do not wait for the old period to expire */
+		for_each_plat_channel(plat_dev, ch)
+			plat_dummy_channel_kick(ch, plat_dev->js_poll_time);
+	}
+
+	mutex_unlock(&plat_cfg_mtx);
+	return 0;
+}
+
+static const struct kernel_param_ops poll_time_ops = {
+	.set = poll_time_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(poll_time_ms, &poll_time_ops, &poll_time_ms, 0644);
+MODULE_PARM_DESC(poll_time_ms, "Device polling period, ms");
+
+static int max_threads_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int count;
+	int ret;
+
+	ret = kstrtouint(val, 0, &count);
+	if (ret || !count || count > WQ_MAX_ACTIVE)
+		return -EINVAL;
+
+	mutex_lock(&plat_cfg_mtx);
+
+	max_threads = count;
+
+	/* The queue is resized in place, no need to re-create it */
+	if (plat_dev)
+		workqueue_set_max_active(plat_dev->data_process_wq, count);
+
+	mutex_unlock(&plat_cfg_mtx);
+	return 0;
+}
+
+static const struct kernel_param_ops max_threads_ops = {
+	.set = max_threads_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(max_threads, &max_threads_ops, &max_threads, 0644);
+MODULE_PARM_DESC(max_threads, "Max concurrently running data processing works");
+
+/* Called with plat_cfg_mtx held, cpu < 0 selects the channel works */
+static int plat_dummy_set_poll_mode(struct plat_dummy_device *my_dev, int cpu)
+{
+	struct plat_dummy_channel *ch;
+	int ret = 0;
+
+	plat_dummy_busypoll_stop(my_dev);
+
+	if (cpu >= 0)
+		ret = plat_dummy_busypoll_start(my_dev, cpu);
+
+	if (cpu < 0 || ret)
+		for_each_plat_channel(my_dev, ch)
+			plat_dummy_channel_start(ch);
+
+	return ret;
+}
+
+static int busy_poll_cpu_set(const char *val, const struct kernel_param *kp)
+{
+	int cpu;
+	int ret;
+
+	ret = kstrtoint(val, 0, &cpu);
+	if (ret)
+		return ret;
+
+	if (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu)))
+		return -EINVAL;
+
+	mutex_lock(&plat_cfg_mtx);
+
+	if (plat_dev)
+		ret = plat_dummy_set_poll_mode(plat_dev, cpu);
+
+	busy_poll_cpu = ret ? -1 : cpu;
+
+	mutex_unlock(&plat_cfg_mtx);
+	return ret;
+}
+
+static const struct kernel_param_ops busy_poll_cpu_ops = {
+	.set = busy_poll_cpu_set,
+	.get = param_get_int,
+};
+
+module_param_cb(busy_poll_cpu, &busy_poll_cpu_ops, &busy_poll_cpu, 0644);
+MODULE_PARM_DESC(busy_poll_cpu, "CPU of the busy-poll thread, -1 = poll from the workqueue");
+
+static bool rx_swap32;
+module_param(rx_swap32, bool, 0644);
+MODULE_PARM_DESC(rx_swap32, "Byte swap the 32-bit words of received messages");
+
 static const char dummy_usr_msg[] = ">> Dummy message << ";
 static const u32 dummy_usr_msg_full = sizeof(dummy_usr_msg) +
 					sizeof(u32);
 
-static void plat_dummy_rd_work(struct work_struct *work)
+/* ----------------------- RX queue -------------------------------- */
+
+/* A full queue drops its oldest message */
+static void plat_dummy_rx_enqueue(struct plat_dummy_device *my_device,
+				  struct plat_msg *msg)
 {
-	struct plat_dummy_device *my_device;
-	u32 i, size;
-	u8 data;
+	struct plat_msg *oldest = NULL;
 
-	pr_info("++%s(%u)\n", __func__, jiffies_to_msecs(jiffies));
+	spin_lock_bh(&my_device->rx_lock);
 
-	my_device = container_of(work, struct plat_dummy_device, plat_rd_work.work);
+	if (my_device->rx_queued >= PLAT_RX_QUEUE_MAX) {
+		oldest = list_first_entry(&my_device->rx_queue,
+					  struct plat_msg, node);
+		list_del(&oldest->node);
+		--my_device->rx_queued;
+		++my_device->rx_dropped;
+	}
 
-	if (plat_dummy_is_rd_buf_ready(my_device, &size)) {
+	list_add_tail(&msg->node, &my_device->rx_queue);
+	++my_device->rx_queued;
 
-		pr_info("%s: size to read = %d\n", __func__, size);
+	spin_unlock_bh(&my_device->rx_lock);
 
-		if (size > MEM_SIZE)
-			size = MEM_SIZE;
+	if (oldest)
+		plat_msg_free(&my_device->msgpool, oldest);
+}
 
-		for(i = 0; i < size; i++) {
-			data = plat_dummy_read_byte(my_device, i);
-			pr_info("%s: mem[%d] = 0x%x ('%c')\n", __func__,  
-				i, data, data);
-		}
+static void plat_dummy_rx_purge(struct plat_dummy_device *my_device)
+{
+	struct plat_msg *msg, *tmp;
+	LIST_HEAD(purged);
+
+	spin_lock_bh(&my_device->rx_lock);
+	list_splice_init(&my_device->rx_queue, &purged);
+	my_device->rx_queued = 0;
+	spin_unlock_bh(&my_device->rx_lock);
+
+	list_for_each_entry_safe(msg, tmp, &purged, node)
+		plat_msg_free(&my_device->msgpool, msg);
+}
+
+/* "cat rx" lists the queued messages, any write drops them */
+static int plat_dummy_rx_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_device *my_device = s->private;
+	struct plat_msg *msg;
+
+	spin_lock_bh(&my_device->rx_lock);
 
-		rmb();
+	seq_printf(s, "queued %u, dropped %llu\n", my_device->rx_queued,
+		   my_device->rx_dropped);
 
-		/* Reset data ready flag to signalize
-		 * the userspace app. that the device
-		 * has completed reading from the
-		 * input buffer.
-		 */
-		plat_dummy_clear_rd_buf_ready(my_device);
+	list_for_each_entry(msg, &my_device->rx_queue, node)
+		seq_printf(s, "[%llu] %u bytes, csum %04x: %*pE\n",
+			   msg->timestamp_ns, msg->len, msg->csum,
+			   (int) min_t(u32, msg->len, 32), msg->data);
+
+	spin_unlock_bh(&my_device->rx_lock);
+	return 0;
+}
+
+static int plat_dummy_rx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, plat_dummy_rx_show, inode->i_private);
+}
+
+static ssize_t plat_dummy_rx_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+
+	plat_dummy_rx_purge(s->private);
+	return count;
+}
+
+static const struct file_operations plat_dummy_rx_fops = {
+	.owner   = THIS_MODULE,
+	.open    = plat_dummy_rx_open,
+	.read    = seq_read,
+	.write   = plat_dummy_rx_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* ----------------------------------------------------------------- */
+
+static u32 plat_dummy_rd_poll(struct plat_dummy_channel *ch)
+{
+	struct plat_dummy_device *my_device = ch->dev;
+	struct plat_dummy_rx_frame frame;
+	struct plat_msg *msg = NULL;
+	u32 size, len = 0;
+
+	pr_debug("++%s(%u)\n", __func__, jiffies_to_msecs(jiffies));
+
+	/* The interface is up, NAPI takes the packets */
+	if (plat_dummy_net_rx_poll(my_device))
+		return 0;
+
+	if (plat_dummy_ring_poll(my_device, PLAT_CH_RD))
+		return 0;
+
+	if (!plat_dummy_is_rd_buf_ready(my_device, &size))
+		return 0;
+
+	pr_debug("%s: size to read = %d\n", __func__, size);
+
+	if (size > MEM_SIZE)
+		size = MEM_SIZE;
+
+	/*
+	 * A corrupted frame is dropped, the window is released anyway.
+	 * So is a message the filter is not interested in.
+	 */
+	if (!plat_dummy_rx_begin(my_device, size, &frame))
+		len = plat_dummy_filter_run(my_device, &frame);
+
+	if (len) {
+		/* Sleeps on the reserve rather than fails under pressure */
+		msg = plat_msg_alloc(&my_device->msgpool, len, GFP_KERNEL);
+	}
+
+	if (msg) {
+		if (plat_dummy_rx_copy(my_device, &frame, msg->data,
+				       len) < 0) {
+			plat_msg_free(&my_device->msgpool, msg);
+			msg = NULL;
+		} else {
+			msg->timestamp_ns = ktime_get_ns();
+			msg->csum = plat_dummy_csum(msg->data, len);
+			if (READ_ONCE(rx_swap32))
+				plat_dummy_bswap32(msg->data, msg->data, len);
+		}
 	}
 
-	queue_delayed_work(my_device->data_process_wq, &my_device->plat_rd_work,
-			my_device->js_poll_time);
+	rmb();
+
+	/* Reset data ready flag to signalize
+	 * the userspace app. that the device
+	 * has completed reading from the
+	 * input buffer.
+	 */
+	plat_dummy_clear_rd_buf_ready(my_device);
+
+	if (msg)
+		plat_dummy_rx_enqueue(my_device, msg);
+
+	return size;
 }
 
-static void plat_dummy_wr_work(struct work_struct *work)
+static const struct plat_dummy_channel_ops plat_dummy_rd_ops = {
+	.name = "rd",
+	.poll = plat_dummy_rd_poll,
+};
+
+static u32 plat_dummy_wr_poll(struct plat_dummy_channel *ch)
 {
-	struct plat_dummy_device *my_device;
+	struct plat_dummy_device *my_device = ch->dev;
 	u32 i, size;
 	u32 curr_jiffies;
 	u32 j = sizeof(u32) - 1; /* For jiffies value serialization */
 
-	pr_info("++%s(%u)\n", __func__, jiffies_to_msecs(jiffies));
+	pr_debug("++%s(%u)\n", __func__, jiffies_to_msecs(jiffies));
 
-	my_device = container_of(work, struct plat_dummy_device, 
-				plat_wr_work.work);
+	/* The interface is up, the window carries its packets */
+	if (plat_dummy_net_tx_poll(my_device))
+		return 0;
 
-	if (!plat_dummy_is_wr_buf_ready(my_device)) {
+	/* Queued messages go first, in class order */
+	size = plat_dummy_txq_poll(my_device);
+	if (size)
+		return size;
 
-		pr_info("Data transfer started.");
+	if (plat_dummy_ring_poll(my_device, PLAT_CH_WR))
+		return 0;
 
-		size = dummy_usr_msg_full;
-		if (size > MEM_SIZE)
-			size = MEM_SIZE;
+	if (!plat_dummy_wr_can_send(my_device))
+		return 0;
 
-		/* Write "dummy" part of the message ... */
-		for (i = 0; i < (size - sizeof(u32)); i++) {
-			plat_dummy_write_byte(my_device, i, dummy_usr_msg[i]);
-		}
+	pr_debug("Data transfer started.\n");
 
-		curr_jiffies = jiffies_to_msecs(jiffies);
+	size = dummy_usr_msg_full;
+	if (size > MEM_SIZE)
+		size = MEM_SIZE;
 
-		/* ... and append four bytes of jiffies to the end. */
-		for (; i < size; i++) {
-			plat_dummy_write_byte(my_device, i, 
-					((u8 *) &curr_jiffies)[j]);
-			j--;
-		}
+	/* Write "dummy" part of the message ... */
+	for (i = 0; i < (size - sizeof(u32)); i++) {
+		plat_dummy_write_byte(my_device, i, dummy_usr_msg[i]);
+	}
 
+	curr_jiffies = jiffies_to_msecs(jiffies);
 
-		wmb();
+	/* ... and append four bytes of jiffies to the end. */
+	for (; i < size; i++) {
+		plat_dummy_write_byte(my_device, i, 
+				((u8 *) &curr_jiffies)[j]);
+		j--;
+	}
 
-		/*
-		 * Signalize the userspace app that the
-		 * data is ready to be transferred.
-		 */
 
-		plat_dummy_set_wr_buf_ready(my_device, (size - 1));
-	}
+	wmb();
 
-	queue_delayed_work(my_device->data_process_wq, &my_device->plat_wr_work,
-			my_device->js_poll_time);
+	/*
+	 * Signalize the userspace app that the
+	 * data is ready to be transferred.
+	 */
+
+	plat_dummy_set_wr_buf_ready(my_device, (size - 1));
+	plat_dummy_trace(&my_device->trace, PLAT_TRACE_WR, size - 1,
+			 size - 1, 0);
+
+	return size - 1;
 }
 
+static const struct plat_dummy_channel_ops plat_dummy_wr_ops = {
+	.name = "wr",
+	.poll = plat_dummy_wr_poll,
+};
+
 static int plat_dummy_probe(struct platform_device *pdev)
 {
 	struct	device *dev = &pdev->dev;
 	struct	plat_dummy_device *my_device;
 	struct	resource *res;
+	void	__iomem *rd_buf, *wr_buf;
+	struct	plat_dummy_channel *ch;
+	int	err;
 
 	pr_info("++%s\n", __func__);
 
@@ -144,9 +416,9 @@ static int plat_dummy_probe(struct platform_device *pdev)
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	pr_info("res 0 (RD buffer) = %zx..%zx\n", res->start, res->end);
 
-	my_device->rd_buf = devm_ioremap_resource(&pdev->dev, res);
-	if (IS_ERR(my_device->rd_buf))
-		return PTR_ERR(my_device->rd_buf);
+	rd_buf = devm_ioremap_resource(&pdev->dev, res);
+	if (IS_ERR(rd_buf))
+		return PTR_ERR(rd_buf);
 	/* --------------------------------------------------------- */
 
 	/*
@@ -156,9 +428,9 @@ static int plat_dummy_probe(struct platform_device *pdev)
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 1);
 	pr_info("res 1 (WR buffer) = %zx..%zx\n", res->start, res->end);
 
-	my_device->wr_buf = devm_ioremap_resource(&pdev->dev, res);
-	if (IS_ERR(my_device->wr_buf))
-		return PTR_ERR(my_device->wr_buf);
+	wr_buf = devm_ioremap_resource(&pdev->dev, res);
+	if (IS_ERR(wr_buf))
+		return PTR_ERR(wr_buf);
 
 	/* --------------------------------------------------------- */
 
@@ -177,27 +449,78 @@ static int plat_dummy_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, my_device);
 
-	pr_info("RD buffer (usr->krn) mapped to %p\n", my_device->rd_buf);
-	pr_info("WR buffer (krn->usr) mapped to %p\n", my_device->wr_buf);
+	pr_info("RD buffer (usr->krn) mapped to %p\n", rd_buf);
+	pr_info("WR buffer (krn->usr) mapped to %p\n", wr_buf);
 	pr_info("Registers mapped to %p\n", my_device->regs);
 
-	/*Init data processing WQ*/
+	INIT_LIST_HEAD(&my_device->rx_queue);
+	spin_lock_init(&my_device->rx_lock);
+	spin_lock_init(&my_device->flags_lock);
+
+	/* No stale credit may let the WR channel send ahead of userspace */
+	plat_dummy_reset_wr_credits(my_device);
+
+	plat_dummy_channel_init(my_device, PLAT_CH_RD, &plat_dummy_rd_ops,
+				rd_buf);
+	plat_dummy_channel_init(my_device, PLAT_CH_WR, &plat_dummy_wr_ops,
+				wr_buf);
+
+	/*
+	 * Init data processing WQ before any debugfs file that can run
+	 * a poll (chan_bench, tx, busypoll) shows up.
+	 */
+	mutex_lock(&plat_cfg_mtx);
 	my_device->data_process_wq = alloc_workqueue("plat_dummy_workqueue",
-					WQ_UNBOUND, MAX_DUMMY_PLAT_THREADS);
+					WQ_UNBOUND, max_threads);
+	mutex_unlock(&plat_cfg_mtx);
 
 	if (!my_device->data_process_wq)
 		return -ENOMEM;
 
-	mutex_init(&my_device->status_mtx);
+	/* The driver's debugfs root, features add their files here */
+	my_device->dbg_dir = debugfs_create_dir(DRV_NAME, NULL);
+
+	err = plat_msgpool_init(&my_device->msgpool, my_device->dbg_dir);
+	if (err)
+		goto err_debugfs_remove;
+
+	err = plat_dummy_codec_init(my_device, my_device->dbg_dir);
+	if (err)
+		goto err_msgpool_destroy;
+
+	debugfs_create_file("rx", 0644, my_device->dbg_dir, my_device,
+			    &plat_dummy_rx_fops);
+	plat_dummy_channels_debugfs_init(my_device);
+	plat_dummy_filter_init(my_device, my_device->dbg_dir);
+	plat_dummy_txq_init(my_device, my_device->dbg_dir);
+	plat_dummy_trace_init(my_device, my_device->dbg_dir);
+	plat_dummy_busypoll_init(my_device, my_device->dbg_dir);
+
+	mutex_lock(&plat_cfg_mtx);
+	my_device->js_poll_time = msecs_to_jiffies(poll_time_ms);
+	for_each_plat_channel(my_device, ch)
+		plat_dummy_channel_start(ch);
+
+	/* Polled from the workqueue until the thread is up */
+	if (busy_poll_cpu >= 0 &&
+	    plat_dummy_set_poll_mode(my_device, busy_poll_cpu)) {
+		pr_warn("Busy polling on CPU %d failed\n", busy_poll_cpu);
+		busy_poll_cpu = -1;
+	}
+
+	plat_dev = my_device;
+	mutex_unlock(&plat_cfg_mtx);
 
-	INIT_DELAYED_WORK(&my_device->plat_rd_work, plat_dummy_rd_work);
-	INIT_DELAYED_WORK(&my_device->plat_wr_work, plat_dummy_wr_work);
+	/* The device stays usable without the network frontend */
+	err = plat_dummy_net_init(my_device, dev);
+	if (err)
+		pr_warn("Network interface registration failed (%d)\n", err);
 
-	my_device->js_poll_time = msecs_to_jiffies(DEVICE_POLLING_TIME_MS);
-	queue_delayed_work(my_device->data_process_wq, 
-			&my_device->plat_rd_work, 0);
-	queue_delayed_work(my_device->data_process_wq, 
-			&my_device->plat_wr_work, 0);
+	err = plat_dummy_ring_init(my_device);
+	if (err)
+		pr_warn("Ring device registration failed (%d)\n", err);
+	else
+		my_device->has_ring = true;
 
 	/*
 	 * It seems there is no need to check ERR_PTR_OR_ZERO
@@ -206,6 +529,17 @@ static int plat_dummy_probe(struct platform_device *pdev)
 	 */
 
 	return 0;
+
+err_msgpool_destroy:
+	debugfs_remove_recursive(my_device->dbg_dir);
+	plat_msgpool_destroy(&my_device->msgpool);
+	destroy_workqueue(my_device->data_process_wq);
+	return err;
+
+err_debugfs_remove:
+	debugfs_remove_recursive(my_device->dbg_dir);
+	destroy_workqueue(my_device->data_process_wq);
+	return err;
 }
 
 static int plat_dummy_remove(struct platform_device *pdev)
@@ -214,15 +548,37 @@ static int plat_dummy_remove(struct platform_device *pdev)
 
 	pr_info("++%s\n", __func__);
 
+	if (my_device->has_ring)
+		plat_dummy_ring_exit(my_device);
+	plat_dummy_net_exit(my_device);
+
+	mutex_lock(&plat_cfg_mtx);
+	plat_dev = NULL;
+	plat_dummy_busypoll_stop(my_device);
+	mutex_unlock(&plat_cfg_mtx);
+
+	/* A "tx" writer may sleep on a full class queue */
+	plat_dummy_txq_close(my_device);
+
+	plat_dummy_trace_exit(my_device);
+	debugfs_remove_recursive(my_device->dbg_dir);
+
 	if (my_device->data_process_wq) {
+		struct plat_dummy_channel *ch;
 
 		/* Destroy the workqueue */
 
-		cancel_delayed_work_sync(&my_device->plat_rd_work);
-		cancel_delayed_work_sync(&my_device->plat_wr_work);
+		for_each_plat_channel(my_device, ch)
+			plat_dummy_channel_stop(ch);
 		destroy_workqueue(my_device->data_process_wq);
 	}
 
+	plat_dummy_rx_purge(my_device);
+	plat_dummy_txq_exit(my_device);
+	plat_dummy_filter_exit(my_device);
+	plat_dummy_codec_exit(my_device);
+	plat_msgpool_destroy(&my_device->msgpool);
+
         return 0;
 }
 
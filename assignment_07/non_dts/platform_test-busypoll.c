@@ -0,0 +1,335 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "dummy_dev.h"
+#include "platform_test-utils.h"
+#include "platform_test-channel.h"
+#include "platform_test-busypoll.h"
+
+static unsigned int busy_spin_us = 10000;
+module_param(busy_spin_us, uint, 0644);
+MODULE_PARM_DESC(busy_spin_us, "Busy-poll: spin this long without traffic before sleeping, us");
+
+static unsigned int busy_sleep_us = 200;
+module_param(busy_sleep_us, uint, 0644);
+MODULE_PARM_DESC(busy_sleep_us, "Busy-poll: check period once sleeping, us");
+
+/* Stats lock held */
+static void plat_bp_account_lat(struct plat_dummy_busypoll *bp, u64 lat_ns)
+{
+	unsigned int b = 0;
+
+	if (lat_ns)
+		b = min_t(unsigned int, ilog2(lat_ns) + 1,
+			  PLAT_BP_LAT_BUCKETS - 1);
+
+	bp->lat_hist[b]++;
+	bp->lat_count++;
+	bp->lat_max_ns = max(bp->lat_max_ns, lat_ns);
+}
+
+/* Channels whose kick delay is over, by id */
+static unsigned long plat_bp_take_kicked(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+	struct plat_dummy_channel *ch;
+	unsigned long kicked = 0;
+	unsigned int id;
+
+	if (!READ_ONCE(bp->pending))
+		return 0;
+
+	for_each_plat_channel(my_dev, ch) {
+		id = ch - my_dev->channels;
+
+		if (test_bit(id, &bp->pending) &&
+		    time_after_eq(jiffies, READ_ONCE(ch->kick_due)) &&
+		    test_and_clear_bit(id, &bp->pending))
+			kicked |= BIT(id);
+	}
+
+	return kicked;
+}
+
+static void plat_bp_sleep(struct plat_dummy_busypoll *bp)
+{
+	WRITE_ONCE(bp->is_woken, false);
+
+	wait_event_interruptible_hrtimeout(bp->wait,
+			READ_ONCE(bp->is_woken) || kthread_should_stop(),
+			ns_to_ktime((u64) READ_ONCE(busy_sleep_us) *
+				    NSEC_PER_USEC));
+}
+
+static int plat_busypoll_thread(void *data)
+{
+	struct plat_dummy_device *my_dev = data;
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+	struct plat_dummy_channel *ch;
+	unsigned long next_period = jiffies;
+	unsigned long todo, kicked;
+	u64 spins = 0, now, last_check, idle_since;
+	u32 flags, last_flags;
+	bool is_rd_event, is_wr_event, is_period;
+	bool is_rd_armed = true;
+
+	last_flags = plat_dummy_read_flags(my_dev);
+	last_check = idle_since = ktime_get_ns();
+
+	while (!kthread_should_stop()) {
+		flags = plat_dummy_read_flags(my_dev);
+
+		/*
+		 * Userspace flagged a message or took the WR window. RD is
+		 * an edge too: a flag the poll left set (NAPI not done yet,
+		 * a ring with no RECV entry) is no new event until it has
+		 * been seen clear.
+		 */
+		if (!(flags & PLAT_RD_DATA_READY))
+			is_rd_armed = true;
+		is_rd_event = is_rd_armed && (flags & PLAT_RD_DATA_READY);
+		is_wr_event = (last_flags & PLAT_WR_DATA_READY) &&
+			      !(flags & PLAT_WR_DATA_READY);
+
+		is_period = time_after_eq(jiffies, next_period);
+		kicked = plat_bp_take_kicked(my_dev);
+
+		if (!is_rd_event && !is_wr_event && !is_period && !kicked) {
+			now = ktime_get_ns();
+			last_check = now;
+			last_flags = flags;
+
+			if (now - idle_since <
+			    (u64) READ_ONCE(busy_spin_us) * NSEC_PER_USEC) {
+				spins++;
+				cpu_relax();
+				cond_resched();
+				continue;
+			}
+
+			/* Idle for long, check once per sleep from now on */
+			spin_lock(&bp->lock);
+			bp->spins += spins;
+			bp->sleeps++;
+			spin_unlock(&bp->lock);
+			spins = 0;
+
+			plat_bp_sleep(bp);
+			continue;
+		}
+
+		todo = kicked;
+		if (is_period) {
+			todo = BIT(PLAT_CH_COUNT) - 1;
+			next_period = jiffies +
+				max(READ_ONCE(my_dev->js_poll_time), 1UL);
+		}
+		if (is_rd_event)
+			todo |= BIT(PLAT_CH_RD);
+		if (is_wr_event)
+			todo |= BIT(PLAT_CH_WR);
+
+		for_each_plat_channel(my_dev, ch)
+			if (todo & BIT(ch - my_dev->channels))
+				plat_dummy_channel_poll(ch);
+
+		now = ktime_get_ns();
+
+		spin_lock(&bp->lock);
+		bp->spins += spins;
+		bp->rd_events += is_rd_event;
+		bp->wr_events += is_wr_event;
+		bp->kick_polls += !!kicked;
+		bp->period_polls += is_period;
+		if (is_rd_event || is_wr_event)
+			plat_bp_account_lat(bp, now - last_check);
+		spin_unlock(&bp->lock);
+		spins = 0;
+
+		/* The periodic poll alone does not restart the spin budget */
+		if (is_rd_event || is_wr_event || kicked)
+			idle_since = now;
+
+		/* The polls changed the flags, that is no event */
+		last_flags = plat_dummy_read_flags(my_dev);
+		is_rd_armed = !(last_flags & PLAT_RD_DATA_READY);
+		last_check = ktime_get_ns();
+	}
+
+	return 0;
+}
+
+int plat_dummy_busypoll_start(struct plat_dummy_device *my_dev, int cpu)
+{
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+	struct plat_dummy_channel *ch;
+	struct task_struct *task;
+
+	task = kthread_create_on_node(plat_busypoll_thread, my_dev,
+				      cpu_to_node(cpu), DRV_NAME "_bp/%d", cpu);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	kthread_bind(task, cpu);
+	bp->task = task;
+	bp->cpu = cpu;
+
+	/* A work running right now sees it and does not re-arm */
+	WRITE_ONCE(bp->is_active, true);
+	for_each_plat_channel(my_dev, ch)
+		plat_dummy_channel_stop(ch);
+
+	wake_up_process(task);
+
+	pr_info("Busy polling on CPU %d\n", cpu);
+	return 0;
+}
+
+void plat_dummy_busypoll_stop(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+
+	if (!bp->task)
+		return;
+
+	WRITE_ONCE(bp->is_active, false);
+	kthread_stop(bp->task);
+	bp->task = NULL;
+
+	/* The channel works start with a poll anyway */
+	WRITE_ONCE(bp->pending, 0);
+
+	pr_info("Busy polling stopped\n");
+}
+
+void plat_dummy_busypoll_kick(struct plat_dummy_channel *ch,
+			      unsigned long delay)
+{
+	struct plat_dummy_busypoll *bp = &ch->dev->busypoll;
+
+	WRITE_ONCE(ch->kick_due, jiffies + delay);
+	smp_mb__before_atomic();
+	set_bit(ch - ch->dev->channels, &bp->pending);
+
+	/* A delayed kick is found by the next check, sleeping or not */
+	if (!delay) {
+		WRITE_ONCE(bp->is_woken, true);
+		wake_up(&bp->wait);
+	}
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+/* Upper bound of the latency bucket the given share falls into */
+static u64 plat_bp_percentile(const struct plat_dummy_busypoll *bp,
+			      unsigned int permille)
+{
+	u64 want = div_u64(bp->lat_count * permille + 999, 1000);
+	u64 sum = 0;
+	unsigned int b;
+
+	for (b = 0; b < PLAT_BP_LAT_BUCKETS; b++) {
+		sum += bp->lat_hist[b];
+		if (sum >= want)
+			return b ? min(1ULL << b, bp->lat_max_ns) : 0;
+	}
+
+	return bp->lat_max_ns;
+}
+
+static int plat_busypoll_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_device *my_dev = s->private;
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+
+	if (READ_ONCE(bp->is_active))
+		seq_printf(s, "mode: kthread on CPU %d\n", bp->cpu);
+	else
+		seq_puts(s, "mode: workqueue\n");
+
+	seq_printf(s, "spin %u us, then check every %u us\n",
+		   READ_ONCE(busy_spin_us), READ_ONCE(busy_sleep_us));
+
+	spin_lock(&bp->lock);
+
+	seq_printf(s, "spins %llu, sleeps %llu\n", bp->spins, bp->sleeps);
+	seq_printf(s, "polls: rd events %llu, wr events %llu, kicked %llu, periodic %llu\n",
+		   bp->rd_events, bp->wr_events, bp->kick_polls,
+		   bp->period_polls);
+	seq_printf(s, "response latency, %llu samples (ns, log2 buckets):\n",
+		   bp->lat_count);
+	if (bp->lat_count)
+		seq_printf(s, "  p50 <= %llu, p90 <= %llu, p99 <= %llu, p99.9 <= %llu, max %llu\n",
+			   plat_bp_percentile(bp, 500),
+			   plat_bp_percentile(bp, 900),
+			   plat_bp_percentile(bp, 990),
+			   plat_bp_percentile(bp, 999), bp->lat_max_ns);
+
+	spin_unlock(&bp->lock);
+	return 0;
+}
+
+static int plat_busypoll_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, plat_busypoll_show, inode->i_private);
+}
+
+/* "reset" clears the stats */
+static ssize_t plat_busypoll_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct plat_dummy_device *my_dev = s->private;
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+	char cmd[16] = { 0 };
+
+	if (copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+		return -EFAULT;
+
+	if (!sysfs_streq(cmd, "reset"))
+		return -EINVAL;
+
+	spin_lock(&bp->lock);
+	bp->spins = 0;
+	bp->sleeps = 0;
+	bp->rd_events = 0;
+	bp->wr_events = 0;
+	bp->kick_polls = 0;
+	bp->period_polls = 0;
+	bp->lat_count = 0;
+	bp->lat_max_ns = 0;
+	memset(bp->lat_hist, 0, sizeof(bp->lat_hist));
+	spin_unlock(&bp->lock);
+
+	return count;
+}
+
+static const struct file_operations plat_busypoll_fops = {
+	.owner   = THIS_MODULE,
+	.open    = plat_busypoll_open,
+	.read    = seq_read,
+	.write   = plat_busypoll_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* ----------------------------------------------------------------- */
+
+void plat_dummy_busypoll_init(struct plat_dummy_device *my_dev,
+			      struct dentry *dbg_dir)
+{
+	struct plat_dummy_busypoll *bp = &my_dev->busypoll;
+
+	spin_lock_init(&bp->lock);
+	init_waitqueue_head(&bp->wait);
+
+	debugfs_create_file("busypoll", 0644, dbg_dir, my_dev,
+			    &plat_busypoll_fops);
+}
@@ -0,0 +1,63 @@
+#ifndef __DUMMY_DEV_BUSYPOLL_H
+#define __DUMMY_DEV_BUSYPOLL_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
+
+/*
+ * Busy-poll mode: instead of the channel works, one kthread bound to
+ * the "busy_poll_cpu" CPU (best an isolcpus one) spins on the flags
+ * register. It polls the RD channel as soon as userspace flags a
+ * message and the WR channel as soon as userspace takes a window,
+ * both channels every js_poll_time like the works do, and a kicked
+ * channel once its delay has passed.
+ *
+ * After "busy_spin_us" without traffic the thread falls back to
+ * checking once every "busy_sleep_us", so an idle link does not
+ * burn the CPU. Response latency is measured from the last check
+ * that found nothing to the end of the poll.
+ */
+#define PLAT_BP_LAT_BUCKETS	(32) /* log2 of the latency in ns */
+
+struct plat_dummy_busypoll {
+	struct task_struct	*task;		/* NULL in workqueue mode */
+	bool			is_active;	/* Kicks go to the thread */
+	int			cpu;
+	wait_queue_head_t	wait;
+	bool			is_woken;	/* Kicked with no delay */
+	unsigned long		pending;	/* Kicked channels, by id */
+
+	/* Stats, updated by the thread at events and before sleeping */
+	spinlock_t		lock;
+	u64			spins;
+	u64			sleeps;
+	u64			rd_events;
+	u64			wr_events;
+	u64			kick_polls;
+	u64			period_polls;
+	u64			lat_count;
+	u64			lat_max_ns;
+	u64			lat_hist[PLAT_BP_LAT_BUCKETS];
+};
+
+struct plat_dummy_device;
+struct plat_dummy_channel;
+
+void plat_dummy_busypoll_init(struct plat_dummy_device *my_dev,
+			      struct dentry *dbg_dir);
+
+/*
+ * Called with plat_cfg_mtx held. start() takes the polls over from
+ * the channel works, stop() ends the thread; the caller restarts the
+ * works if the device goes on.
+ */
+int plat_dummy_busypoll_start(struct plat_dummy_device *my_dev, int cpu);
+void plat_dummy_busypoll_stop(struct plat_dummy_device *my_dev);
+
+/* plat_dummy_channel_kick() in busy-poll mode */
+void plat_dummy_busypoll_kick(struct plat_dummy_channel *ch,
+			      unsigned long delay);
+
+#endif
@@ -0,0 +1,263 @@
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>
+
+#include "dummy_dev.h"
+#include "platform_test-channel.h"
+
+#define PLAT_BENCH_MAX_LOOPS	(10000000)
+
+void plat_dummy_channel_poll(struct plat_dummy_channel *ch)
+{
+	u64 start = ktime_get_ns();
+	u32 bytes;
+
+	mutex_lock(&ch->lock);
+
+	bytes = ch->ops->poll(ch);
+
+	++ch->polls;
+	if (bytes) {
+		++ch->transfers;
+		ch->bytes += bytes;
+	}
+	ch->busy_ns += ktime_get_ns() - start;
+	ch->last_cpu = raw_smp_processor_id();
+
+	mutex_unlock(&ch->lock);
+}
+
+static void plat_dummy_channel_work(struct work_struct *work)
+{
+	struct plat_dummy_channel *ch;
+
+	ch = container_of(work, struct plat_dummy_channel, work.work);
+
+	plat_dummy_channel_poll(ch);
+
+	/* The busy-poll thread has taken over */
+	if (READ_ONCE(ch->dev->busypoll.is_active))
+		return;
+
+	queue_delayed_work(ch->dev->data_process_wq, &ch->work,
+			READ_ONCE(ch->dev->js_poll_time));
+}
+
+/* Polls the channel back to back, see plat_dummy_bench_run() */
+static void plat_dummy_channel_bench_work(struct work_struct *work)
+{
+	struct plat_dummy_channel *ch;
+	unsigned int i;
+	u64 start;
+
+	ch = container_of(work, struct plat_dummy_channel, bench_work);
+
+	start = ktime_get_ns();
+	for (i = 0; i < ch->bench_loops; i++)
+		plat_dummy_channel_poll(ch);
+	ch->bench_ns = ktime_get_ns() - start;
+}
+
+void plat_dummy_channel_init(struct plat_dummy_device *my_dev,
+			     enum plat_dummy_channel_id id,
+			     const struct plat_dummy_channel_ops *ops,
+			     void __iomem *buf)
+{
+	struct plat_dummy_channel *ch = &my_dev->channels[id];
+
+	ch->dev = my_dev;
+	ch->ops = ops;
+	ch->buf = buf;
+	ch->last_cpu = -1;
+	mutex_init(&ch->lock);
+	INIT_DELAYED_WORK(&ch->work, plat_dummy_channel_work);
+	INIT_WORK(&ch->bench_work, plat_dummy_channel_bench_work);
+}
+
+void plat_dummy_channel_start(struct plat_dummy_channel *ch)
+{
+	queue_delayed_work(ch->dev->data_process_wq, &ch->work, 0);
+}
+
+void plat_dummy_channel_stop(struct plat_dummy_channel *ch)
+{
+	cancel_delayed_work_sync(&ch->work);
+	cancel_work_sync(&ch->bench_work);
+}
+
+void plat_dummy_channel_kick(struct plat_dummy_channel *ch,
+			     unsigned long delay)
+{
+	if (READ_ONCE(ch->dev->busypoll.is_active))
+		plat_dummy_busypoll_kick(ch, delay);
+	else
+		mod_delayed_work(ch->dev->data_process_wq, &ch->work, delay);
+}
+
+void plat_dummy_channels_sync(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_channel *ch;
+
+	for_each_plat_channel(my_dev, ch) {
+		mutex_lock(&ch->lock);
+		mutex_unlock(&ch->lock);
+	}
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+static int plat_dummy_channels_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_device *my_dev = s->private;
+	struct plat_dummy_channel *ch;
+
+	seq_printf(s, "%-4s %10s %10s %12s %12s %4s\n", "name", "polls",
+		   "transfers", "bytes", "busy_us", "cpu");
+
+	for_each_plat_channel(my_dev, ch) {
+		mutex_lock(&ch->lock);
+		seq_printf(s, "%-4s %10llu %10llu %12llu %12llu %4d\n",
+			   ch->ops->name, ch->polls, ch->transfers, ch->bytes,
+			   div_u64(ch->busy_ns, NSEC_PER_USEC), ch->last_cpu);
+		mutex_unlock(&ch->lock);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(plat_dummy_channels);
+
+/*
+ * Channel scaling benchmark: every channel is polled "loops" times
+ * back to back, first one channel after another, then all channels
+ * at once on the data processing WQ. With independent channels the
+ * concurrent run takes as long as the slowest channel alone when
+ * there are enough CPUs and max_threads allows it.
+ *
+ * The loops run the real polls, so run it with no traffic: a message
+ * userspace flagged meanwhile is consumed by the RD loop, and the
+ * first WR poll sends a message and takes the window. The remaining
+ * WR polls mostly time the early exit of plat_dummy_wr_can_send(),
+ * i.e. the figures are the per-poll overhead, not a transfer rate.
+ */
+static DEFINE_MUTEX(plat_bench_mtx);
+
+static struct {
+	unsigned int	loops;
+	u64		serial_ns[PLAT_CH_COUNT];
+	u64		serial_wall_ns;
+	u64		concurrent_ns[PLAT_CH_COUNT];
+	u64		concurrent_wall_ns;
+} plat_bench;
+
+static void plat_dummy_bench_run(struct plat_dummy_device *my_dev,
+				 unsigned int loops)
+{
+	struct plat_dummy_channel *ch;
+	u64 start;
+
+	for_each_plat_channel(my_dev, ch)
+		ch->bench_loops = loops;
+
+	start = ktime_get_ns();
+	for_each_plat_channel(my_dev, ch) {
+		queue_work(my_dev->data_process_wq, &ch->bench_work);
+		flush_work(&ch->bench_work);
+		plat_bench.serial_ns[ch - my_dev->channels] = ch->bench_ns;
+	}
+	plat_bench.serial_wall_ns = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	for_each_plat_channel(my_dev, ch)
+		queue_work(my_dev->data_process_wq, &ch->bench_work);
+	for_each_plat_channel(my_dev, ch) {
+		flush_work(&ch->bench_work);
+		plat_bench.concurrent_ns[ch - my_dev->channels] = ch->bench_ns;
+	}
+	plat_bench.concurrent_wall_ns = ktime_get_ns() - start;
+
+	plat_bench.loops = loops;
+}
+
+static int plat_dummy_bench_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_device *my_dev = s->private;
+	struct plat_dummy_channel *ch;
+	unsigned int i;
+
+	mutex_lock(&plat_bench_mtx);
+
+	if (!plat_bench.loops) {
+		seq_puts(s, "write the number of polls per channel to run\n");
+		goto out;
+	}
+
+	seq_printf(s, "%u polls per channel, %u online CPUs\n",
+		   plat_bench.loops, num_online_cpus());
+	seq_printf(s, "%-4s %14s %14s\n", "name", "serial_ns/poll",
+		   "concur_ns/poll");
+
+	for_each_plat_channel(my_dev, ch) {
+		i = ch - my_dev->channels;
+		seq_printf(s, "%-4s %14llu %14llu\n", ch->ops->name,
+			   div_u64(plat_bench.serial_ns[i], plat_bench.loops),
+			   div_u64(plat_bench.concurrent_ns[i],
+				   plat_bench.loops));
+	}
+
+	seq_printf(s, "wall: serial %llu us, concurrent %llu us, speedup x%llu.%02llu\n",
+		   div_u64(plat_bench.serial_wall_ns, NSEC_PER_USEC),
+		   div_u64(plat_bench.concurrent_wall_ns, NSEC_PER_USEC),
+		   div64_u64(plat_bench.serial_wall_ns,
+			     plat_bench.concurrent_wall_ns ?: 1),
+		   div64_u64(plat_bench.serial_wall_ns * 100,
+			     plat_bench.concurrent_wall_ns ?: 1) % 100);
+out:
+	mutex_unlock(&plat_bench_mtx);
+	return 0;
+}
+
+static int plat_dummy_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, plat_dummy_bench_show, inode->i_private);
+}
+
+static ssize_t plat_dummy_bench_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	unsigned int loops;
+	int ret;
+
+	ret = kstrtouint_from_user(buf, count, 0, &loops);
+	if (ret)
+		return ret;
+
+	if (!loops || loops > PLAT_BENCH_MAX_LOOPS)
+		return -EINVAL;
+
+	mutex_lock(&plat_bench_mtx);
+	plat_dummy_bench_run(s->private, loops);
+	mutex_unlock(&plat_bench_mtx);
+
+	return count;
+}
+
+static const struct file_operations plat_dummy_bench_fops = {
+	.owner   = THIS_MODULE,
+	.open    = plat_dummy_bench_open,
+	.read    = seq_read,
+	.write   = plat_dummy_bench_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+void plat_dummy_channels_debugfs_init(struct plat_dummy_device *my_dev)
+{
+	debugfs_create_file("channels", 0444, my_dev->dbg_dir, my_dev,
+			    &plat_dummy_channels_fops);
+	debugfs_create_file("chan_bench", 0644, my_dev->dbg_dir, my_dev,
+			    &plat_dummy_bench_fops);
+}
@@ -0,0 +1,39 @@
+#ifndef __DUMMY_DEV_CHANNEL_H
+#define __DUMMY_DEV_CHANNEL_H
+
+/*
+ * Generic channel routines: a channel is polled by its own delayed
+ * work on the device's data processing WQ every js_poll_time, or by
+ * the busy-poll thread (see platform_test-busypoll.h).
+ * A new direction/queue needs an id in plat_dummy_channel_id and
+ * a plat_dummy_channel_ops.
+ */
+#define for_each_plat_channel(my_dev, ch) \
+	for ((ch) = (my_dev)->channels; \
+	     (ch) < (my_dev)->channels + PLAT_CH_COUNT; (ch)++)
+
+void plat_dummy_channel_init(struct plat_dummy_device *my_dev,
+			     enum plat_dummy_channel_id id,
+			     const struct plat_dummy_channel_ops *ops,
+			     void __iomem *buf);
+
+void plat_dummy_channel_start(struct plat_dummy_channel *ch);
+void plat_dummy_channel_stop(struct plat_dummy_channel *ch);
+
+/* One poll, serialized with the other polls of the channel */
+void plat_dummy_channel_poll(struct plat_dummy_channel *ch);
+
+/* Re-arms the poll of the channel with the given delay */
+void plat_dummy_channel_kick(struct plat_dummy_channel *ch,
+			     unsigned long delay);
+
+/*
+ * Waits for the polls running right now: a frontend unpublished
+ * before the call is not seen by any poll after it.
+ */
+void plat_dummy_channels_sync(struct plat_dummy_device *my_dev);
+
+/* "channels" and "chan_bench" debugfs files */
+void plat_dummy_channels_debugfs_init(struct plat_dummy_device *my_dev);
+
+#endif
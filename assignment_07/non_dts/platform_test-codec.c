@@ -0,0 +1,188 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/lz4.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
+#include <asm/unaligned.h>
+
+#include "dummy_dev.h"
+#include "platform_test-utils.h"
+#include "platform_test-codec.h"
+
+static bool lz4_tx;
+module_param(lz4_tx, bool, 0644);
+MODULE_PARM_DESC(lz4_tx, "Send LZ4 frames to userspace if it can decode them");
+
+/* ---------------------------- RX --------------------------------- */
+
+int plat_dummy_rx_begin(struct plat_dummy_device *my_dev, u32 size,
+			struct plat_dummy_rx_frame *f)
+{
+	struct plat_dummy_codec *codec = &my_dev->codec;
+
+	if (size > MEM_SIZE)
+		size = MEM_SIZE;
+
+	f->wire_len = size;
+	f->is_lz4 = plat_dummy_read_flags(my_dev) & PLAT_RD_LZ4_FRAME;
+
+	if (!f->is_lz4) {
+		f->len = size;
+		codec->rx_raw++;
+		plat_dummy_trace(&my_dev->trace, PLAT_TRACE_RD, size, size, 0);
+		return 0;
+	}
+
+	/* The block is decoded from RAM, not from the window */
+	if (size <= PLAT_LZ4_HDR_SIZE)
+		goto err_bad_frame;
+
+	plat_dummy_read_buf(my_dev, codec->rx_frame, size);
+
+	f->len = get_unaligned_le32(codec->rx_frame);
+	if (!f->len || f->len > PLAT_MAX_PAYLOAD)
+		goto err_bad_frame;
+
+	codec->rx_lz4++;
+	codec->rx_lz4_in += size;
+	codec->rx_lz4_out += f->len;
+	plat_dummy_trace(&my_dev->trace, PLAT_TRACE_RD, size, f->len,
+			 PLAT_TRACE_LZ4);
+	return 0;
+
+err_bad_frame:
+	codec->rx_errors++;
+	plat_dummy_trace(&my_dev->trace, PLAT_TRACE_RD, size, 0,
+			 PLAT_TRACE_LZ4 | PLAT_TRACE_BAD);
+	return -EBADMSG;
+}
+
+int plat_dummy_rx_copy(struct plat_dummy_device *my_dev,
+		       const struct plat_dummy_rx_frame *f, void *dst, u32 cap)
+{
+	struct plat_dummy_codec *codec = &my_dev->codec;
+	u32 len = min(f->len, cap);
+	int ret;
+
+	if (!f->is_lz4) {
+		plat_dummy_read_buf(my_dev, dst, len);
+		return len;
+	}
+
+	ret = LZ4_decompress_safe_partial(codec->rx_frame + PLAT_LZ4_HDR_SIZE,
+					  dst, f->wire_len - PLAT_LZ4_HDR_SIZE,
+					  len, cap);
+	if (ret < (int) len) {
+		codec->rx_errors++;
+		return -EBADMSG;
+	}
+
+	return len;
+}
+
+/* ---------------------------- TX --------------------------------- */
+
+int plat_dummy_tx_payload(struct plat_dummy_device *my_dev, const void *src,
+			  u32 len)
+{
+	struct plat_dummy_codec *codec = &my_dev->codec;
+	int clen = 0;
+
+	if (READ_ONCE(lz4_tx) && len >= PLAT_LZ4_MIN_LEN &&
+	    len <= PLAT_MAX_PAYLOAD &&
+	    (plat_dummy_read_flags(my_dev) & PLAT_USR_LZ4_CAPABLE))
+		clen = LZ4_compress_default(src,
+				codec->tx_frame + PLAT_LZ4_HDR_SIZE, len,
+				MEM_SIZE - PLAT_LZ4_HDR_SIZE, codec->wrkmem);
+
+	/* Only frames that are shorter than the payload pay off */
+	if (clen > 0 && clen + PLAT_LZ4_HDR_SIZE < len) {
+		clen += PLAT_LZ4_HDR_SIZE;
+		put_unaligned_le32(len, codec->tx_frame);
+
+		plat_dummy_write_buf(my_dev, codec->tx_frame, clen);
+		wmb();
+		plat_dummy_set_wr_buf_ready_flags(my_dev, clen,
+						  PLAT_WR_LZ4_FRAME);
+
+		codec->tx_lz4++;
+		codec->tx_lz4_in += len;
+		codec->tx_lz4_out += clen;
+		plat_dummy_trace(&my_dev->trace, PLAT_TRACE_WR, clen, len,
+				 PLAT_TRACE_LZ4);
+		return 0;
+	}
+
+	if (len > MEM_SIZE)
+		return -EMSGSIZE;
+
+	plat_dummy_write_buf(my_dev, src, len);
+	wmb();
+	plat_dummy_set_wr_buf_ready(my_dev, len);
+
+	codec->tx_raw++;
+	plat_dummy_trace(&my_dev->trace, PLAT_TRACE_WR, len, len, 0);
+	return 0;
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+/* Payload bytes per frame byte, in percent */
+static u64 plat_codec_ratio(u64 payload, u64 frame)
+{
+	return frame ? div64_u64(payload * 100, frame) : 0;
+}
+
+static int plat_codec_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_codec *codec = s->private;
+
+	seq_printf(s, "lz4_tx %s\n", READ_ONCE(lz4_tx) ? "on" : "off");
+	seq_printf(s, "tx: raw %llu, lz4 %llu (%llu -> %llu bytes, x%llu.%02llu)\n",
+		   codec->tx_raw, codec->tx_lz4, codec->tx_lz4_in,
+		   codec->tx_lz4_out,
+		   plat_codec_ratio(codec->tx_lz4_in, codec->tx_lz4_out) / 100,
+		   plat_codec_ratio(codec->tx_lz4_in, codec->tx_lz4_out) % 100);
+	seq_printf(s, "rx: raw %llu, lz4 %llu (%llu -> %llu bytes, x%llu.%02llu), errors %llu\n",
+		   codec->rx_raw, codec->rx_lz4, codec->rx_lz4_in,
+		   codec->rx_lz4_out,
+		   plat_codec_ratio(codec->rx_lz4_out, codec->rx_lz4_in) / 100,
+		   plat_codec_ratio(codec->rx_lz4_out, codec->rx_lz4_in) % 100,
+		   codec->rx_errors);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(plat_codec);
+
+/* ----------------------------------------------------------------- */
+
+int plat_dummy_codec_init(struct plat_dummy_device *my_dev,
+			  struct dentry *dbg_dir)
+{
+	struct plat_dummy_codec *codec = &my_dev->codec;
+
+	codec->wrkmem = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	codec->tx_frame = kmalloc(MEM_SIZE, GFP_KERNEL);
+	codec->rx_frame = kmalloc(MEM_SIZE, GFP_KERNEL);
+
+	if (!codec->wrkmem || !codec->tx_frame || !codec->rx_frame) {
+		plat_dummy_codec_exit(my_dev);
+		return -ENOMEM;
+	}
+
+	debugfs_create_file("codec", 0444, dbg_dir, codec, &plat_codec_fops);
+	return 0;
+}
+
+void plat_dummy_codec_exit(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_codec *codec = &my_dev->codec;
+
+	kfree(codec->wrkmem);
+	kfree(codec->tx_frame);
+	kfree(codec->rx_frame);
+
+	codec->wrkmem = NULL;
+	codec->tx_frame = NULL;
+	codec->rx_frame = NULL;
+}
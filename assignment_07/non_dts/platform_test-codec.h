@@ -0,0 +1,69 @@
+#ifndef __DUMMY_DEV_CODEC_H
+#define __DUMMY_DEV_CODEC_H
+
+#include <linux/types.h>
+#include <linux/debugfs.h>
+
+/*
+ * Compressed frames: a window may carry an LZ4 block of up to
+ * PLAT_MAX_PAYLOAD bytes instead of raw data. The frame is the
+ * uncompressed length (u32, little endian) followed by the block,
+ * the size register holds the frame length.
+ *
+ * RD frames are flagged by userspace with PLAT_RD_LZ4_FRAME and are
+ * always accepted. WR frames are sent only if "lz4_tx" is set and
+ * userspace has advertised PLAT_USR_LZ4_CAPABLE; a payload that does
+ * not shrink goes out raw.
+ */
+#define PLAT_LZ4_HDR_SIZE	(sizeof(u32))
+#define PLAT_LZ4_MIN_LEN	(64) /* Smaller payloads always go out raw */
+
+struct plat_dummy_codec {
+	void			*wrkmem;	/* LZ4 compression state */
+	u8			*tx_frame;	/* One WR window */
+	u8			*rx_frame;	/* One RD window */
+
+	/* Stats */
+	u64			tx_raw;
+	u64			tx_lz4;
+	u64			tx_lz4_in;	/* Payload bytes */
+	u64			tx_lz4_out;	/* Frame bytes */
+	u64			rx_raw;
+	u64			rx_lz4;
+	u64			rx_lz4_in;	/* Frame bytes */
+	u64			rx_lz4_out;	/* Payload bytes */
+	u64			rx_errors;
+};
+
+/* A received window, filled by plat_dummy_rx_begin() */
+struct plat_dummy_rx_frame {
+	u32			wire_len;
+	u32			len;		/* Payload length */
+	bool			is_lz4;
+};
+
+struct plat_dummy_device;
+
+int plat_dummy_codec_init(struct plat_dummy_device *my_dev,
+			  struct dentry *dbg_dir);
+void plat_dummy_codec_exit(struct plat_dummy_device *my_dev);
+
+/*
+ * RD path: begin() looks at the window the size register says is
+ * ready, copy() stores up to cap bytes of the payload to dst and
+ * returns the bytes stored. The caller clears the ready flag after.
+ * Both return -EBADMSG on a corrupted frame.
+ */
+int plat_dummy_rx_begin(struct plat_dummy_device *my_dev, u32 size,
+			struct plat_dummy_rx_frame *f);
+int plat_dummy_rx_copy(struct plat_dummy_device *my_dev,
+		       const struct plat_dummy_rx_frame *f, void *dst, u32 cap);
+
+/*
+ * WR path: fills the free WR window with the payload, compressed if
+ * negotiated, and sets it ready. -EMSGSIZE if it does not fit.
+ */
+int plat_dummy_tx_payload(struct plat_dummy_device *my_dev, const void *src,
+			  u32 len);
+
+#endif
@@ -0,0 +1,219 @@
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "dummy_dev.h"
+#include "platform_test-codec.h"
+#include "platform_test-filter.h"
+
+#define PLAT_FILTER_MAX_TEXT	(BPF_MAXINSNS * 32)
+
+u32 plat_dummy_filter_run(struct plat_dummy_device *my_dev,
+			  const struct plat_dummy_rx_frame *f)
+{
+	struct plat_dummy_filter *flt = &my_dev->filter;
+	struct sk_buff *skb = flt->skb;
+	u32 snap = min_t(u32, f->len, PLAT_FILTER_SNAPLEN);
+	u32 ret;
+
+	if (!flt->prog)
+		return f->len;
+
+	__skb_trim(skb, 0);
+	if (plat_dummy_rx_copy(my_dev, f, skb_put(skb, snap), snap) < 0)
+		return 0;
+
+	preempt_disable();
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+	ret = bpf_prog_run(flt->prog, skb);
+#else
+	ret = BPF_PROG_RUN(flt->prog, skb);
+#endif
+	preempt_enable();
+
+	if (!ret) {
+		flt->dropped++;
+		return 0;
+	}
+
+	if (ret < f->len) {
+		flt->truncated++;
+		return ret;
+	}
+
+	flt->passed++;
+	return f->len;
+}
+
+/* ---------------------------- loading ---------------------------- */
+
+/* "tcpdump -ddd" output: instruction count, then "code jt jf k" lines */
+static int plat_filter_parse(char *text, struct sock_filter **insns)
+{
+	struct sock_filter *prog;
+	unsigned int count, i = 0;
+	unsigned int code, jt, jf, k;
+	char *line;
+
+	line = strsep(&text, "\n");
+	if (!line || kstrtouint(strim(line), 10, &count) ||
+	    !count || count > BPF_MAXINSNS)
+		return -EINVAL;
+
+	prog = kcalloc(count, sizeof(*prog), GFP_KERNEL);
+	if (!prog)
+		return -ENOMEM;
+
+	while (i < count && (line = strsep(&text, "\n"))) {
+		if (sscanf(line, "%u %u %u %u", &code, &jt, &jf, &k) != 4 ||
+		    code > U16_MAX || jt > U8_MAX || jf > U8_MAX) {
+			kfree(prog);
+			return -EINVAL;
+		}
+
+		prog[i].code = code;
+		prog[i].jt = jt;
+		prog[i].jf = jf;
+		prog[i].k = k;
+		i++;
+	}
+
+	if (i != count) {
+		kfree(prog);
+		return -EINVAL;
+	}
+
+	*insns = prog;
+	return count;
+}
+
+static int plat_filter_attach(struct plat_dummy_device *my_dev, char *text)
+{
+	struct plat_dummy_channel *rd = &my_dev->channels[PLAT_CH_RD];
+	struct plat_dummy_filter *flt = &my_dev->filter;
+	struct sock_fprog_kern fprog;
+	struct sock_filter *insns = NULL;
+	struct bpf_prog *prog = NULL, *old;
+	int ret;
+
+	if (!sysfs_streq(text, "off")) {
+		ret = plat_filter_parse(text, &insns);
+		if (ret < 0)
+			return ret;
+
+		fprog.len = ret;
+		fprog.filter = insns;
+
+		/* Checks the program and translates it */
+		ret = bpf_prog_create(&prog, &fprog);
+		kfree(insns);
+		if (ret)
+			return ret;
+	}
+
+	mutex_lock(&rd->lock);
+	old = flt->prog;
+	flt->prog = prog;
+	flt->len = prog ? prog->len : 0;
+	flt->passed = 0;
+	flt->truncated = 0;
+	flt->dropped = 0;
+	mutex_unlock(&rd->lock);
+
+	if (old)
+		bpf_prog_destroy(old);
+
+	return 0;
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+static int plat_filter_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_device *my_dev = s->private;
+	struct plat_dummy_channel *rd = &my_dev->channels[PLAT_CH_RD];
+	struct plat_dummy_filter *flt = &my_dev->filter;
+
+	mutex_lock(&rd->lock);
+
+	if (flt->prog)
+		seq_printf(s, "filter: %u insns, snaplen %u\n", flt->len,
+			   PLAT_FILTER_SNAPLEN);
+	else
+		seq_puts(s, "filter: off\n");
+
+	seq_printf(s, "passed %llu, truncated %llu, dropped %llu\n",
+		   flt->passed, flt->truncated, flt->dropped);
+
+	mutex_unlock(&rd->lock);
+	return 0;
+}
+
+static int plat_filter_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, plat_filter_show, inode->i_private);
+}
+
+static ssize_t plat_filter_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	char *text;
+	int ret;
+
+	if (count > PLAT_FILTER_MAX_TEXT)
+		return -E2BIG;
+
+	text = memdup_user_nul(buf, count);
+	if (IS_ERR(text))
+		return PTR_ERR(text);
+
+	ret = plat_filter_attach(s->private, text);
+	kfree(text);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations plat_filter_fops = {
+	.owner   = THIS_MODULE,
+	.open    = plat_filter_open,
+	.read    = seq_read,
+	.write   = plat_filter_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* ----------------------------------------------------------------- */
+
+void plat_dummy_filter_init(struct plat_dummy_device *my_dev,
+			    struct dentry *dbg_dir)
+{
+	struct plat_dummy_filter *flt = &my_dev->filter;
+
+	/* Without the snapshot buffer the filter just cannot be loaded */
+	flt->skb = alloc_skb(PLAT_FILTER_SNAPLEN, GFP_KERNEL);
+	if (!flt->skb) {
+		pr_warn("Filter snapshot allocation failed\n");
+		return;
+	}
+
+	debugfs_create_file("filter", 0644, dbg_dir, my_dev,
+			    &plat_filter_fops);
+}
+
+void plat_dummy_filter_exit(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_filter *flt = &my_dev->filter;
+
+	if (flt->prog)
+		bpf_prog_destroy(flt->prog);
+	flt->prog = NULL;
+
+	kfree_skb(flt->skb);
+	flt->skb = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef __DUMMY_DEV_FILTER_H
+#define __DUMMY_DEV_FILTER_H
+
+#include <linux/types.h>
+#include <linux/debugfs.h>
+
+/*
+ * Classic BPF filter on the RD message path, socket filter style:
+ * the program sees the first PLAT_FILTER_SNAPLEN bytes of a received
+ * payload and returns the number of bytes to deliver, 0 drops the
+ * message before it is copied out of the window.
+ *
+ * The program is loaded by writing "tcpdump -ddd" style text (count,
+ * then "code jt jf k" per line) to debugfs plat_dummy/filter, "off"
+ * removes it.
+ */
+#define PLAT_FILTER_SNAPLEN	(256)
+
+struct bpf_prog;
+struct sk_buff;
+
+struct plat_dummy_filter {
+	/* Under the RD channel lock */
+	struct bpf_prog		*prog;
+	struct sk_buff		*skb;	/* Preallocated, holds the snapshot */
+	unsigned int		len;	/* Instructions */
+
+	/* Stats */
+	u64			passed;
+	u64			truncated;
+	u64			dropped;
+};
+
+struct plat_dummy_device;
+struct plat_dummy_rx_frame;
+
+void plat_dummy_filter_init(struct plat_dummy_device *my_dev,
+			    struct dentry *dbg_dir);
+void plat_dummy_filter_exit(struct plat_dummy_device *my_dev);
+
+/*
+ * Returns the payload bytes to deliver, 0 to drop the message.
+ * Called with the RD channel lock held.
+ */
+u32 plat_dummy_filter_run(struct plat_dummy_device *my_dev,
+			  const struct plat_dummy_rx_frame *f);
+
+#endif
@@ -0,0 +1,449 @@
+#include <kunit/test.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "dummy_dev.h"
+#include "platform_test-utils.h"
+#include "platform_test-xform.h"
+
+/*
+ * KUnit suite of the platform_test-utils accessors and of the payload
+ * kernels, run on a device whose windows and registers are plain
+ * memory. The bench cases only report their timings (C vs SIMD per
+ * KB for the kernels) and always pass.
+ *
+ * Built with CONFIG_PLAT_DUMMY_KUNIT_TEST, see .kunitconfig.
+ */
+#define PLAT_KUNIT_BENCH_LOOPS	(100000)
+
+/* A device whose windows and registers are plain memory */
+struct plat_kunit {
+	struct plat_dummy_device	*my_dev;
+	u32				*regs;
+	u8				*rd;
+	u8				*wr;
+	u8				*buf;	/* MEM_SIZE of scratch */
+};
+
+static int plat_kunit_init(struct kunit *test)
+{
+	struct plat_kunit *kt;
+
+	kt = kunit_kzalloc(test, sizeof(*kt), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kt);
+
+	kt->my_dev = kunit_kzalloc(test, sizeof(*kt->my_dev), GFP_KERNEL);
+	kt->regs = kunit_kzalloc(test, REG_SIZE, GFP_KERNEL);
+	kt->rd = kunit_kzalloc(test, MEM_SIZE, GFP_KERNEL);
+	kt->wr = kunit_kzalloc(test, MEM_SIZE, GFP_KERNEL);
+	kt->buf = kunit_kzalloc(test, MEM_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kt->my_dev);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kt->regs);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kt->rd);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kt->wr);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kt->buf);
+
+	kt->my_dev->regs = (void __iomem __force *) kt->regs;
+	kt->my_dev->channels[PLAT_CH_RD].buf = (void __iomem __force *) kt->rd;
+	kt->my_dev->channels[PLAT_CH_WR].buf = (void __iomem __force *) kt->wr;
+	spin_lock_init(&kt->my_dev->flags_lock);
+
+	test->priv = kt;
+	return 0;
+}
+
+static u32 plat_kunit_reg(struct plat_kunit *kt, u32 reg)
+{
+	return READ_ONCE(kt->regs[reg / sizeof(u32)]);
+}
+
+static void plat_kunit_set_reg(struct plat_kunit *kt, u32 reg, u32 val)
+{
+	WRITE_ONCE(kt->regs[reg / sizeof(u32)], val);
+}
+
+static void plat_kunit_set_regs(struct plat_kunit *kt, u32 flags, u32 rd_size)
+{
+	plat_kunit_set_reg(kt, PLAT_IO_FLAGS_REG, flags);
+	plat_kunit_set_reg(kt, PLAT_RD_SIZE_REG, rd_size);
+	plat_kunit_set_reg(kt, PLAT_WR_SIZE_REG, 0);
+}
+
+/* ------------------------- protocol ------------------------------ */
+
+static void plat_kunit_data(struct kunit *test)
+{
+	struct plat_kunit *kt = test->priv;
+	struct plat_dummy_device *my_dev = kt->my_dev;
+	u32 i;
+
+	for (i = 0; i < MEM_SIZE; i++)
+		kt->rd[i] = i * 7;
+
+	for (i = 0; i < MEM_SIZE; i++)
+		KUNIT_ASSERT_EQ(test, plat_dummy_read_byte(my_dev, i),
+				(u8) (i * 7));
+
+	for (i = 0; i < MEM_SIZE; i++)
+		plat_dummy_write_byte(my_dev, i, i * 3);
+
+	for (i = 0; i < MEM_SIZE; i++)
+		KUNIT_ASSERT_EQ(test, kt->wr[i], (u8) (i * 3));
+
+	plat_dummy_read_buf(my_dev, kt->buf, MEM_SIZE);
+	KUNIT_EXPECT_EQ(test, memcmp(kt->buf, kt->rd, MEM_SIZE), 0);
+
+	/* Up to size, not a byte further */
+	memset(kt->wr, 0, MEM_SIZE);
+	plat_dummy_write_buf(my_dev, kt->buf, MEM_SIZE - 1);
+	KUNIT_EXPECT_EQ(test, memcmp(kt->wr, kt->rd, MEM_SIZE - 1), 0);
+	KUNIT_EXPECT_EQ(test, kt->wr[MEM_SIZE - 1], (u8) 0);
+}
+
+static void plat_kunit_rd_flags(struct kunit *test)
+{
+	struct plat_kunit *kt = test->priv;
+	struct plat_dummy_device *my_dev = kt->my_dev;
+	u32 size = 0;
+
+	plat_kunit_set_regs(kt, PLAT_WR_DATA_READY, 123);
+	KUNIT_EXPECT_FALSE(test, plat_dummy_is_rd_buf_ready(my_dev, &size));
+
+	plat_kunit_set_regs(kt, PLAT_RD_DATA_READY, 123);
+	KUNIT_EXPECT_TRUE(test, plat_dummy_is_rd_buf_ready(my_dev, &size));
+	KUNIT_EXPECT_EQ(test, size, 123U);
+
+	/* Clearing RD drops the RD flags only */
+	plat_kunit_set_regs(kt, PLAT_RD_DATA_READY | PLAT_RD_LZ4_FRAME |
+			    PLAT_WR_DATA_READY | PLAT_USR_LZ4_CAPABLE, 1);
+	plat_dummy_clear_rd_buf_ready(my_dev);
+	KUNIT_EXPECT_EQ(test, plat_kunit_reg(kt, PLAT_IO_FLAGS_REG),
+			(u32) (PLAT_WR_DATA_READY | PLAT_USR_LZ4_CAPABLE));
+}
+
+static void plat_kunit_wr_flags(struct kunit *test)
+{
+	struct plat_kunit *kt = test->priv;
+	struct plat_dummy_device *my_dev = kt->my_dev;
+
+	plat_kunit_set_regs(kt, PLAT_RD_DATA_READY | PLAT_USR_LZ4_CAPABLE, 0);
+	KUNIT_EXPECT_FALSE(test, plat_dummy_is_wr_buf_ready(my_dev));
+
+	plat_kunit_set_regs(kt, PLAT_WR_LZ4_FRAME, 0);
+	KUNIT_EXPECT_FALSE(test, plat_dummy_is_wr_buf_ready(my_dev));
+
+	/* Setting WR stores the size and keeps the RD flag */
+	plat_kunit_set_regs(kt, PLAT_RD_DATA_READY, 0);
+	plat_dummy_set_wr_buf_ready(my_dev, 77);
+	KUNIT_EXPECT_EQ(test, plat_kunit_reg(kt, PLAT_IO_FLAGS_REG),
+			(u32) (PLAT_RD_DATA_READY | PLAT_WR_DATA_READY));
+	KUNIT_EXPECT_EQ(test, plat_kunit_reg(kt, PLAT_WR_SIZE_REG), 77U);
+	KUNIT_EXPECT_TRUE(test, plat_dummy_is_wr_buf_ready(my_dev));
+
+	/* The frame flag follows each WR set */
+	plat_kunit_set_regs(kt, 0, 0);
+	plat_dummy_set_wr_buf_ready_flags(my_dev, 10, PLAT_WR_LZ4_FRAME);
+	KUNIT_EXPECT_EQ(test, plat_kunit_reg(kt, PLAT_IO_FLAGS_REG),
+			(u32) (PLAT_WR_DATA_READY | PLAT_WR_LZ4_FRAME));
+	plat_dummy_set_wr_buf_ready(my_dev, 10);
+	KUNIT_EXPECT_EQ(test, plat_kunit_reg(kt, PLAT_IO_FLAGS_REG),
+			(u32) PLAT_WR_DATA_READY);
+}
+
+static void plat_kunit_wr_credits(struct kunit *test)
+{
+	struct plat_kunit *kt = test->priv;
+	struct plat_dummy_device *my_dev = kt->my_dev;
+
+	/* No flow control */
+	plat_kunit_set_regs(kt, 0, 0);
+	plat_kunit_set_reg(kt, PLAT_WR_CREDITS_REG, 0);
+	KUNIT_EXPECT_TRUE(test, plat_dummy_wr_can_send(my_dev));
+
+	/* All credits used, right before the wrap */
+	plat_kunit_set_regs(kt, PLAT_USR_WR_CREDITS, 0);
+	my_dev->wr_sent = 0xfffffffe;
+	plat_kunit_set_reg(kt, PLAT_WR_CREDITS_REG, 0xfffffffe);
+	KUNIT_EXPECT_FALSE(test, plat_dummy_wr_can_send(my_dev));
+
+	/* Two credits, across the wrap */
+	plat_kunit_set_reg(kt, PLAT_WR_CREDITS_REG, 0);
+	KUNIT_EXPECT_TRUE(test, plat_dummy_wr_can_send(my_dev));
+	plat_dummy_set_wr_buf_ready(my_dev, 1);
+	KUNIT_EXPECT_FALSE(test, plat_dummy_wr_can_send(my_dev));
+
+	plat_kunit_set_regs(kt, PLAT_USR_WR_CREDITS, 0);
+	KUNIT_EXPECT_TRUE(test, plat_dummy_wr_can_send(my_dev));
+	plat_dummy_set_wr_buf_ready(my_dev, 1);
+
+	plat_kunit_set_regs(kt, PLAT_USR_WR_CREDITS, 0);
+	KUNIT_EXPECT_FALSE(test, plat_dummy_wr_can_send(my_dev));
+	KUNIT_EXPECT_EQ(test, plat_kunit_reg(kt, PLAT_WR_SENT_REG), 0U);
+	KUNIT_EXPECT_EQ(test, my_dev->wr_sent, 0U);
+}
+
+/* SIMD kernels must match the C ones, tails and odd lengths included */
+static const u32 plat_kunit_lens[] = { 1, 3, 63, 64, 65, 255, 1000, MEM_SIZE };
+
+static void plat_kunit_fill_rd(struct plat_kunit *kt)
+{
+	u32 i;
+
+	for (i = 0; i < MEM_SIZE; i++)
+		kt->rd[i] = i * 37 + (i >> 8);
+}
+
+static void plat_kunit_csum(struct kunit *test)
+{
+	static const u8 sample[] = { 0x01, 0x02, 0x03 };
+	struct plat_kunit *kt = test->priv;
+	u32 i;
+
+	KUNIT_EXPECT_EQ(test, plat_dummy_csum_scalar(sample, 3),
+			(u16) 0x0204);
+
+	plat_kunit_fill_rd(kt);
+	for (i = 0; i < ARRAY_SIZE(plat_kunit_lens); i++)
+		KUNIT_EXPECT_EQ_MSG(test,
+			plat_dummy_csum_simd(kt->rd, plat_kunit_lens[i]),
+			plat_dummy_csum_scalar(kt->rd, plat_kunit_lens[i]),
+			"len %u", plat_kunit_lens[i]);
+}
+
+static void plat_kunit_bswap32(struct kunit *test)
+{
+	struct plat_kunit *kt = test->priv;
+	u8 *half = kt->buf + MEM_SIZE / 2;
+	u32 i, len;
+
+	plat_kunit_fill_rd(kt);
+	for (i = 0; i < ARRAY_SIZE(plat_kunit_lens); i++) {
+		len = min(plat_kunit_lens[i], (u32) MEM_SIZE / 2);
+		plat_dummy_bswap32_scalar(kt->buf, kt->rd, len);
+		plat_dummy_bswap32_simd(half, kt->rd, len);
+		KUNIT_EXPECT_EQ_MSG(test, memcmp(kt->buf, half, len), 0,
+				    "len %u", len);
+	}
+
+	/* In place twice is the identity */
+	memcpy(kt->buf, kt->rd, MEM_SIZE);
+	plat_dummy_bswap32_simd(kt->buf, kt->buf, MEM_SIZE);
+	plat_dummy_bswap32_simd(kt->buf, kt->buf, MEM_SIZE);
+	KUNIT_EXPECT_EQ(test, memcmp(kt->buf, kt->rd, MEM_SIZE), 0);
+}
+
+static void plat_kunit_copy_fromio(struct kunit *test)
+{
+	struct plat_kunit *kt = test->priv;
+	u32 i;
+
+	plat_kunit_fill_rd(kt);
+	for (i = 0; i < ARRAY_SIZE(plat_kunit_lens); i++) {
+		memset(kt->buf, 0, MEM_SIZE);
+		plat_dummy_copy_fromio_simd(kt->buf,
+				kt->my_dev->channels[PLAT_CH_RD].buf,
+				plat_kunit_lens[i]);
+		KUNIT_EXPECT_EQ_MSG(test,
+			memcmp(kt->buf, kt->rd, plat_kunit_lens[i]), 0,
+			"len %u", plat_kunit_lens[i]);
+	}
+}
+
+/* ------------------------- benchmarks ---------------------------- */
+
+static u32 plat_kunit_sink;
+
+static void plat_kunit_op_read_byte(struct plat_kunit *kt, u32 i)
+{
+	plat_kunit_sink += plat_dummy_read_byte(kt->my_dev, i & (MEM_SIZE - 1));
+}
+
+static void plat_kunit_op_write_byte(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_write_byte(kt->my_dev, i & (MEM_SIZE - 1), i);
+}
+
+static void plat_kunit_op_read_flags(struct plat_kunit *kt, u32 i)
+{
+	plat_kunit_sink += plat_dummy_read_flags(kt->my_dev);
+}
+
+static void plat_kunit_op_is_rd_ready(struct plat_kunit *kt, u32 i)
+{
+	u32 size;
+
+	plat_kunit_sink += plat_dummy_is_rd_buf_ready(kt->my_dev, &size);
+}
+
+static void plat_kunit_op_clear_rd_ready(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_clear_rd_buf_ready(kt->my_dev);
+}
+
+static void plat_kunit_op_is_wr_ready(struct plat_kunit *kt, u32 i)
+{
+	plat_kunit_sink += plat_dummy_is_wr_buf_ready(kt->my_dev);
+}
+
+static void plat_kunit_op_set_wr_ready(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_set_wr_buf_ready(kt->my_dev, i & (MEM_SIZE - 1));
+}
+
+static void plat_kunit_op_read_buf(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_read_buf(kt->my_dev, kt->buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_write_buf(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_write_buf(kt->my_dev, kt->buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_write_bytes(struct plat_kunit *kt, u32 i)
+{
+	u32 off;
+
+	for (off = 0; off < MEM_SIZE; off++)
+		plat_dummy_write_byte(kt->my_dev, off, kt->buf[off]);
+}
+
+static void plat_kunit_op_read_bytes(struct plat_kunit *kt, u32 i)
+{
+	u32 off;
+
+	for (off = 0; off < MEM_SIZE; off++)
+		kt->buf[off] = plat_dummy_read_byte(kt->my_dev, off);
+}
+
+static void plat_kunit_op_csum_c(struct plat_kunit *kt, u32 i)
+{
+	plat_kunit_sink += plat_dummy_csum_scalar(kt->buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_csum_simd(struct plat_kunit *kt, u32 i)
+{
+	plat_kunit_sink += plat_dummy_csum_simd(kt->buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_bswap_c(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_bswap32_scalar(kt->buf, kt->buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_bswap_simd(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_bswap32_simd(kt->buf, kt->buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_copy_c(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_copy_fromio_scalar(kt->buf,
+			kt->my_dev->channels[PLAT_CH_RD].buf, MEM_SIZE);
+}
+
+static void plat_kunit_op_copy_simd(struct plat_kunit *kt, u32 i)
+{
+	plat_dummy_copy_fromio_simd(kt->buf,
+			kt->my_dev->channels[PLAT_CH_RD].buf, MEM_SIZE);
+}
+
+struct plat_kunit_bench {
+	const char	*name;
+	void		(*op)(struct plat_kunit *kt, u32 i);
+	unsigned int	bytes;	/* Per op, 0 for accessors */
+};
+
+static void plat_kunit_bench_run(struct kunit *test,
+				 const struct plat_kunit_bench *benches,
+				 unsigned int count)
+{
+	struct plat_kunit *kt = test->priv;
+	unsigned int i, n, k;
+	u64 start, ns;
+
+	for (k = 0; k < count; k++) {
+		/* Whole-window ops are ~1000 times slower */
+		n = benches[k].bytes ? PLAT_KUNIT_BENCH_LOOPS / 1000 :
+				       PLAT_KUNIT_BENCH_LOOPS;
+
+		plat_kunit_set_regs(kt, PLAT_RD_DATA_READY, MEM_SIZE);
+
+		start = ktime_get_ns();
+		for (i = 0; i < n; i++)
+			benches[k].op(kt, i);
+		ns = ktime_get_ns() - start;
+
+		if (benches[k].bytes)
+			kunit_info(test, "%-20s %10llu ns/op %8llu ns/KB %6llu MB/s\n",
+				   benches[k].name, div_u64(ns, n),
+				   div64_u64(ns * SZ_1K,
+					     (u64) n * benches[k].bytes),
+				   div64_u64((u64) n * benches[k].bytes *
+					     NSEC_PER_SEC / SZ_1M, ns ?: 1));
+		else
+			kunit_info(test, "%-20s %10llu ns/op\n",
+				   benches[k].name, div_u64(ns, n));
+
+		cond_resched();
+	}
+}
+
+static void plat_kunit_bench_accessors(struct kunit *test)
+{
+	static const struct plat_kunit_bench benches[] = {
+		{ "read_byte",		plat_kunit_op_read_byte },
+		{ "write_byte",		plat_kunit_op_write_byte },
+		{ "read_flags",		plat_kunit_op_read_flags },
+		{ "is_rd_buf_ready",	plat_kunit_op_is_rd_ready },
+		{ "clear_rd_buf_ready",	plat_kunit_op_clear_rd_ready },
+		{ "is_wr_buf_ready",	plat_kunit_op_is_wr_ready },
+		{ "set_wr_buf_ready",	plat_kunit_op_set_wr_ready },
+		{ "read_buf 4K",	plat_kunit_op_read_buf,		MEM_SIZE },
+		{ "write_buf 4K",	plat_kunit_op_write_buf,	MEM_SIZE },
+		{ "write_byte x 4K",	plat_kunit_op_write_bytes,	MEM_SIZE },
+		{ "read_byte x 4K",	plat_kunit_op_read_bytes,	MEM_SIZE },
+	};
+
+	plat_kunit_bench_run(test, benches, ARRAY_SIZE(benches));
+}
+
+static void plat_kunit_bench_xform(struct kunit *test)
+{
+	static const struct plat_kunit_bench benches[] = {
+		{ "copy_fromio C",	plat_kunit_op_copy_c,		MEM_SIZE },
+		{ "copy_fromio SIMD",	plat_kunit_op_copy_simd,	MEM_SIZE },
+		{ "csum C",		plat_kunit_op_csum_c,		MEM_SIZE },
+		{ "csum SIMD",		plat_kunit_op_csum_simd,	MEM_SIZE },
+		{ "bswap32 C",		plat_kunit_op_bswap_c,		MEM_SIZE },
+		{ "bswap32 SIMD",	plat_kunit_op_bswap_simd,	MEM_SIZE },
+	};
+
+	kunit_info(test, "SIMD: %s\n",
+		   plat_dummy_has_simd() ? "NEON" : "none, C fallback");
+	plat_kunit_bench_run(test, benches, ARRAY_SIZE(benches));
+}
+
+/* ----------------------------------------------------------------- */
+
+static struct kunit_case plat_dummy_test_cases[] = {
+	KUNIT_CASE(plat_kunit_data),
+	KUNIT_CASE(plat_kunit_rd_flags),
+	KUNIT_CASE(plat_kunit_wr_flags),
+	KUNIT_CASE(plat_kunit_wr_credits),
+	KUNIT_CASE(plat_kunit_csum),
+	KUNIT_CASE(plat_kunit_bswap32),
+	KUNIT_CASE(plat_kunit_copy_fromio),
+	KUNIT_CASE(plat_kunit_bench_accessors),
+	KUNIT_CASE(plat_kunit_bench_xform),
+	{}
+};
+
+static struct kunit_suite plat_dummy_test_suite = {
+	.name		= "plat_dummy",
+	.init		= plat_kunit_init,
+	.test_cases	= plat_dummy_test_cases,
+};
+kunit_test_suite(plat_dummy_test_suite);
@@ -0,0 +1,202 @@
+#include <linux/kernel.h>
+#include <linux/irqflags.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+
+#include "dummy_dev.h"
+#include "platform_test-msgpool.h"
+
+static u32 plat_msg_class_size(unsigned int class)
+{
+	return 1U << (PLAT_MSG_MIN_SHIFT + class * PLAT_MSG_CLASS_STEP);
+}
+
+static int plat_msg_size_to_class(u32 size)
+{
+	unsigned int class;
+
+	for (class = 0; class < PLAT_MSG_CLASSES; ++class)
+		if (size <= plat_msg_class_size(class))
+			return class;
+
+	return -1;
+}
+
+static void plat_msg_account_alloc(struct plat_msg_class *mc)
+{
+	int in_use = atomic_inc_return(&mc->in_use);
+	int hw = atomic_read(&mc->high_water);
+
+	while (in_use > hw) {
+		int prev = atomic_cmpxchg(&mc->high_water, hw, in_use);
+
+		if (prev == hw)
+			break;
+		hw = prev;
+	}
+
+	atomic64_inc(&mc->allocs);
+}
+
+struct plat_msg *plat_msg_alloc(struct plat_msgpool *mp, u32 size, gfp_t gfp)
+{
+	struct plat_msg_pcpu_cache *pc;
+	struct plat_msg_class *mc;
+	struct plat_msg *msg = NULL;
+	unsigned long flags;
+	int class = plat_msg_size_to_class(size);
+
+	if (class < 0)
+		return NULL;
+
+	mc = &mp->classes[class];
+
+	/* Fast path: the free list of this CPU, no slab or pool locks */
+	local_irq_save(flags);
+	pc = this_cpu_ptr(mc->pcpu);
+	if (pc->count)
+		msg = pc->msgs[--pc->count];
+	local_irq_restore(flags);
+
+	if (msg) {
+		atomic64_inc(&mc->pcpu_hits);
+	} else {
+		msg = mempool_alloc(mc->pool, gfp);
+		if (!msg) {
+			atomic64_inc(&mc->failures);
+			return NULL;
+		}
+	}
+
+	plat_msg_account_alloc(mc);
+
+	INIT_LIST_HEAD(&msg->node);
+	msg->size_class = class;
+	msg->len = size;
+	msg->timestamp_ns = 0;
+	return msg;
+}
+
+void plat_msg_free(struct plat_msgpool *mp, struct plat_msg *msg)
+{
+	struct plat_msg_class *mc = &mp->classes[msg->size_class];
+	struct plat_msg_pcpu_cache *pc;
+	unsigned long flags;
+	bool is_cached = false;
+
+	atomic_dec(&mc->in_use);
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(mc->pcpu);
+	if (pc->count < PLAT_MSG_PCPU_CACHE) {
+		pc->msgs[pc->count++] = msg;
+		is_cached = true;
+	}
+	local_irq_restore(flags);
+
+	/* Refills the reserve first, then goes back to the slab */
+	if (!is_cached)
+		mempool_free(msg, mc->pool);
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+static int plat_msgpool_show(struct seq_file *s, void *unused)
+{
+	struct plat_msgpool *mp = s->private;
+	struct plat_msg_class *mc;
+	unsigned int class;
+
+	seq_printf(s, "%6s %10s %10s %8s %8s %10s %8s\n", "size", "allocs",
+		   "pcpu_hits", "in_use", "hi_water", "failures", "reserve");
+
+	for (class = 0; class < PLAT_MSG_CLASSES; ++class) {
+		mc = &mp->classes[class];
+
+		seq_printf(s, "%6u %10lld %10lld %8d %8d %10lld %8d\n",
+			   mc->size,
+			   (long long) atomic64_read(&mc->allocs),
+			   (long long) atomic64_read(&mc->pcpu_hits),
+			   atomic_read(&mc->in_use),
+			   atomic_read(&mc->high_water),
+			   (long long) atomic64_read(&mc->failures),
+			   mc->pool->curr_nr);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(plat_msgpool);
+
+/* ----------------------------------------------------------------- */
+
+static void plat_msg_class_destroy(struct plat_msg_class *mc)
+{
+	struct plat_msg_pcpu_cache *pc;
+	int cpu;
+
+	if (mc->pcpu) {
+		for_each_possible_cpu(cpu) {
+			pc = per_cpu_ptr(mc->pcpu, cpu);
+			while (pc->count)
+				mempool_free(pc->msgs[--pc->count], mc->pool);
+		}
+		free_percpu(mc->pcpu);
+		mc->pcpu = NULL;
+	}
+
+	if (mc->pool) {
+		mempool_destroy(mc->pool);
+		mc->pool = NULL;
+	}
+
+	kmem_cache_destroy(mc->cache);
+	mc->cache = NULL;
+}
+
+void plat_msgpool_destroy(struct plat_msgpool *mp)
+{
+	unsigned int class;
+
+	for (class = 0; class < PLAT_MSG_CLASSES; ++class)
+		plat_msg_class_destroy(&mp->classes[class]);
+}
+
+int plat_msgpool_init(struct plat_msgpool *mp, struct dentry *dbg_dir)
+{
+	struct plat_msg_class *mc;
+	unsigned int class;
+	char name[32];
+
+	BUILD_BUG_ON(PLAT_MSG_MIN_SHIFT + (PLAT_MSG_CLASSES - 1) *
+		     PLAT_MSG_CLASS_STEP != ilog2(PLAT_MAX_PAYLOAD));
+
+	for (class = 0; class < PLAT_MSG_CLASSES; ++class) {
+		mc = &mp->classes[class];
+		mc->size = plat_msg_class_size(class);
+
+		snprintf(name, sizeof(name), DRV_NAME "_msg%u", mc->size);
+		mc->cache = kmem_cache_create(name,
+				sizeof(struct plat_msg) + mc->size,
+				0, SLAB_HWCACHE_ALIGN, NULL);
+		if (!mc->cache)
+			goto err_destroy;
+
+		mc->pool = mempool_create_slab_pool(PLAT_MSG_POOL_MIN,
+						    mc->cache);
+		if (!mc->pool)
+			goto err_destroy;
+
+		mc->pcpu = alloc_percpu(struct plat_msg_pcpu_cache);
+		if (!mc->pcpu)
+			goto err_destroy;
+	}
+
+	debugfs_create_file("msgpool", 0444, dbg_dir, mp,
+			    &plat_msgpool_fops);
+	return 0;
+
+err_destroy:
+	pr_err("Message pool allocation failed\n");
+	plat_msgpool_destroy(mp);
+	return -ENOMEM;
+}
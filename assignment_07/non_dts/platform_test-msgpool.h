@@ -0,0 +1,68 @@
+#ifndef __DUMMY_DEV_MSGPOOL_H
+#define __DUMMY_DEV_MSGPOOL_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/mempool.h>
+#include <linux/percpu.h>
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+
+/*
+ * Message buffers: a descriptor with the payload right behind it, one
+ * slab object per message. Size classes go up to PLAT_MAX_PAYLOAD; each class
+ * has its own kmem_cache, a mempool reserve (allocations may sleep
+ * but do not fail for lack of memory) and small per-CPU free lists
+ * in front of the mempool.
+ */
+#define PLAT_MSG_CLASSES	(5)	/* 64 bytes ... 16 KB */
+#define PLAT_MSG_MIN_SHIFT	(6)
+#define PLAT_MSG_CLASS_STEP	(2)	/* Each class is 4x the previous */
+#define PLAT_MSG_POOL_MIN	(16)	/* Reserved messages per class */
+#define PLAT_MSG_PCPU_CACHE	(8)	/* Cached free messages per CPU & class */
+
+struct plat_msg {
+	struct list_head	node;
+	u64			timestamp_ns;
+	u32			len;
+	u16			csum;	/* See plat_dummy_csum() */
+	u8			size_class;
+	/* Word-aligned for the copy, csum & bswap kernels */
+	u8			data[] __aligned(8);
+};
+
+struct plat_msg_pcpu_cache {
+	unsigned int		count;
+	struct plat_msg		*msgs[PLAT_MSG_PCPU_CACHE];
+};
+
+struct plat_msg_class {
+	struct kmem_cache	*cache;
+	mempool_t		*pool;
+	struct plat_msg_pcpu_cache __percpu *pcpu;
+	u32			size;
+
+	/* Stats */
+	atomic64_t		allocs;
+	atomic64_t		pcpu_hits;
+	atomic64_t		failures;
+	atomic_t		in_use;
+	atomic_t		high_water;
+};
+
+struct plat_msgpool {
+	struct plat_msg_class	classes[PLAT_MSG_CLASSES];
+};
+
+int plat_msgpool_init(struct plat_msgpool *mp, struct dentry *dbg_dir);
+void plat_msgpool_destroy(struct plat_msgpool *mp);
+
+/*
+ * Returns NULL only if size is over PLAT_MAX_PAYLOAD or if gfp does not allow
+ * to wait and the reserve is exhausted.
+ */
+struct plat_msg *plat_msg_alloc(struct plat_msgpool *mp, u32 size, gfp_t gfp);
+void plat_msg_free(struct plat_msgpool *mp, struct plat_msg *msg);
+
+#endif
@@ -0,0 +1,325 @@
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/if_arp.h>
+#include <linux/if_ether.h>
+
+#include "dummy_dev.h"
+#include "platform_test-utils.h"
+#include "platform_test-channel.h"
+#include "platform_test-txq.h"
+#include "platform_test-net.h"
+
+#define PLAT_NET_MIN_MTU	(68)
+
+/* ---------------------------- RX --------------------------------- */
+
+static void plat_dummy_net_rx_one(struct plat_dummy_net *net, u32 size)
+{
+	struct net_device *ndev = net->ndev;
+	struct plat_dummy_rx_frame frame;
+	struct sk_buff *skb = NULL;
+
+	if (!size || size > MEM_SIZE) {
+		ndev->stats.rx_length_errors++;
+		goto out_clear;
+	}
+
+	if (plat_dummy_rx_begin(net->my_dev, size, &frame)) {
+		ndev->stats.rx_frame_errors++;
+		goto out_clear;
+	}
+
+	skb = napi_alloc_skb(&net->napi, frame.len);
+	if (!skb) {
+		ndev->stats.rx_dropped++;
+		goto out_clear;
+	}
+
+	if (plat_dummy_rx_copy(net->my_dev, &frame, skb_put(skb, frame.len),
+			       frame.len) < 0) {
+		ndev->stats.rx_frame_errors++;
+		dev_kfree_skb_any(skb);
+		skb = NULL;
+	}
+
+out_clear:
+	rmb();
+
+	/* The window is free for the next packet */
+	plat_dummy_clear_rd_buf_ready(net->my_dev);
+
+	if (!skb)
+		return;
+
+	switch (skb->data[0] >> 4) {
+	case 4:
+		skb->protocol = htons(ETH_P_IP);
+		break;
+	case 6:
+		skb->protocol = htons(ETH_P_IPV6);
+		break;
+	default:
+		ndev->stats.rx_frame_errors++;
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	skb->dev = ndev;
+	skb_reset_mac_header(skb);
+	skb_reset_network_header(skb);
+
+	ndev->stats.rx_packets++;
+	ndev->stats.rx_bytes += frame.len;
+
+	napi_gro_receive(&net->napi, skb);
+}
+
+static int plat_dummy_net_poll(struct napi_struct *napi, int budget)
+{
+	struct plat_dummy_net *net = container_of(napi, struct plat_dummy_net,
+						  napi);
+	struct plat_dummy_device *my_dev = net->my_dev;
+	int work_done = 0;
+	u32 size;
+
+	while (work_done < budget &&
+	       plat_dummy_is_rd_buf_ready(my_dev, &size)) {
+		plat_dummy_net_rx_one(net, size);
+		work_done++;
+	}
+
+	/*
+	 * The window holds one packet, so the poll usually ends before
+	 * the budget does. Keep an eye on a busy link, fall back to the
+	 * regular poll period on an idle one.
+	 */
+	if (work_done < budget && napi_complete_done(napi, work_done))
+		plat_dummy_channel_kick(&my_dev->channels[PLAT_CH_RD],
+				work_done ? 1 : READ_ONCE(my_dev->js_poll_time));
+
+	return work_done;
+}
+
+bool plat_dummy_net_rx_poll(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_net *net = READ_ONCE(my_dev->net);
+	u32 size;
+
+	if (!net || !net->rx_active)
+		return false;
+
+	/*
+	 * Process context (channel work or busy-poll thread): with BHs
+	 * off the raised NET_RX softirq runs at local_bh_enable() rather
+	 * than at some later interrupt exit.
+	 */
+	if (plat_dummy_is_rd_buf_ready(my_dev, &size)) {
+		local_bh_disable();
+		napi_schedule(&net->napi);
+		local_bh_enable();
+	}
+
+	return true;
+}
+
+/* ---------------------------- TX --------------------------------- */
+
+static netdev_tx_t plat_dummy_net_xmit(struct sk_buff *skb,
+				       struct net_device *ndev)
+{
+	struct plat_dummy_net *net = netdev_priv(ndev);
+	struct plat_dummy_device *my_dev = net->my_dev;
+
+	if (skb->len > PLAT_MAX_PAYLOAD || skb_linearize(skb)) {
+		ndev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return NETDEV_TX_OK;
+	}
+
+	/*
+	 * The queue is only woken with the window free, but userspace
+	 * can still take the credits back meanwhile. Requeueing is left
+	 * to the upper layers: drop, and let the WR poll wake the queue.
+	 */
+	if (!plat_dummy_wr_can_send(my_dev)) {
+		ndev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		netif_stop_queue(ndev);
+		plat_dummy_channel_kick(&my_dev->channels[PLAT_CH_WR], 1);
+		return NETDEV_TX_OK;
+	}
+
+	/* Too long to go out raw and does not compress enough */
+	if (plat_dummy_tx_payload(my_dev, skb->data, skb->len)) {
+		ndev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return NETDEV_TX_OK;
+	}
+
+	ndev->stats.tx_packets++;
+	ndev->stats.tx_bytes += skb->len;
+	dev_consume_skb_any(skb);
+
+	/* One packet in flight, the WR poll wakes the queue */
+	netif_stop_queue(ndev);
+	plat_dummy_channel_kick(&my_dev->channels[PLAT_CH_WR], 1);
+
+	return NETDEV_TX_OK;
+}
+
+bool plat_dummy_net_tx_poll(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_net *net = READ_ONCE(my_dev->net);
+
+	if (!net || !net->tx_active)
+		return false;
+
+	if (netif_queue_stopped(net->ndev)) {
+		if (plat_dummy_wr_can_send(my_dev))
+			netif_wake_queue(net->ndev);
+		else
+			plat_dummy_channel_kick(&my_dev->channels[PLAT_CH_WR],
+						1);
+	}
+
+	return true;
+}
+
+/* ----------------------------------------------------------------- */
+
+static int plat_dummy_net_open(struct net_device *ndev)
+{
+	struct plat_dummy_net *net = netdev_priv(ndev);
+	struct plat_dummy_channel *rd = &net->my_dev->channels[PLAT_CH_RD];
+	struct plat_dummy_channel *wr = &net->my_dev->channels[PLAT_CH_WR];
+
+	napi_enable(&net->napi);
+
+	/* Take the windows over from the channels' own processing */
+	mutex_lock(&rd->lock);
+	net->rx_active = true;
+	mutex_unlock(&rd->lock);
+
+	mutex_lock(&wr->lock);
+	net->tx_active = true;
+	mutex_unlock(&wr->lock);
+
+	/* Fails the txq producers, queued messages wait for ndo_stop */
+	plat_dummy_txq_set_net_up(net->my_dev, true);
+
+	/* Previous message not taken yet or no credit: the WR poll wakes it */
+	if (plat_dummy_wr_can_send(net->my_dev))
+		netif_start_queue(ndev);
+	else
+		netif_stop_queue(ndev);
+
+	plat_dummy_channel_kick(rd, 0);
+	plat_dummy_channel_kick(wr, 0);
+
+	return 0;
+}
+
+static int plat_dummy_net_stop(struct net_device *ndev)
+{
+	struct plat_dummy_net *net = netdev_priv(ndev);
+	struct plat_dummy_channel *rd = &net->my_dev->channels[PLAT_CH_RD];
+	struct plat_dummy_channel *wr = &net->my_dev->channels[PLAT_CH_WR];
+
+	/* Waits for a running xmit */
+	netif_tx_disable(ndev);
+
+	mutex_lock(&wr->lock);
+	net->tx_active = false;
+	mutex_unlock(&wr->lock);
+	plat_dummy_txq_set_net_up(net->my_dev, false);
+
+	/* Waits for a running poll, a later napi_schedule() is a no-op */
+	napi_disable(&net->napi);
+
+	mutex_lock(&rd->lock);
+	net->rx_active = false;
+	mutex_unlock(&rd->lock);
+
+	return 0;
+}
+
+static const struct net_device_ops plat_dummy_netdev_ops = {
+	.ndo_open	= plat_dummy_net_open,
+	.ndo_stop	= plat_dummy_net_stop,
+	.ndo_start_xmit	= plat_dummy_net_xmit,
+};
+
+static void plat_dummy_net_setup(struct net_device *ndev)
+{
+	ndev->netdev_ops = &plat_dummy_netdev_ops;
+
+	/* Raw IP over a point-to-point link, no link layer header */
+	ndev->type = ARPHRD_NONE;
+	ndev->hard_header_len = 0;
+	ndev->addr_len = 0;
+	ndev->flags = IFF_POINTOPOINT | IFF_NOARP;
+	ndev->tx_queue_len = DEFAULT_TX_QUEUE_LEN;
+
+	/* Over MEM_SIZE only packets that compress well get through */
+	ndev->mtu = MEM_SIZE;
+	ndev->min_mtu = PLAT_NET_MIN_MTU;
+	ndev->max_mtu = PLAT_MAX_PAYLOAD;
+}
+
+int plat_dummy_net_init(struct plat_dummy_device *my_dev, struct device *dev)
+{
+	struct net_device *ndev;
+	struct plat_dummy_net *net;
+	int err;
+
+	ndev = alloc_netdev(sizeof(struct plat_dummy_net), "pdummy%d",
+			    NET_NAME_ENUM, plat_dummy_net_setup);
+	if (!ndev)
+		return -ENOMEM;
+
+	SET_NETDEV_DEV(ndev, dev);
+
+	net = netdev_priv(ndev);
+	net->ndev = ndev;
+	net->my_dev = my_dev;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	netif_napi_add(ndev, &net->napi, plat_dummy_net_poll);
+#else
+	netif_napi_add(ndev, &net->napi, plat_dummy_net_poll,
+		       NAPI_POLL_WEIGHT);
+#endif
+
+	my_dev->net = net;
+
+	err = register_netdev(ndev);
+	if (err) {
+		my_dev->net = NULL;
+		netif_napi_del(&net->napi);
+		free_netdev(ndev);
+		return err;
+	}
+
+	pr_info("Network interface %s registered\n", ndev->name);
+	return 0;
+}
+
+void plat_dummy_net_exit(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_net *net = my_dev->net;
+
+	if (!net)
+		return;
+
+	/* Closes the interface, the windows go back to the channels */
+	unregister_netdev(net->ndev);
+	netif_napi_del(&net->napi);
+
+	/* Wait for the polls that may still look at the frontend */
+	WRITE_ONCE(my_dev->net, NULL);
+	plat_dummy_channels_sync(my_dev);
+
+	free_netdev(net->ndev);
+}
@@ -0,0 +1,34 @@
+#ifndef __DUMMY_DEV_NET_H
+#define __DUMMY_DEV_NET_H
+
+#include <linux/netdevice.h>
+
+/*
+ * Network frontend: the RD/WR windows as a point-to-point link
+ * carrying raw IPv4/IPv6 packets, one packet per window.
+ *
+ * While the interface is up the RD window is drained by NAPI and
+ * the WR window is fed by ndo_start_xmit, the rd/wr channel polls
+ * only kick them (see plat_dummy_net_rx_poll/tx_poll).
+ */
+struct plat_dummy_net {
+	struct napi_struct		napi;
+	struct net_device		*ndev;
+	struct plat_dummy_device	*my_dev;
+
+	/* Under the RD and WR channel locks respectively */
+	bool				rx_active;
+	bool				tx_active;
+};
+
+int plat_dummy_net_init(struct plat_dummy_device *my_dev, struct device *dev);
+void plat_dummy_net_exit(struct plat_dummy_device *my_dev);
+
+/*
+ * Called from the channel polls with the channel lock held. Return
+ * true if the window belongs to the network frontend.
+ */
+bool plat_dummy_net_rx_poll(struct plat_dummy_device *my_dev);
+bool plat_dummy_net_tx_poll(struct plat_dummy_device *my_dev);
+
+#endif
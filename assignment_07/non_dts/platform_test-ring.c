@@ -0,0 +1,475 @@
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/eventfd.h>
+#include <linux/uaccess.h>
+
+#include "dummy_dev.h"
+#include "platform_test-utils.h"
+#include "platform_test-channel.h"
+#include "platform_test-ring.h"
+
+/* Requests taken off the SQ and waiting for their window */
+struct plat_ring_queue {
+	struct plat_ring_sqe	*sqes;
+	u32			head;
+	u32			tail;
+};
+
+struct plat_ring {
+	struct plat_dummy_device	*my_dev;
+
+	void				*buf;	/* Shared with userspace */
+	size_t				buf_size;
+	struct plat_ring_hdr		*hdr;
+	struct plat_ring_sqe		*sqes;
+	struct plat_ring_cqe		*cqes;
+	u8				*data;
+	u32				data_size;
+
+	struct eventfd_ctx		*efd;
+
+	/*
+	 * Ring geometry, fixed at setup. The copies in the shared header
+	 * are for userspace only: it can rewrite them at any time.
+	 */
+	u32				sq_entries;
+	u32				sq_mask;
+	u32				cq_entries;
+	u32				cq_mask;
+
+	/* Serializes the RD and WR polls on the rings below */
+	spinlock_t			lock;
+	u32				sq_head;
+	u32				cq_tail;
+	u32				cq_overflow;
+	struct plat_ring_queue		queues[PLAT_CH_COUNT];
+};
+
+/* --------------------------- rings ------------------------------- */
+
+static void plat_ring_post(struct plat_ring *ring, u64 user_data, s32 res,
+			   u32 flags)
+{
+	struct plat_ring_hdr *hdr = ring->hdr;
+	struct plat_ring_cqe *cqe;
+
+	if (ring->cq_tail - READ_ONCE(hdr->cq.head) >= ring->cq_entries) {
+		WRITE_ONCE(hdr->cq_overflow, ++ring->cq_overflow);
+		return;
+	}
+
+	cqe = &ring->cqes[ring->cq_tail & ring->cq_mask];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = flags;
+
+	smp_store_release(&hdr->cq.tail, ++ring->cq_tail);
+}
+
+static int plat_ring_sqe_check(struct plat_ring *ring,
+			       const struct plat_ring_sqe *sqe)
+{
+	if (!sqe->len || sqe->len > PLAT_MAX_PAYLOAD)
+		return -EINVAL;
+
+	if (sqe->len > ring->data_size ||
+	    sqe->data_off > ring->data_size - sqe->len)
+		return -EFAULT;
+
+	return 0;
+}
+
+/* Moves new submissions to their direction's queue, lock held */
+static void plat_ring_drain_sq(struct plat_ring *ring)
+{
+	struct plat_ring_hdr *hdr = ring->hdr;
+	struct plat_ring_queue *q;
+	struct plat_ring_sqe sqe;
+	u32 tail = smp_load_acquire(&hdr->sq.tail);
+	int err;
+
+	/* Never more than one ring of entries, whatever the user tail */
+	if (tail - ring->sq_head > ring->sq_entries)
+		tail = ring->sq_head + ring->sq_entries;
+
+	while (ring->sq_head != tail) {
+		sqe = ring->sqes[ring->sq_head & ring->sq_mask];
+
+		switch (sqe.opcode) {
+		case PLAT_RING_OP_NOP:
+			plat_ring_post(ring, sqe.user_data, 0, 0);
+			ring->sq_head++;
+			continue;
+		case PLAT_RING_OP_SEND:
+			q = &ring->queues[PLAT_CH_WR];
+			break;
+		case PLAT_RING_OP_RECV:
+			q = &ring->queues[PLAT_CH_RD];
+			break;
+		default:
+			plat_ring_post(ring, sqe.user_data, -EINVAL, 0);
+			ring->sq_head++;
+			continue;
+		}
+
+		err = plat_ring_sqe_check(ring, &sqe);
+		if (err) {
+			plat_ring_post(ring, sqe.user_data, err, 0);
+			ring->sq_head++;
+			continue;
+		}
+
+		/* Full queue: the rest waits in the SQ */
+		if (q->tail - q->head == ring->sq_entries)
+			break;
+
+		q->sqes[q->tail++ & ring->sq_mask] = sqe;
+		ring->sq_head++;
+	}
+
+	smp_store_release(&hdr->sq.head, ring->sq_head);
+}
+
+static bool plat_ring_is_idle(struct plat_ring *ring)
+{
+	unsigned int i;
+
+	if (ring->sq_head != READ_ONCE(ring->hdr->sq.tail))
+		return false;
+
+	for (i = 0; i < PLAT_CH_COUNT; i++)
+		if (ring->queues[i].head != ring->queues[i].tail)
+			return false;
+
+	return true;
+}
+
+/* ------------------------- transfers ----------------------------- */
+
+static int plat_ring_send(struct plat_ring *ring,
+			  const struct plat_ring_sqe *sqe, u32 *flags)
+{
+	struct plat_dummy_device *my_dev = ring->my_dev;
+	int ret;
+
+	/* Previous message not taken yet or no credit left */
+	if (!plat_dummy_wr_can_send(my_dev))
+		return -EAGAIN;
+
+	ret = plat_dummy_tx_payload(my_dev, ring->data + sqe->data_off,
+				    sqe->len);
+	return ret ? ret : sqe->len;
+}
+
+static int plat_ring_recv(struct plat_ring *ring,
+			  const struct plat_ring_sqe *sqe, u32 *flags)
+{
+	struct plat_dummy_device *my_dev = ring->my_dev;
+	struct plat_dummy_rx_frame frame;
+	u32 size;
+	int ret;
+
+	if (!plat_dummy_is_rd_buf_ready(my_dev, &size))
+		return -EAGAIN;
+
+	ret = plat_dummy_rx_begin(my_dev, size, &frame);
+	if (!ret) {
+		if (frame.len > sqe->len)
+			*flags |= PLAT_RING_CQE_TRUNC;
+
+		ret = plat_dummy_rx_copy(my_dev, &frame,
+					 ring->data + sqe->data_off, sqe->len);
+	}
+
+	rmb();
+
+	plat_dummy_clear_rd_buf_ready(my_dev);
+	return ret;
+}
+
+bool plat_dummy_ring_poll(struct plat_dummy_device *my_dev,
+			  enum plat_dummy_channel_id id)
+{
+	struct plat_ring *ring = smp_load_acquire(&my_dev->ring);
+	struct plat_dummy_channel *ch = &my_dev->channels[id];
+	struct plat_ring_queue *q;
+	struct plat_ring_sqe sqe;
+	bool is_pending;
+	u32 flags = 0;
+	int res;
+
+	if (!ring)
+		return false;
+
+	q = &ring->queues[id];
+
+	spin_lock(&ring->lock);
+
+	plat_ring_drain_sq(ring);
+
+	is_pending = q->head != q->tail;
+	if (is_pending)
+		sqe = q->sqes[q->head & ring->sq_mask];
+
+	if (plat_ring_is_idle(ring)) {
+		/* Pairs with the barrier between a new sq.tail and the flags check */
+		WRITE_ONCE(ring->hdr->flags, PLAT_RING_NEED_WAKEUP);
+		smp_mb();
+		if (ring->sq_head != READ_ONCE(ring->hdr->sq.tail)) {
+			WRITE_ONCE(ring->hdr->flags, 0);
+			plat_dummy_channel_kick(ch, 0);
+		}
+	}
+
+	spin_unlock(&ring->lock);
+
+	if (!is_pending)
+		return true;
+
+	if (id == PLAT_CH_WR)
+		res = plat_ring_send(ring, &sqe, &flags);
+	else
+		res = plat_ring_recv(ring, &sqe, &flags);
+
+	if (res == -EAGAIN) {
+		/* Window busy, look again on the next tick */
+		plat_dummy_channel_kick(ch, 1);
+		return true;
+	}
+
+	spin_lock(&ring->lock);
+	q->head++;
+	plat_ring_post(ring, sqe.user_data, res, flags);
+	spin_unlock(&ring->lock);
+
+	if (ring->efd)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+		eventfd_signal(ring->efd);
+#else
+		eventfd_signal(ring->efd, 1);
+#endif
+
+	/* The window may be free again already */
+	plat_dummy_channel_kick(ch, 0);
+	return true;
+}
+
+/* ------------------------ setup/teardown ------------------------- */
+
+static void plat_ring_free(struct plat_ring *ring)
+{
+	unsigned int i;
+
+	if (ring->efd)
+		eventfd_ctx_put(ring->efd);
+
+	for (i = 0; i < PLAT_CH_COUNT; i++)
+		kfree(ring->queues[i].sqes);
+
+	vfree(ring->buf);
+	kfree(ring);
+}
+
+static struct plat_ring *plat_ring_alloc(struct plat_dummy_device *my_dev,
+					 struct plat_ring_params *p)
+{
+	struct plat_ring *ring;
+	u32 sq_entries, cq_entries;
+	size_t size;
+	unsigned int i;
+
+	if (!p->sq_entries || p->sq_entries > PLAT_RING_MAX_ENTRIES ||
+	    p->cq_entries > 2 * PLAT_RING_MAX_ENTRIES ||
+	    p->data_size > PLAT_RING_MAX_DATA)
+		return ERR_PTR(-EINVAL);
+
+	sq_entries = roundup_pow_of_two(p->sq_entries);
+	cq_entries = roundup_pow_of_two(p->cq_entries ?: 2 * sq_entries);
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return ERR_PTR(-ENOMEM);
+
+	ring->my_dev = my_dev;
+	spin_lock_init(&ring->lock);
+
+	/* Each part starts on a page, so it can be mapped on its own */
+	p->sqes_off = PAGE_ALIGN(sizeof(struct plat_ring_hdr));
+	p->cqes_off = p->sqes_off +
+		PAGE_ALIGN(sq_entries * sizeof(struct plat_ring_sqe));
+	p->data_off = p->cqes_off +
+		PAGE_ALIGN(cq_entries * sizeof(struct plat_ring_cqe));
+	p->mmap_size = p->data_off + PAGE_ALIGN(p->data_size);
+	p->sq_entries = sq_entries;
+	p->cq_entries = cq_entries;
+
+	size = p->mmap_size;
+	ring->buf = vmalloc_user(size);
+	if (!ring->buf)
+		goto err_free;
+
+	ring->buf_size = size;
+	ring->hdr = ring->buf;
+	ring->sqes = ring->buf + p->sqes_off;
+	ring->cqes = ring->buf + p->cqes_off;
+	ring->data = ring->buf + p->data_off;
+	ring->data_size = p->data_size;
+
+	ring->sq_entries = sq_entries;
+	ring->sq_mask = sq_entries - 1;
+	ring->cq_entries = cq_entries;
+	ring->cq_mask = cq_entries - 1;
+
+	ring->hdr->sq.mask = ring->sq_mask;
+	ring->hdr->sq.entries = sq_entries;
+	ring->hdr->cq.mask = ring->cq_mask;
+	ring->hdr->cq.entries = cq_entries;
+
+	for (i = 0; i < PLAT_CH_COUNT; i++) {
+		ring->queues[i].sqes = kcalloc(sq_entries,
+					       sizeof(struct plat_ring_sqe),
+					       GFP_KERNEL);
+		if (!ring->queues[i].sqes)
+			goto err_free;
+	}
+
+	if (p->eventfd >= 0) {
+		ring->efd = eventfd_ctx_fdget(p->eventfd);
+		if (IS_ERR(ring->efd)) {
+			long err = PTR_ERR(ring->efd);
+
+			ring->efd = NULL;
+			plat_ring_free(ring);
+			return ERR_PTR(err);
+		}
+	}
+
+	return ring;
+
+err_free:
+	plat_ring_free(ring);
+	return ERR_PTR(-ENOMEM);
+}
+
+/* ------------------------- char device --------------------------- */
+
+static struct plat_dummy_device *plat_ring_dev(struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+
+	return container_of(misc, struct plat_dummy_device, ring_misc);
+}
+
+/* One ring per device, it lives as long as the file */
+static int plat_ring_open(struct inode *inode, struct file *file)
+{
+	struct plat_dummy_device *my_dev = plat_ring_dev(file);
+
+	if (test_and_set_bit(0, &my_dev->ring_busy))
+		return -EBUSY;
+
+	return 0;
+}
+
+static int plat_ring_release(struct inode *inode, struct file *file)
+{
+	struct plat_dummy_device *my_dev = plat_ring_dev(file);
+	struct plat_ring *ring = my_dev->ring;
+
+	if (ring) {
+		/* The windows go back to the channels' own processing */
+		WRITE_ONCE(my_dev->ring, NULL);
+		plat_dummy_channels_sync(my_dev);
+		plat_ring_free(ring);
+	}
+
+	clear_bit(0, &my_dev->ring_busy);
+	return 0;
+}
+
+static long plat_ring_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct plat_dummy_device *my_dev = plat_ring_dev(file);
+	struct plat_ring_params p;
+	struct plat_ring *ring;
+	struct plat_dummy_channel *ch;
+
+	switch (cmd) {
+	case PLAT_RING_IOC_SETUP:
+		if (copy_from_user(&p, (void __user *) arg, sizeof(p)))
+			return -EFAULT;
+
+		ring = plat_ring_alloc(my_dev, &p);
+		if (IS_ERR(ring))
+			return PTR_ERR(ring);
+
+		if (copy_to_user((void __user *) arg, &p, sizeof(p))) {
+			plat_ring_free(ring);
+			return -EFAULT;
+		}
+
+		/*
+		 * Set up once per file. Full barrier, pairs with
+		 * smp_load_acquire() in plat_dummy_ring_poll().
+		 */
+		if (cmpxchg(&my_dev->ring, NULL, ring)) {
+			plat_ring_free(ring);
+			return -EBUSY;
+		}
+		return 0;
+
+	case PLAT_RING_IOC_WAKEUP:
+		ring = my_dev->ring;
+		if (!ring)
+			return -ENXIO;
+
+		WRITE_ONCE(ring->hdr->flags, 0);
+		for_each_plat_channel(my_dev, ch)
+			plat_dummy_channel_kick(ch, 0);
+		return 0;
+	}
+
+	return -ENOTTY;
+}
+
+static int plat_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct plat_dummy_device *my_dev = plat_ring_dev(file);
+
+	if (!my_dev->ring)
+		return -ENXIO;
+
+	return remap_vmalloc_range(vma, my_dev->ring->buf, vma->vm_pgoff);
+}
+
+static const struct file_operations plat_ring_fops = {
+	.owner		= THIS_MODULE,
+	.open		= plat_ring_open,
+	.release	= plat_ring_release,
+	.unlocked_ioctl	= plat_ring_ioctl,
+	.mmap		= plat_ring_mmap,
+	.llseek		= noop_llseek,
+};
+
+int plat_dummy_ring_init(struct plat_dummy_device *my_dev)
+{
+	my_dev->ring_misc.minor = MISC_DYNAMIC_MINOR;
+	my_dev->ring_misc.name = DRV_NAME "_ring";
+	my_dev->ring_misc.fops = &plat_ring_fops;
+	my_dev->ring_misc.mode = 0600;
+
+	return misc_register(&my_dev->ring_misc);
+}
+
+void plat_dummy_ring_exit(struct plat_dummy_device *my_dev)
+{
+	/* An open ring holds a module reference, so none is left here */
+	misc_deregister(&my_dev->ring_misc);
+}
@@ -0,0 +1,104 @@
+#ifndef __DUMMY_DEV_RING_H
+#define __DUMMY_DEV_RING_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Asynchronous I/O through /dev/plat_dummy_ring, shared with userspace.
+ *
+ * ioctl(PLAT_RING_IOC_SETUP) allocates the rings, then userspace maps
+ * params.mmap_size bytes of the device at offset 0:
+ *
+ *  0             struct plat_ring_hdr
+ *  sqes_off      submission queue entries
+ *  cqes_off      completion queue entries
+ *  data_off      data area, referenced by plat_ring_sqe.data_off
+ *
+ * Userspace owns sq.tail and cq.head, the driver owns sq.head and
+ * cq.tail. Entries are published with a release store of the index
+ * and consumed after an acquire load of it. The driver never reads
+ * mask and entries back: it keeps its own copies, and a sq.tail more
+ * than a ring ahead only gets one ring of entries taken.
+ *
+ * The RD/WR channel polls drain the submissions and post the
+ * completions. When both directions run out of work the driver sets
+ * PLAT_RING_NEED_WAKEUP and falls back to the regular poll period:
+ * userspace then calls ioctl(PLAT_RING_IOC_WAKEUP) after submitting.
+ */
+
+#define PLAT_RING_MAX_ENTRIES	(4096)
+#define PLAT_RING_MAX_DATA	(4 * 1024 * 1024)
+
+enum plat_ring_op {
+	PLAT_RING_OP_NOP,
+	PLAT_RING_OP_SEND,	/* Data area -> WR window */
+	PLAT_RING_OP_RECV,	/* RD window -> data area */
+};
+
+struct plat_ring_sqe {
+	__u8	opcode;
+	__u8	flags;
+	__u16	rsvd;
+	__u32	len;		/* Bytes to send / buffer size to receive */
+	__u64	data_off;	/* Buffer offset in the data area */
+	__u64	user_data;	/* Returned in the completion */
+};
+
+#define PLAT_RING_CQE_TRUNC	(1) /* Received message did not fit */
+
+struct plat_ring_cqe {
+	__u64	user_data;
+	__s32	res;		/* Bytes transferred or -errno */
+	__u32	flags;
+};
+
+struct plat_ring_idx {
+	__u32	head;
+	__u32	tail;
+	__u32	mask;
+	__u32	entries;
+};
+
+#define PLAT_RING_NEED_WAKEUP	(1)
+
+/* Producer and consumer indexes on cache lines of their own */
+struct plat_ring_hdr {
+	struct plat_ring_idx	sq __attribute__((aligned(64)));
+	struct plat_ring_idx	cq __attribute__((aligned(64)));
+	__u32			flags __attribute__((aligned(64)));
+	__u32			cq_overflow;	/* Completions dropped */
+};
+
+struct plat_ring_params {
+	__u32	sq_entries;	/* In: rounded up to a power of 2 */
+	__u32	cq_entries;	/* In: 0 = twice sq_entries */
+	__u32	data_size;	/* In: bytes of the data area */
+	__s32	eventfd;	/* In: signalled on completions, -1 = none */
+	__u64	sqes_off;	/* Out */
+	__u64	cqes_off;	/* Out */
+	__u64	data_off;	/* Out */
+	__u64	mmap_size;	/* Out */
+};
+
+#define PLAT_RING_IOC_MAGIC	'p'
+#define PLAT_RING_IOC_SETUP	_IOWR(PLAT_RING_IOC_MAGIC, 1, struct plat_ring_params)
+#define PLAT_RING_IOC_WAKEUP	_IO(PLAT_RING_IOC_MAGIC, 2)
+
+#ifdef __KERNEL__
+
+struct plat_dummy_device;
+
+int plat_dummy_ring_init(struct plat_dummy_device *my_dev);
+void plat_dummy_ring_exit(struct plat_dummy_device *my_dev);
+
+/*
+ * Called from the channel polls with the channel lock held. Returns
+ * true if the window belongs to the ring.
+ */
+bool plat_dummy_ring_poll(struct plat_dummy_device *my_dev,
+			  enum plat_dummy_channel_id id);
+
+#endif
+
+#endif
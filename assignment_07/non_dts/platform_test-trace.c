@@ -0,0 +1,196 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/relay.h>
+#include <linux/rcupdate.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "dummy_dev.h"
+#include "platform_test-trace.h"
+
+static unsigned int trace_subbuf_kb = 64;
+module_param(trace_subbuf_kb, uint, 0444);
+MODULE_PARM_DESC(trace_subbuf_kb, "Size of a trace sub-buffer in KiB");
+
+static unsigned int trace_subbufs = 8;
+module_param(trace_subbufs, uint, 0444);
+MODULE_PARM_DESC(trace_subbufs, "Trace sub-buffers per CPU");
+
+void __plat_dummy_trace(struct plat_dummy_trace *trace,
+			enum plat_trace_dir dir, u32 size, u32 len, u8 flags)
+{
+	struct plat_trace_rec rec = {
+		.timestamp_ns	= ktime_get_ns(),
+		.len		= len,
+		.size		= size,
+		.dir		= dir,
+		.flags		= flags,
+	};
+
+	/* The control side waits for the writers before it resets */
+	rcu_read_lock();
+	if (READ_ONCE(trace->is_on)) {
+		relay_write(trace->chan, &rec, sizeof(rec));
+		atomic64_inc(&trace->records);
+	}
+	rcu_read_unlock();
+}
+
+/* ----------------------------- relay ----------------------------- */
+
+static int plat_trace_subbuf_start(struct rchan_buf *buf, void *subbuf,
+				   void *prev_subbuf, size_t prev_padding)
+{
+	struct plat_dummy_trace *trace = buf->chan->private_data;
+
+	/* No overwrite: the reader has fallen behind */
+	if (relay_buf_full(buf)) {
+		atomic64_inc(&trace->lost);
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct dentry *plat_trace_create_buf_file(const char *filename,
+						 struct dentry *parent,
+						 umode_t mode,
+						 struct rchan_buf *buf,
+						 int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+				   &relay_file_operations);
+}
+
+static int plat_trace_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+	return 0;
+}
+
+static struct rchan_callbacks plat_trace_relay_cb = {
+	.subbuf_start		= plat_trace_subbuf_start,
+	.create_buf_file	= plat_trace_create_buf_file,
+	.remove_buf_file	= plat_trace_remove_buf_file,
+};
+
+/* Called with ctl_lock held */
+static void plat_trace_stop(struct plat_dummy_trace *trace)
+{
+	if (!trace->is_on)
+		return;
+
+	WRITE_ONCE(trace->is_on, false);
+	synchronize_rcu();
+
+	relay_flush(trace->chan);
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+static int plat_trace_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_trace *trace = s->private;
+
+	mutex_lock(&trace->ctl_lock);
+
+	if (!trace->chan)
+		seq_puts(s, "state: unavailable\n");
+	else
+		seq_printf(s, "state: %s\n", trace->is_on ? "on" : "off");
+
+	seq_printf(s, "sub-buffers: %u x %u KiB per CPU, record %zu bytes\n",
+		   trace_subbufs, trace_subbuf_kb,
+		   sizeof(struct plat_trace_rec));
+	seq_printf(s, "records %lld, lost %lld\n",
+		   (long long) atomic64_read(&trace->records),
+		   (long long) atomic64_read(&trace->lost));
+
+	mutex_unlock(&trace->ctl_lock);
+	return 0;
+}
+
+static int plat_trace_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, plat_trace_show, inode->i_private);
+}
+
+/* "start" captures from empty buffers, "stop" ends and flushes */
+static ssize_t plat_trace_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct plat_dummy_trace *trace = s->private;
+	char cmd[16] = { 0 };
+
+	if (copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+		return -EFAULT;
+
+	mutex_lock(&trace->ctl_lock);
+
+	if (!trace->chan) {
+		count = -ENODEV;
+	} else if (sysfs_streq(cmd, "start")) {
+		plat_trace_stop(trace);
+		relay_reset(trace->chan);
+		atomic64_set(&trace->records, 0);
+		atomic64_set(&trace->lost, 0);
+		WRITE_ONCE(trace->is_on, true);
+	} else if (sysfs_streq(cmd, "stop")) {
+		plat_trace_stop(trace);
+	} else {
+		count = -EINVAL;
+	}
+
+	mutex_unlock(&trace->ctl_lock);
+	return count;
+}
+
+static const struct file_operations plat_trace_fops = {
+	.owner   = THIS_MODULE,
+	.open    = plat_trace_open,
+	.read    = seq_read,
+	.write   = plat_trace_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* ----------------------------------------------------------------- */
+
+void plat_dummy_trace_init(struct plat_dummy_device *my_dev,
+			   struct dentry *dbg_dir)
+{
+	struct plat_dummy_trace *trace = &my_dev->trace;
+	size_t subbuf_size = max(trace_subbuf_kb, 1U) * 1024UL;
+
+	/* The layout is read by userspace, no padding anywhere */
+	BUILD_BUG_ON(sizeof(struct plat_trace_rec) != 16);
+
+	mutex_init(&trace->ctl_lock);
+
+	/* The device works without it, so does the "trace_ctl" file */
+	trace->chan = relay_open("trace", dbg_dir, subbuf_size,
+				 max(trace_subbufs, 2U), &plat_trace_relay_cb,
+				 trace);
+	if (!trace->chan)
+		pr_warn("Traffic capture is not available\n");
+
+	debugfs_create_file("trace_ctl", 0644, dbg_dir, trace,
+			    &plat_trace_fops);
+}
+
+void plat_dummy_trace_exit(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_trace *trace = &my_dev->trace;
+
+	mutex_lock(&trace->ctl_lock);
+
+	if (trace->chan) {
+		plat_trace_stop(trace);
+		relay_close(trace->chan);
+		trace->chan = NULL;
+	}
+
+	mutex_unlock(&trace->ctl_lock);
+}
@@ -0,0 +1,74 @@
+#ifndef __DUMMY_DEV_TRACE_H
+#define __DUMMY_DEV_TRACE_H
+
+#include <linux/types.h>
+
+/*
+ * Traffic capture, shared with userspace (see plat_replay.c).
+ *
+ * Every RD and WR window that goes through the codec, plus the dummy
+ * message, is recorded as one struct plat_trace_rec into a relay
+ * channel with a buffer per CPU: plat_dummy/trace0, trace1, ... in
+ * debugfs. Records of one CPU are in time order, readers merge the
+ * files by timestamp.
+ *
+ * Writing "start" to plat_dummy/trace_ctl empties the buffers and
+ * starts the capture, "stop" ends it and flushes the partly filled
+ * sub-buffers so the files can be read to the end. Records that do
+ * not fit while nobody reads are counted as lost.
+ */
+
+enum plat_trace_dir {
+	PLAT_TRACE_RD,		/* usr -> krn */
+	PLAT_TRACE_WR,		/* krn -> usr */
+};
+
+#define PLAT_TRACE_LZ4		(1) /* The window held an LZ4 frame */
+#define PLAT_TRACE_BAD		(2) /* Corrupted frame, len is 0 */
+
+struct plat_trace_rec {
+	__u64	timestamp_ns;	/* ktime_get_ns() at the handshake */
+	__u32	len;		/* Payload bytes */
+	__u16	size;		/* Window bytes, at most MEM_SIZE */
+	__u8	dir;
+	__u8	flags;
+};
+
+#ifdef __KERNEL__
+
+#include <linux/atomic.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+
+struct rchan;
+
+struct plat_dummy_trace {
+	struct rchan		*chan;		/* NULL if relay is unavailable */
+	bool			is_on;
+	struct mutex		ctl_lock;
+	atomic64_t		records;
+	atomic64_t		lost;
+};
+
+struct plat_dummy_device;
+
+void plat_dummy_trace_init(struct plat_dummy_device *my_dev,
+			   struct dentry *dbg_dir);
+/* Before the debugfs directory goes, the relay files are in it */
+void plat_dummy_trace_exit(struct plat_dummy_device *my_dev);
+
+void __plat_dummy_trace(struct plat_dummy_trace *trace,
+			enum plat_trace_dir dir, u32 size, u32 len, u8 flags);
+
+/* Any context, a plain load while the capture is off */
+static inline void plat_dummy_trace(struct plat_dummy_trace *trace,
+				    enum plat_trace_dir dir, u32 size,
+				    u32 len, u8 flags)
+{
+	if (unlikely(READ_ONCE(trace->is_on)))
+		__plat_dummy_trace(trace, dir, size, len, flags);
+}
+
+#endif
+
+#endif
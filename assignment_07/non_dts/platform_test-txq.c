@@ -0,0 +1,378 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/sched/signal.h>
+
+#include "dummy_dev.h"
+#include "platform_test-utils.h"
+#include "platform_test-channel.h"
+#include "platform_test-codec.h"
+#include "platform_test-txq.h"
+
+#define PLAT_TX_GEN_MAX		(PLAT_TX_QUEUE_MAX * 4)
+
+/* The control class is not weighted, it always goes first */
+static unsigned int tx_weights[PLAT_TX_CLASSES] = { 0, 4, 2, 1 };
+module_param_array(tx_weights, uint, NULL, 0644);
+MODULE_PARM_DESC(tx_weights, "DRR weights of the classes 1.., in MEM_SIZE quanta");
+
+/* ------------------------- scheduler ----------------------------- */
+
+static u32 plat_txq_quantum(unsigned int class)
+{
+	return max(READ_ONCE(tx_weights[class]), 1U) * MEM_SIZE;
+}
+
+/* Lock held */
+static int plat_txq_refuse(struct plat_dummy_txq *txq)
+{
+	if (txq->is_closed)
+		return -ENODEV;
+	if (txq->is_net_up)
+		return -EBUSY;
+	return 0;
+}
+
+int plat_dummy_txq_enqueue(struct plat_dummy_device *my_dev,
+			   unsigned int class, struct plat_msg *msg,
+			   bool nonblock)
+{
+	struct plat_dummy_txq *txq = &my_dev->txq;
+	struct plat_tx_class *tc;
+	int ret;
+
+	if (class >= PLAT_TX_CLASSES) {
+		plat_msg_free(&my_dev->msgpool, msg);
+		return -EINVAL;
+	}
+
+	tc = &txq->classes[class];
+	msg->timestamp_ns = ktime_get_ns();
+
+	spin_lock_bh(&txq->lock);
+
+	for (;;) {
+		ret = plat_txq_refuse(txq);
+		if (ret || tc->depth < PLAT_TX_QUEUE_MAX)
+			break;
+
+		if (nonblock) {
+			tc->dropped++;
+			ret = -EAGAIN;
+			break;
+		}
+
+		/* Full until userspace takes or grants more */
+		tc->blocked++;
+		spin_unlock_bh(&txq->lock);
+
+		ret = wait_event_interruptible(txq->wait,
+				READ_ONCE(tc->depth) < PLAT_TX_QUEUE_MAX ||
+				READ_ONCE(txq->is_net_up) ||
+				READ_ONCE(txq->is_closed));
+
+		spin_lock_bh(&txq->lock);
+		if (ret)
+			break;
+	}
+
+	if (ret) {
+		spin_unlock_bh(&txq->lock);
+		plat_msg_free(&my_dev->msgpool, msg);
+		return ret;
+	}
+
+	list_add_tail(&msg->node, &tc->msgs);
+	tc->enqueued++;
+	WRITE_ONCE(tc->depth, tc->depth + 1);
+	tc->max_depth = max(tc->depth, tc->max_depth);
+
+	if (class != PLAT_TX_CONTROL && list_empty(&tc->active))
+		list_add_tail(&tc->active, &txq->drr);
+
+	spin_unlock_bh(&txq->lock);
+
+	plat_dummy_channel_kick(&my_dev->channels[PLAT_CH_WR], 0);
+	return 0;
+}
+
+static struct plat_msg *plat_txq_take(struct plat_tx_class *tc)
+{
+	struct plat_msg *msg = list_first_entry(&tc->msgs, struct plat_msg,
+						node);
+
+	list_del(&msg->node);
+	WRITE_ONCE(tc->depth, tc->depth - 1);
+	return msg;
+}
+
+/* Picks the next message, lock held */
+static struct plat_msg *plat_txq_pick(struct plat_dummy_txq *txq,
+				      unsigned int *class)
+{
+	struct plat_tx_class *tc = &txq->classes[PLAT_TX_CONTROL];
+	struct plat_msg *msg;
+
+	if (!list_empty(&tc->msgs)) {
+		*class = PLAT_TX_CONTROL;
+		return plat_txq_take(tc);
+	}
+
+	/* Each visit adds one quantum, so a class is served eventually */
+	while (!list_empty(&txq->drr)) {
+		tc = list_first_entry(&txq->drr, struct plat_tx_class, active);
+		*class = tc - txq->classes;
+
+		if (!tc->has_quantum) {
+			tc->deficit += plat_txq_quantum(*class);
+			tc->has_quantum = true;
+		}
+
+		msg = list_first_entry(&tc->msgs, struct plat_msg, node);
+		if (msg->len > tc->deficit) {
+			/* Its turn is over */
+			tc->has_quantum = false;
+			list_move_tail(&tc->active, &txq->drr);
+			continue;
+		}
+
+		tc->deficit -= msg->len;
+		plat_txq_take(tc);
+
+		if (list_empty(&tc->msgs)) {
+			/* An idle class does not save up credit */
+			list_del_init(&tc->active);
+			tc->deficit = 0;
+			tc->has_quantum = false;
+		}
+
+		return msg;
+	}
+
+	return NULL;
+}
+
+u32 plat_dummy_txq_poll(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_txq *txq = &my_dev->txq;
+	struct plat_dummy_channel *wr = &my_dev->channels[PLAT_CH_WR];
+	struct plat_tx_class *tc;
+	struct plat_msg *msg;
+	unsigned int class;
+	u64 lat;
+	u32 len;
+	bool is_backlogged;
+
+	spin_lock_bh(&txq->lock);
+	is_backlogged = !txq->is_net_up &&
+			(!list_empty(&txq->classes[PLAT_TX_CONTROL].msgs) ||
+			 !list_empty(&txq->drr));
+	spin_unlock_bh(&txq->lock);
+
+	if (!is_backlogged)
+		return 0;
+
+	if (!plat_dummy_wr_can_send(my_dev)) {
+		/* Previous message not taken yet or no credit left */
+		plat_dummy_channel_kick(wr, 1);
+		return 0;
+	}
+
+	spin_lock_bh(&txq->lock);
+	msg = plat_txq_pick(txq, &class);
+	spin_unlock_bh(&txq->lock);
+
+	if (!msg)
+		return 0;
+
+	/* Room in the class queue, let blocked producers in */
+	wake_up_interruptible(&txq->wait);
+
+	len = msg->len;
+	if (plat_dummy_tx_payload(my_dev, msg->data, len)) {
+		txq->errors++;
+		len = 0;
+	}
+
+	lat = ktime_get_ns() - msg->timestamp_ns;
+	plat_msg_free(&my_dev->msgpool, msg);
+
+	tc = &txq->classes[class];
+	spin_lock_bh(&txq->lock);
+	if (len) {
+		tc->sent++;
+		tc->bytes += len;
+		tc->lat_sum_ns += lat;
+		tc->lat_max_ns = max(tc->lat_max_ns, lat);
+	}
+	spin_unlock_bh(&txq->lock);
+
+	/* More to send once userspace takes this one */
+	plat_dummy_channel_kick(wr, 1);
+	return len;
+}
+
+/* ---------------------------- debugfs ---------------------------- */
+
+static int plat_txq_show(struct seq_file *s, void *unused)
+{
+	struct plat_dummy_device *my_dev = s->private;
+	struct plat_dummy_txq *txq = &my_dev->txq;
+	struct plat_tx_class *tc;
+	unsigned int class;
+
+	u32 flags = plat_dummy_read_flags(my_dev);
+	u32 credits = plat_dummy_read_wr_credits(my_dev);
+	u32 sent = READ_ONCE(my_dev->wr_sent);
+
+	seq_printf(s, "%-5s %6s %6s %6s %10s %10s %8s %8s %12s %10s %10s\n",
+		   "class", "weight", "depth", "max", "enqueued", "sent",
+		   "dropped", "blocked", "bytes", "avg_us", "max_us");
+
+	spin_lock_bh(&txq->lock);
+
+	for (class = 0; class < PLAT_TX_CLASSES; class++) {
+		tc = &txq->classes[class];
+
+		if (class == PLAT_TX_CONTROL)
+			seq_printf(s, "%-5u %6s", class, "strict");
+		else
+			seq_printf(s, "%-5u %6u", class,
+				   max(READ_ONCE(tx_weights[class]), 1U));
+
+		seq_printf(s, " %6u %6u %10llu %10llu %8llu %8llu %12llu %10llu %10llu\n",
+			   tc->depth, tc->max_depth, tc->enqueued, tc->sent,
+			   tc->dropped, tc->blocked, tc->bytes,
+			   div64_u64(tc->lat_sum_ns, tc->sent ?: 1) / NSEC_PER_USEC,
+			   div_u64(tc->lat_max_ns, NSEC_PER_USEC));
+	}
+
+	seq_printf(s, "errors %llu\n", txq->errors);
+
+	spin_unlock_bh(&txq->lock);
+
+	if (flags & PLAT_USR_WR_CREDITS)
+		seq_printf(s, "credits: granted %u, sent %u, left %d\n",
+			   credits, sent, (s32) (credits - sent));
+	else
+		seq_puts(s, "credits: off\n");
+	seq_printf(s, "credit stalls %lld\n",
+		   (long long) atomic64_read(&my_dev->wr_credit_stalls));
+	return 0;
+}
+
+static int plat_txq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, plat_txq_show, inode->i_private);
+}
+
+/*
+ * "class count len" queues count generated messages of len bytes,
+ * e.g. a bulk flood next to a few control messages. Blocks on a full
+ * class queue unless the file is opened with O_NONBLOCK.
+ */
+static ssize_t plat_txq_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct plat_dummy_device *my_dev = s->private;
+	unsigned int class, n, len, i;
+	struct plat_msg *msg;
+	char cmd[32] = { 0 };
+	int ret;
+
+	if (copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+		return -EFAULT;
+
+	if (sscanf(cmd, "%u %u %u", &class, &n, &len) != 3 ||
+	    class >= PLAT_TX_CLASSES || !n || n > PLAT_TX_GEN_MAX ||
+	    !len || len > PLAT_MAX_PAYLOAD)
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		msg = plat_msg_alloc(&my_dev->msgpool, len, GFP_KERNEL);
+		if (!msg)
+			return -ENOMEM;
+
+		memset(msg->data, 'A' + class, len);
+		snprintf((char *) msg->data, len, "class %u #%u", class, i);
+
+		ret = plat_dummy_txq_enqueue(my_dev, class, msg,
+					     file->f_flags & O_NONBLOCK);
+		if (ret)
+			return ret;
+	}
+
+	return count;
+}
+
+static const struct file_operations plat_txq_fops = {
+	.owner   = THIS_MODULE,
+	.open    = plat_txq_open,
+	.read    = seq_read,
+	.write   = plat_txq_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* ----------------------------------------------------------------- */
+
+void plat_dummy_txq_init(struct plat_dummy_device *my_dev,
+			 struct dentry *dbg_dir)
+{
+	struct plat_dummy_txq *txq = &my_dev->txq;
+	unsigned int class;
+
+	spin_lock_init(&txq->lock);
+	init_waitqueue_head(&txq->wait);
+	INIT_LIST_HEAD(&txq->drr);
+
+	for (class = 0; class < PLAT_TX_CLASSES; class++) {
+		INIT_LIST_HEAD(&txq->classes[class].msgs);
+		INIT_LIST_HEAD(&txq->classes[class].active);
+	}
+
+	debugfs_create_file("tx", 0644, dbg_dir, my_dev, &plat_txq_fops);
+}
+
+void plat_dummy_txq_set_net_up(struct plat_dummy_device *my_dev, bool is_up)
+{
+	struct plat_dummy_txq *txq = &my_dev->txq;
+
+	spin_lock_bh(&txq->lock);
+	WRITE_ONCE(txq->is_net_up, is_up);
+	spin_unlock_bh(&txq->lock);
+
+	if (is_up)
+		wake_up_interruptible_all(&txq->wait);
+	else
+		plat_dummy_channel_kick(&my_dev->channels[PLAT_CH_WR], 0);
+}
+
+void plat_dummy_txq_close(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_txq *txq = &my_dev->txq;
+
+	spin_lock_bh(&txq->lock);
+	WRITE_ONCE(txq->is_closed, true);
+	spin_unlock_bh(&txq->lock);
+
+	wake_up_interruptible_all(&txq->wait);
+}
+
+void plat_dummy_txq_exit(struct plat_dummy_device *my_dev)
+{
+	struct plat_dummy_txq *txq = &my_dev->txq;
+	struct plat_tx_class *tc;
+	unsigned int class;
+
+	for (class = 0; class < PLAT_TX_CLASSES; class++) {
+		tc = &txq->classes[class];
+		while (!list_empty(&tc->msgs))
+			plat_msg_free(&my_dev->msgpool, plat_txq_take(tc));
+		list_del_init(&tc->active);
+	}
+}
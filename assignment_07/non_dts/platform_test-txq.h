@@ -0,0 +1,88 @@
+#ifndef __DUMMY_DEV_TXQ_H
+#define __DUMMY_DEV_TXQ_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
+
+/*
+ * Outgoing priority classes. Class 0 (control) is strict priority:
+ * it always fills the next WR window if it has anything queued.
+ * The other classes share the rest by deficit round robin, weighted
+ * with the "tx_weights" param (in MEM_SIZE quanta).
+ *
+ * Queued messages go before ring sends and the dummy message. The
+ * queues only drain while userspace grants WR credits, a producer on
+ * a full class queue waits for room or gets -EAGAIN.
+ *
+ * The network frontend wins the WR window: while the interface is up
+ * the queues do not drain and enqueue fails with -EBUSY, a waiting
+ * producer included. Messages queued before it came up go out once
+ * it is down again.
+ */
+#define PLAT_TX_CLASSES		(4)
+#define PLAT_TX_CONTROL		(0)
+#define PLAT_TX_QUEUE_MAX	(256) /* Per class */
+
+struct plat_msg;
+
+struct plat_tx_class {
+	struct list_head	msgs;
+	struct list_head	active;		/* On the DRR list */
+	unsigned int		depth;
+	u32			deficit;
+	bool			has_quantum;
+
+	/* Stats */
+	unsigned int		max_depth;
+	u64			enqueued;
+	u64			sent;
+	u64			dropped;
+	u64			blocked;
+	u64			bytes;
+	u64			lat_sum_ns;	/* Enqueue to WR ready */
+	u64			lat_max_ns;
+};
+
+struct plat_dummy_txq {
+	spinlock_t		lock;
+	wait_queue_head_t	wait;		/* Producers on a full class */
+	struct plat_tx_class	classes[PLAT_TX_CLASSES];
+	struct list_head	drr;		/* Backlogged DRR classes */
+	u64			errors;
+
+	/* Under lock, setting either wakes the waiting producers */
+	bool			is_net_up;	/* The netdev owns WR */
+	bool			is_closed;	/* Device going away */
+};
+
+struct plat_dummy_device;
+
+void plat_dummy_txq_init(struct plat_dummy_device *my_dev,
+			 struct dentry *dbg_dir);
+void plat_dummy_txq_exit(struct plat_dummy_device *my_dev);
+
+/* Called by the network frontend as it takes/gives back the WR window */
+void plat_dummy_txq_set_net_up(struct plat_dummy_device *my_dev, bool is_up);
+
+/* Fails enqueues from now on and wakes the waiting producers */
+void plat_dummy_txq_close(struct plat_dummy_device *my_dev);
+
+/*
+ * Takes the message over. On a full class queue it sleeps until there
+ * is room, or frees the message and returns -EAGAIN with nonblock.
+ * The message is freed as well on -EBUSY (netdev up) and -ENODEV.
+ */
+int plat_dummy_txq_enqueue(struct plat_dummy_device *my_dev,
+			   unsigned int class, struct plat_msg *msg,
+			   bool nonblock);
+
+/*
+ * Called from the WR channel poll: sends the next scheduled message
+ * if the window is free. Returns the payload bytes sent.
+ */
+u32 plat_dummy_txq_poll(struct plat_dummy_device *my_dev);
+
+#endif
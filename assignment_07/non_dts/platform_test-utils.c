@@ -1,5 +1,6 @@
 #include "dummy_dev.h"
 #include "platform_test-utils.h"
+#include "platform_test-xform.h"
 
 static u32 plat_dummy_reg_read32(struct plat_dummy_device *my_dev, u32 offset)
 {
@@ -16,21 +17,33 @@ static void plat_dummy_reg_write32(struct plat_dummy_device *my_dev,
 
 u8 plat_dummy_read_byte(struct plat_dummy_device *my_dev, u32 offset)
 {
-	return ioread8(my_dev->rd_buf + offset);
+	return ioread8(my_dev->channels[PLAT_CH_RD].buf + offset);
+}
+
+void plat_dummy_read_buf(struct plat_dummy_device *my_dev, void *dst, u32 size)
+{
+	plat_dummy_copy_fromio(dst, my_dev->channels[PLAT_CH_RD].buf, size);
 }
 
 void plat_dummy_write_byte(struct plat_dummy_device *my_dev, u32 offset, u8 data)
 {
-	iowrite8(data, my_dev->wr_buf + offset);
+	iowrite8(data, my_dev->channels[PLAT_CH_WR].buf + offset);
 }
 
-bool plat_dummy_is_rd_buf_ready(struct plat_dummy_device *my_dev, u32 *data_size)
+void plat_dummy_write_buf(struct plat_dummy_device *my_dev, const void *src,
+			  u32 size)
 {
-	u32 status_reg;
+	memcpy_toio(my_dev->channels[PLAT_CH_WR].buf, src, size);
+}
 
-	mutex_lock(&my_dev->status_mtx);
-	status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
-	mutex_unlock(&my_dev->status_mtx);
+u32 plat_dummy_read_flags(struct plat_dummy_device *my_dev)
+{
+	return plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
+}
+
+bool plat_dummy_is_rd_buf_ready(struct plat_dummy_device *my_dev, u32 *data_size)
+{
+	u32 status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
 
 	if (status_reg & PLAT_RD_DATA_READY) {
 		*data_size = plat_dummy_reg_read32(my_dev, PLAT_RD_SIZE_REG);
@@ -44,28 +57,63 @@ void plat_dummy_clear_rd_buf_ready(struct plat_dummy_device *my_dev)
 {
 	u32 status_reg;
 
-	mutex_lock(&my_dev->status_mtx);
+	spin_lock_bh(&my_dev->flags_lock);
 	status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
-	status_reg &= ~PLAT_RD_DATA_READY;
+	status_reg &= ~(PLAT_RD_DATA_READY | PLAT_RD_LZ4_FRAME);
 	plat_dummy_reg_write32(my_dev, PLAT_IO_FLAGS_REG, status_reg);
-	mutex_unlock(&my_dev->status_mtx);
+	spin_unlock_bh(&my_dev->flags_lock);
 }
 
 bool plat_dummy_is_wr_buf_ready(struct plat_dummy_device *my_dev)
 {
-	u32 status_reg;
+	u32 status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
 
-	mutex_lock(&my_dev->status_mtx);
-	status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
-	mutex_unlock(&my_dev->status_mtx);
+	if (status_reg & PLAT_WR_DATA_READY)
+		return true;
+
+	return false;
+}
+
+u32 plat_dummy_read_wr_credits(struct plat_dummy_device *my_dev)
+{
+	return plat_dummy_reg_read32(my_dev, PLAT_WR_CREDITS_REG);
+}
+
+void plat_dummy_reset_wr_credits(struct plat_dummy_device *my_dev)
+{
+	spin_lock_bh(&my_dev->flags_lock);
+	WRITE_ONCE(my_dev->wr_sent, 0);
+	plat_dummy_reg_write32(my_dev, PLAT_WR_SENT_REG, 0);
+	plat_dummy_reg_write32(my_dev, PLAT_WR_CREDITS_REG, 0);
+	spin_unlock_bh(&my_dev->flags_lock);
+}
 
-	if (status_reg & PLAT_WR_SIZE_REG)
+bool plat_dummy_wr_can_send(struct plat_dummy_device *my_dev)
+{
+	u32 status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
+	u32 credits;
+
+	if (status_reg & PLAT_WR_DATA_READY)
+		return false;
+
+	if (!(status_reg & PLAT_USR_WR_CREDITS))
+		return true;
+
+	credits = plat_dummy_reg_read32(my_dev, PLAT_WR_CREDITS_REG);
+	if ((s32) (credits - READ_ONCE(my_dev->wr_sent)) > 0)
 		return true;
 
+	atomic64_inc(&my_dev->wr_credit_stalls);
 	return false;
 }
 
 void plat_dummy_set_wr_buf_ready(struct plat_dummy_device *my_dev, u32 data_size)
+{
+	plat_dummy_set_wr_buf_ready_flags(my_dev, data_size, 0);
+}
+
+void plat_dummy_set_wr_buf_ready_flags(struct plat_dummy_device *my_dev,
+				       u32 data_size, u32 flags)
 {
 	u32 status_reg;
 
@@ -73,9 +121,12 @@ void plat_dummy_set_wr_buf_ready(struct plat_dummy_device *my_dev, u32 data_size
 
 	wmb();
 
-	mutex_lock(&my_dev->status_mtx);
+	spin_lock_bh(&my_dev->flags_lock);
 	status_reg = plat_dummy_reg_read32(my_dev, PLAT_IO_FLAGS_REG);
-	status_reg |= PLAT_WR_DATA_READY;
+	status_reg &= ~PLAT_WR_LZ4_FRAME;
+	status_reg |= PLAT_WR_DATA_READY | flags;
 	plat_dummy_reg_write32(my_dev, PLAT_IO_FLAGS_REG, status_reg);
-	mutex_unlock(&my_dev->status_mtx);
+	WRITE_ONCE(my_dev->wr_sent, my_dev->wr_sent + 1);
+	plat_dummy_reg_write32(my_dev, PLAT_WR_SENT_REG, my_dev->wr_sent);
+	spin_unlock_bh(&my_dev->flags_lock);
 }
@@ -5,7 +5,15 @@
  * Buffers data access routines.
  */
 u8 plat_dummy_read_byte(struct plat_dummy_device *my_dev, u32 offset);
+void plat_dummy_read_buf(struct plat_dummy_device *my_dev, void *dst, u32 size);
 void plat_dummy_write_byte(struct plat_dummy_device *my_dev, u32 offset, u8 data);
+void plat_dummy_write_buf(struct plat_dummy_device *my_dev, const void *src,
+			  u32 size);
+
+/*
+ * Raw flags register, no lock needed for reading.
+ */
+u32 plat_dummy_read_flags(struct plat_dummy_device *my_dev);
 
 /*
  * RD (input) buffer status manipulation.
@@ -17,6 +25,20 @@ void plat_dummy_clear_rd_buf_ready(struct plat_dummy_device *my_dev);
  * WR (output) buffer status manipulation.
  */
 bool plat_dummy_is_wr_buf_ready(struct plat_dummy_device *my_dev);
+/*
+ * The WR window is free and, if userspace asked for flow control,
+ * it has a credit left. Senders must check this one.
+ */
+bool plat_dummy_wr_can_send(struct plat_dummy_device *my_dev);
+u32 plat_dummy_read_wr_credits(struct plat_dummy_device *my_dev);
+/*
+ * Zeroes the sent count and the credits: the registers keep whatever
+ * a previous load or userspace left there.
+ */
+void plat_dummy_reset_wr_credits(struct plat_dummy_device *my_dev);
 void plat_dummy_set_wr_buf_ready(struct plat_dummy_device *my_dev, u32 data_size);
+/* Also sets the given PLAT_WR_* frame flags */
+void plat_dummy_set_wr_buf_ready_flags(struct plat_dummy_device *my_dev,
+				       u32 data_size, u32 flags);
 
 #endif
@@ -0,0 +1,83 @@
+#include <arm_neon.h>
+
+#include "platform_test-xform-neon.h"
+
+/* u32 lanes take 2^15 pairwise u16 adds, flush well before that */
+#define PLAT_NEON_CSUM_FLUSH	(1024)
+
+unsigned long plat_neon_csum(const void *buf, unsigned long len,
+			     unsigned long long *sum)
+{
+	const uint16_t *p = buf;
+	unsigned long blocks = len / PLAT_NEON_BLOCK;
+	unsigned long done = blocks * PLAT_NEON_BLOCK;
+	uint64x2_t acc64 = vdupq_n_u64(0);
+
+	while (blocks) {
+		unsigned long n = blocks < PLAT_NEON_CSUM_FLUSH ?
+				  blocks : PLAT_NEON_CSUM_FLUSH;
+		uint32x4_t acc = vdupq_n_u32(0);
+
+		blocks -= n;
+		while (n--) {
+			acc = vpadalq_u16(acc, vld1q_u16(p));
+			acc = vpadalq_u16(acc, vld1q_u16(p + 8));
+			acc = vpadalq_u16(acc, vld1q_u16(p + 16));
+			acc = vpadalq_u16(acc, vld1q_u16(p + 24));
+			p += PLAT_NEON_BLOCK / sizeof(*p);
+		}
+
+		acc64 = vpadalq_u32(acc64, acc);
+	}
+
+	*sum += vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1);
+	return done;
+}
+
+unsigned long plat_neon_bswap32(void *dst, const void *src,
+				unsigned long len)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	unsigned long done = len & ~(unsigned long) (PLAT_NEON_BLOCK - 1);
+	unsigned long i;
+
+	for (i = 0; i < done; i += PLAT_NEON_BLOCK) {
+		uint8x16_t a = vld1q_u8(s + i);
+		uint8x16_t b = vld1q_u8(s + i + 16);
+		uint8x16_t c = vld1q_u8(s + i + 32);
+		uint8x16_t e = vld1q_u8(s + i + 48);
+
+		vst1q_u8(d + i, vrev32q_u8(a));
+		vst1q_u8(d + i + 16, vrev32q_u8(b));
+		vst1q_u8(d + i + 32, vrev32q_u8(c));
+		vst1q_u8(d + i + 48, vrev32q_u8(e));
+	}
+
+	return done;
+}
+
+unsigned long plat_neon_copy_fromio(void *dst, const volatile void *src,
+				    unsigned long len)
+{
+	/* 32-bit lanes keep the loads aligned on device memory */
+	const uint32_t *s = (const uint32_t *) src;
+	uint8_t *d = dst;
+	unsigned long done = len & ~(unsigned long) (PLAT_NEON_BLOCK - 1);
+	unsigned long i;
+
+	for (i = 0; i < done; i += PLAT_NEON_BLOCK) {
+		uint32x4_t a = vld1q_u32(s);
+		uint32x4_t b = vld1q_u32(s + 4);
+		uint32x4_t c = vld1q_u32(s + 8);
+		uint32x4_t e = vld1q_u32(s + 12);
+
+		vst1q_u8(d + i, vreinterpretq_u8_u32(a));
+		vst1q_u8(d + i + 16, vreinterpretq_u8_u32(b));
+		vst1q_u8(d + i + 32, vreinterpretq_u8_u32(c));
+		vst1q_u8(d + i + 48, vreinterpretq_u8_u32(e));
+		s += PLAT_NEON_BLOCK / sizeof(*s);
+	}
+
+	return done;
+}
@@ -0,0 +1,24 @@
+#ifndef __DUMMY_DEV_XFORM_NEON_H
+#define __DUMMY_DEV_XFORM_NEON_H
+
+/*
+ * NEON kernels, built with the FPU enabled and without kernel headers.
+ * Call them between kernel_neon_begin() and kernel_neon_end() only.
+ * Each one handles the leading multiple of its block size and returns
+ * the bytes done, the caller finishes the tail.
+ */
+#define PLAT_NEON_BLOCK		(64)
+
+/* Adds the little endian 16-bit words of buf to *sum */
+unsigned long plat_neon_csum(const void *buf, unsigned long len,
+			     unsigned long long *sum);
+
+/* Byte swaps every 32-bit word, dst may be src */
+unsigned long plat_neon_bswap32(void *dst, const void *src,
+				unsigned long len);
+
+/* src is a window: 16-byte aligned, read with aligned vector loads */
+unsigned long plat_neon_copy_fromio(void *dst, const volatile void *src,
+				    unsigned long len);
+
+#endif
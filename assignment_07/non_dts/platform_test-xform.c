@@ -0,0 +1,155 @@
+#include <linux/kernel.h>
+#include <linux/io.h>
+#include <linux/swab.h>
+#include <asm/unaligned.h>
+
+#if IS_ENABLED(CONFIG_KERNEL_MODE_NEON)
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include "platform_test-xform-neon.h"
+#endif
+
+#include "platform_test-xform.h"
+
+/* The checksum kernel adds little endian words */
+#define PLAT_HAS_NEON	(IS_ENABLED(CONFIG_KERNEL_MODE_NEON) && \
+			 !IS_ENABLED(CONFIG_CPU_BIG_ENDIAN))
+
+/* ---------------------------- C ---------------------------------- */
+
+static u64 plat_csum_add(const u8 *p, u32 len, u64 sum)
+{
+	u32 i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += get_unaligned_le16(p + i);
+
+	if (len & 1)
+		sum += p[len - 1];
+
+	return sum;
+}
+
+static u16 plat_csum_fold(u64 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+
+static void plat_bswap32_tail(u8 *d, const u8 *s, u32 len)
+{
+	u32 i;
+
+	for (i = 0; i + 4 <= len; i += 4)
+		put_unaligned(swab32(get_unaligned((const u32 *) (s + i))),
+			      (u32 *) (d + i));
+
+	/* A partial last word stays as it is */
+	if (d != s)
+		memcpy(d + i, s + i, len - i);
+}
+
+u16 plat_dummy_csum_scalar(const void *buf, u32 len)
+{
+	return plat_csum_fold(plat_csum_add(buf, len, 0));
+}
+
+void plat_dummy_bswap32_scalar(void *dst, const void *src, u32 len)
+{
+	plat_bswap32_tail(dst, src, len);
+}
+
+void plat_dummy_copy_fromio_scalar(void *dst, const void __iomem *src,
+				   u32 len)
+{
+	memcpy_fromio(dst, src, len);
+}
+
+/* ---------------------------- NEON ------------------------------- */
+
+bool plat_dummy_has_simd(void)
+{
+#if PLAT_HAS_NEON
+	return may_use_simd();
+#else
+	return false;
+#endif
+}
+
+u16 plat_dummy_csum_simd(const void *buf, u32 len)
+{
+	u64 sum = 0;
+	u32 done = 0;
+
+#if PLAT_HAS_NEON
+	unsigned long long acc = 0;
+
+	kernel_neon_begin();
+	done = plat_neon_csum(buf, len, &acc);
+	kernel_neon_end();
+	sum = acc;
+#endif
+
+	return plat_csum_fold(plat_csum_add(buf + done, len - done, sum));
+}
+
+void plat_dummy_bswap32_simd(void *dst, const void *src, u32 len)
+{
+	u32 done = 0;
+
+#if PLAT_HAS_NEON
+	kernel_neon_begin();
+	done = plat_neon_bswap32(dst, src, len);
+	kernel_neon_end();
+#endif
+
+	plat_bswap32_tail(dst + done, src + done, len - done);
+}
+
+void plat_dummy_copy_fromio_simd(void *dst, const void __iomem *src, u32 len)
+{
+	u32 done = 0;
+
+#if PLAT_HAS_NEON
+	/* Device memory faults on unaligned vector loads */
+	if (IS_ALIGNED((unsigned long) src, 16)) {
+		kernel_neon_begin();
+		done = plat_neon_copy_fromio(dst, (const void __force *) src,
+					     len);
+		kernel_neon_end();
+	}
+#endif
+
+	memcpy_fromio(dst + done, src + done, len - done);
+}
+
+/* ----------------------------------------------------------------- */
+
+/* Short buffers are not worth saving the FPU state */
+#define PLAT_SIMD_MIN_LEN	(256)
+
+u16 plat_dummy_csum(const void *buf, u32 len)
+{
+	if (len >= PLAT_SIMD_MIN_LEN && plat_dummy_has_simd())
+		return plat_dummy_csum_simd(buf, len);
+
+	return plat_dummy_csum_scalar(buf, len);
+}
+
+void plat_dummy_bswap32(void *dst, const void *src, u32 len)
+{
+	if (len >= PLAT_SIMD_MIN_LEN && plat_dummy_has_simd())
+		plat_dummy_bswap32_simd(dst, src, len);
+	else
+		plat_dummy_bswap32_scalar(dst, src, len);
+}
+
+void plat_dummy_copy_fromio(void *dst, const void __iomem *src, u32 len)
+{
+	if (len >= PLAT_SIMD_MIN_LEN && plat_dummy_has_simd())
+		plat_dummy_copy_fromio_simd(dst, src, len);
+	else
+		plat_dummy_copy_fromio_scalar(dst, src, len);
+}
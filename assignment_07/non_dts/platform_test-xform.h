@@ -0,0 +1,31 @@
+#ifndef __DUMMY_DEV_XFORM_H
+#define __DUMMY_DEV_XFORM_H
+
+#include <linux/types.h>
+
+/*
+ * Payload kernels of the RD path: 16-bit one's complement checksum
+ * (folded, not inverted), 32-bit byte swap and window copy.
+ *
+ * The plain names pick NEON when the kernel allows it here and fall
+ * back to C otherwise (non-ARM hosts, interrupt context). The _scalar
+ * and _simd variants are there for the KUnit suite; _simd is the C code
+ * too without NEON.
+ */
+u16 plat_dummy_csum(const void *buf, u32 len);
+void plat_dummy_bswap32(void *dst, const void *src, u32 len);
+void plat_dummy_copy_fromio(void *dst, const void __iomem *src, u32 len);
+
+bool plat_dummy_has_simd(void);
+
+u16 plat_dummy_csum_scalar(const void *buf, u32 len);
+void plat_dummy_bswap32_scalar(void *dst, const void *src, u32 len);
+void plat_dummy_copy_fromio_scalar(void *dst, const void __iomem *src,
+				   u32 len);
+
+u16 plat_dummy_csum_simd(const void *buf, u32 len);
+void plat_dummy_bswap32_simd(void *dst, const void *src, u32 len);
+void plat_dummy_copy_fromio_simd(void *dst, const void __iomem *src,
+				 u32 len);
+
+#endif
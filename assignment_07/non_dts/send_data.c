@@ -5,28 +5,97 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <lz4.h>
+
+/*
+ * Build: gcc -o send_data send_data.c -llz4
+ * Run "send_data -z" to exchange LZ4 frames with the driver.
+ */
 
 #define OUT_BUF_BASE	0x9f200000
 #define IN_BUF_BASE	0x9f201000
 
 #define REG_BASE	0x9f202000
 
-#define MEM_SIZE	(1024)
-#define REG_SIZE	(12)
+#define MEM_SIZE	(4096)	/* Window size, as in dummy_dev.h */
+#define REG_SIZE	(20)
 
 #define OUT_BUF_DATA_READY	(1)
 #define IN_BUF_DATA_READY	(2) 
+#define OUT_BUF_LZ4_FRAME	(4)
+#define IN_BUF_LZ4_FRAME	(8)
+#define USR_LZ4_CAPABLE		(16)
+#define USR_WR_CREDITS		(32)
+
+/* Messages we can take ahead, granted through the credits register */
+#define RX_CREDITS		(4)
+
+/* LZ4 frame: u32 payload length (little endian) + LZ4 block */
+#define LZ4_HDR_SIZE		(4)
+#define MAX_PAYLOAD		(4 * MEM_SIZE)
+
+static unsigned char frame[MEM_SIZE];
+static char payload[MAX_PAYLOAD + 1];
+
+/* Returns the frame length or 0 if the payload does not shrink */
+static int lz4_encode(const char *src, int len)
+{
+	int clen = LZ4_compress_default(src, (char *) frame + LZ4_HDR_SIZE,
+					len, MEM_SIZE - LZ4_HDR_SIZE);
+
+	if (clen <= 0 || clen + LZ4_HDR_SIZE >= len)
+		return 0;
+
+	frame[0] = len;
+	frame[1] = len >> 8;
+	frame[2] = len >> 16;
+	frame[3] = len >> 24;
+
+	return clen + LZ4_HDR_SIZE;
+}
+
+/* Returns the payload length or -1 on a corrupted frame */
+static int lz4_decode(int frame_len)
+{
+	unsigned int len = frame[0] | frame[1] << 8 | frame[2] << 16 |
+			   (unsigned int) frame[3] << 24;
+
+	if (frame_len <= LZ4_HDR_SIZE || len > MAX_PAYLOAD)
+		return -1;
+
+	if (LZ4_decompress_safe((char *) frame + LZ4_HDR_SIZE, payload,
+				frame_len - LZ4_HDR_SIZE, MAX_PAYLOAD) != len)
+		return -1;
+
+	payload[len] = 0;
+	return len;
+}
 
 extern int errno;
 
 int main(int argc, char **argv)
 {
 	volatile unsigned int *reg_addr = NULL, *count_addr, *flag_addr;
+	volatile unsigned int *credits_addr, *sent_addr;
 	volatile unsigned char *mem_out_addr = NULL;
 	volatile unsigned char *mem_in_addr = NULL;
 	unsigned int i,j, num = 0, val;
 	char drv_data;
+	int use_lz4 = 0, use_credits = 0;
+	int len, frame_len = 0;
+	unsigned int usr_flags;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-z"))
+			use_lz4 = 1;
+		else if (!strcmp(argv[i], "-c"))
+			use_credits = 1;
+	}
+
+	usr_flags = (use_lz4 ? USR_LZ4_CAPABLE : 0) |
+			(use_credits ? USR_WR_CREDITS : 0);
 
 	int fd = open("/dev/mem", O_RDWR | O_SYNC);
 	if(fd < 0)
@@ -61,13 +130,37 @@ int main(int argc, char **argv)
 	flag_addr = reg_addr;
 	count_addr = reg_addr;
 	count_addr++;
+	credits_addr = reg_addr + 3;
+	sent_addr = reg_addr + 4;
+
+	/* Room for RX_CREDITS messages past what the driver has sent */
+	if (use_credits)
+		*credits_addr = *sent_addr + RX_CREDITS;
 	
-	for (i=0; i < 50; i++) {
-		*mem_out_addr++ = 0x41 + i;
+	if (use_lz4) {
+		/* Text telemetry compresses well: send 16K per handshake */
+		for (len = 0, i = 0; len < MAX_PAYLOAD - 64; i++)
+			len += sprintf(payload + len,
+				"sensor=%02u temp=%d.%u status=OK\n",
+				i % 16, 20 + i % 5, i % 10);
+
+		frame_len = lz4_encode(payload, len);
 	}
+
+	if (frame_len) {
+		for (i = 0; i < frame_len; i++)
+			mem_out_addr[i] = frame[i];
+
+		*count_addr = frame_len;
+		*flag_addr = OUT_BUF_DATA_READY | OUT_BUF_LZ4_FRAME | usr_flags;
+	} else {
+		for (i=0; i < 50; i++) {
+			*mem_out_addr++ = 0x41 + i;
+		}
 	
-	*count_addr = 50;
-	*flag_addr = OUT_BUF_DATA_READY;
+		*count_addr = 50;
+		*flag_addr = OUT_BUF_DATA_READY | usr_flags;
+	}
 
 	/* ---------------------------------- */
 	/* Now read from our dummy device     */
@@ -85,12 +178,29 @@ int main(int argc, char **argv)
 
 		printf("----- DATA count to receive: %d\n", *count_addr);
 
-		for (j = 0; j < *count_addr; j++) {
-			drv_data = *((char *)(mem_in_addr + j));
-			printf("0x%x - %c\n", drv_data, drv_data);
+		if (val & IN_BUF_LZ4_FRAME) {
+			for (j = 0; j < *count_addr && j < MEM_SIZE; j++)
+				frame[j] = mem_in_addr[j];
+
+			len = lz4_decode(j);
+			if (len < 0)
+				printf("----- Corrupted LZ4 frame\n");
+			else
+				printf("----- LZ4 frame, %d -> %d bytes:\n%s\n",
+					j, len, payload);
+		} else {
+			for (j = 0; j < *count_addr; j++) {
+				drv_data = *((char *)(mem_in_addr + j));
+				printf("0x%x - %c\n", drv_data, drv_data);
+			}
 		}
 
-		*flag_addr = 0; /* Clear all transfer statuses */
+		/* The message is consumed, the room is ours again */
+		if (use_credits)
+			*credits_addr = *sent_addr + RX_CREDITS;
+
+		/* Clear all transfer statuses, keep the capabilities */
+		*flag_addr = usr_flags;
 	}
 
 	return 0;
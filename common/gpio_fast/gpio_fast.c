@@ -0,0 +1,232 @@
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/io.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+
+#include "gpio_fast.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Victor Krasnoshchok");
+MODULE_DESCRIPTION("GPIO1 fast path helpers");
+MODULE_VERSION("0.1");
+
+/* Toggles done with local IRQs off before giving the CPU a break */
+#define GPIO_BENCH_CHUNK (1000)
+#define GPIO_BENCH_MAX_TOGGLES (100000000)
+
+void __iomem* gpio_fast_base;
+EXPORT_SYMBOL_GPL(gpio_fast_base);
+
+atomic_t gpio_fast_shadow = ATOMIC_INIT(0);
+EXPORT_SYMBOL_GPL(gpio_fast_shadow);
+
+static DEFINE_SPINLOCK(gpio_oe_lock);
+
+/* ************************************************* */
+
+void gpio_fast_set_output(u32 mask)
+{
+    unsigned long flags;
+    u32 oe;
+
+    spin_lock_irqsave(&gpio_oe_lock, flags);
+    oe = readl_relaxed(gpio_fast_base + GPIO_FAST_OE_REG);
+    writel_relaxed(oe & ~mask, gpio_fast_base + GPIO_FAST_OE_REG); /* 0 - output */
+    spin_unlock_irqrestore(&gpio_oe_lock, flags);
+}
+EXPORT_SYMBOL_GPL(gpio_fast_set_output);
+
+void gpio_fast_set_input(u32 mask)
+{
+    unsigned long flags;
+    u32 oe;
+
+    spin_lock_irqsave(&gpio_oe_lock, flags);
+    oe = readl_relaxed(gpio_fast_base + GPIO_FAST_OE_REG);
+    writel_relaxed(oe | mask, gpio_fast_base + GPIO_FAST_OE_REG);
+    spin_unlock_irqrestore(&gpio_oe_lock, flags);
+}
+EXPORT_SYMBOL_GPL(gpio_fast_set_input);
+
+/* **************** Toggle benchmark *************** */
+
+/*
+ * "echo <toggles> <pin> > /sys/kernel/debug/gpio_fast/toggle_bench"
+ * toggles the pin with gpio_fast_toggle() and, for comparison, with
+ * the read-modify-write of the SET/CLR registers the modules used to
+ * do. "cat toggle_bench" shows the rates.
+ */
+typedef struct GPIO_bench_result_STCT
+{
+    u32 pin;
+    u64 toggles;
+    u64 fast_ns;
+    u64 rmw_ns;
+} GPIO_bench_result_STC;
+
+static GPIO_bench_result_STC bench_result;
+static DEFINE_MUTEX(bench_mtx);
+static struct dentry* gpio_dbg_dir;
+
+static void gpio_rmw_toggle(u32 mask, bool* is_on)
+{
+    void __iomem* reg = gpio_fast_base +
+                        (*is_on ? GPIO_FAST_DATA_OUT_CLR : GPIO_FAST_DATA_OUT_SET);
+
+    writel_relaxed(readl_relaxed(reg) | mask, reg);
+    *is_on = !*is_on;
+}
+
+static u64 gpio_bench_run(u32 mask, u64 toggles, bool is_fast)
+{
+    unsigned long flags;
+    bool is_on = false;
+    u64 elapsed_ns = 0;
+    u64 start_ns;
+    u64 done = 0;
+    u64 chunk;
+    u64 i;
+
+    while (done < toggles)
+    {
+        chunk = min_t(u64, toggles - done, GPIO_BENCH_CHUNK);
+
+        local_irq_save(flags);
+        start_ns = ktime_get_ns();
+
+        for (i = 0; i < chunk; ++i)
+        {
+            if (is_fast)
+            {
+                gpio_fast_toggle(mask);
+            }
+            else
+            {
+                gpio_rmw_toggle(mask, &is_on);
+            }
+        }
+
+        /* Make sure the stores reached the device */
+        readl(gpio_fast_base + GPIO_FAST_DATA_OUT_REG);
+        elapsed_ns += ktime_get_ns() - start_ns;
+        local_irq_restore(flags);
+
+        done += chunk;
+        cond_resched();
+    }
+
+    gpio_fast_clear(mask);
+    return elapsed_ns;
+}
+
+static u64 gpio_bench_rate(u64 toggles, u64 elapsed_ns)
+{
+    return (0 != elapsed_ns) ? div64_u64(toggles * NSEC_PER_SEC, elapsed_ns) : 0;
+}
+
+static int gpio_bench_show(struct seq_file* s, void* unused)
+{
+    mutex_lock(&bench_mtx);
+
+    if (0 == bench_result.toggles)
+    {
+        seq_puts(s, "no results yet\n");
+    }
+    else
+    {
+        seq_printf(s, "pin %u, %llu toggles\n", bench_result.pin, bench_result.toggles);
+        seq_printf(s, "single store: %llu toggles/s\n",
+                   gpio_bench_rate(bench_result.toggles, bench_result.fast_ns));
+        seq_printf(s, "read-modify-write: %llu toggles/s\n",
+                   gpio_bench_rate(bench_result.toggles, bench_result.rmw_ns));
+    }
+
+    mutex_unlock(&bench_mtx);
+    return 0;
+}
+
+static int gpio_bench_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, gpio_bench_show, inode->i_private);
+}
+
+static ssize_t gpio_bench_write(struct file* file, const char __user* buf,
+                                size_t count, loff_t* ppos)
+{
+    char cmd[32] = { 0 };
+    unsigned long long toggles = 0;
+    unsigned int pin = 0;
+
+    if (0 != copy_from_user(cmd, buf, min(count, sizeof(cmd) - 1)))
+    {
+        return -EFAULT;
+    }
+
+    if ((2 != sscanf(cmd, "%llu %u", &toggles, &pin)) ||
+        (pin >= GPIO_FAST_BANK_PINS) || (0 == toggles) ||
+        (toggles > GPIO_BENCH_MAX_TOGGLES))
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&bench_mtx);
+
+    gpio_fast_set_output(BIT(pin));
+
+    bench_result.pin = pin;
+    bench_result.toggles = toggles;
+    bench_result.fast_ns = gpio_bench_run(BIT(pin), toggles, true);
+    bench_result.rmw_ns = gpio_bench_run(BIT(pin), toggles, false);
+
+    mutex_unlock(&bench_mtx);
+    return count;
+}
+
+static const struct file_operations gpio_bench_fops = {
+        .owner   = THIS_MODULE,
+        .open    = gpio_bench_open,
+        .read    = seq_read,
+        .write   = gpio_bench_write,
+        .llseek  = seq_lseek,
+        .release = single_release
+};
+
+/* ************************************************* */
+
+static int __init gpio_fast_init(void)
+{
+    gpio_fast_base = ioremap(GPIO_FAST_MAP_BASE, GPIO_FAST_MAP_LEN);
+    if (NULL == gpio_fast_base)
+    {
+        printk(KERN_ERR "Cannot remap GPIO1 area\n");
+        return -EIO;
+    }
+
+    /* The only read of the output latch: start from the real state */
+    atomic_set(&gpio_fast_shadow, readl(gpio_fast_base + GPIO_FAST_DATA_OUT_REG));
+
+    gpio_dbg_dir = debugfs_create_dir("gpio_fast", NULL);
+    debugfs_create_file("toggle_bench", S_IRUGO | S_IWUSR, gpio_dbg_dir, NULL, &gpio_bench_fops);
+
+    printk(KERN_INFO "GPIO fast path loaded.\n");
+    return 0;
+}
+
+static void __exit gpio_fast_exit(void)
+{
+    debugfs_remove_recursive(gpio_dbg_dir);
+    iounmap(gpio_fast_base);
+
+    printk(KERN_INFO "GPIO fast path unloaded.\n");
+}
+
+module_init(gpio_fast_init);
+module_exit(gpio_fast_exit);
@@ -0,0 +1,88 @@
+#ifndef __GPIO_FAST_H
+#define __GPIO_FAST_H
+
+#include <linux/types.h>
+#include <linux/io.h>
+#include <linux/atomic.h>
+
+/*
+ * Fast path access to the GPIO1 bank of AM335x (USR LEDs & P8/P9
+ * header pins). The bank is mapped once by the gpio_fast module, the
+ * users just call the helpers below. Output updates go through the
+ * write-one-to-set/clear registers: a single store per update, no
+ * read of the (uncached) data register.
+ *
+ * The output state is mirrored in gpio_fast_shadow to implement the
+ * toggle without reading the hardware. Updates of the same pin must
+ * be serialized by its owner; different pins may be driven from any
+ * context concurrently.
+ */
+
+/* GPIO1 registers */
+#define GPIO_FAST_MAP_BASE      (0x4804c000)
+#define GPIO_FAST_MAP_LEN       (4096)
+
+#define GPIO_FAST_OE_REG        (0x134)
+#define GPIO_FAST_DATA_IN_REG   (0x138)
+#define GPIO_FAST_DATA_OUT_REG  (0x13c)
+#define GPIO_FAST_DATA_OUT_CLR  (0x190)
+#define GPIO_FAST_DATA_OUT_SET  (0x194)
+
+#define GPIO_FAST_BANK_PINS     (32)
+
+extern void __iomem* gpio_fast_base;
+extern atomic_t gpio_fast_shadow;
+
+/* Direction control: read-modify-write of OE, serialized inside */
+void gpio_fast_set_output(u32 mask);
+void gpio_fast_set_input(u32 mask);
+
+/* Hardware stores only, the shadow is maintained by the callers */
+static inline void __gpio_fast_store(u32 set_mask, u32 clr_mask)
+{
+    if (0 != set_mask)
+    {
+        writel_relaxed(set_mask, gpio_fast_base + GPIO_FAST_DATA_OUT_SET);
+    }
+
+    if (0 != clr_mask)
+    {
+        writel_relaxed(clr_mask, gpio_fast_base + GPIO_FAST_DATA_OUT_CLR);
+    }
+}
+
+static inline void gpio_fast_set(u32 mask)
+{
+    atomic_or(mask, &gpio_fast_shadow);
+    writel_relaxed(mask, gpio_fast_base + GPIO_FAST_DATA_OUT_SET);
+}
+
+static inline void gpio_fast_clear(u32 mask)
+{
+    atomic_andnot(mask, &gpio_fast_shadow);
+    writel_relaxed(mask, gpio_fast_base + GPIO_FAST_DATA_OUT_CLR);
+}
+
+/* Bulk update: one store per direction for any number of pins */
+static inline void gpio_fast_update(u32 set_mask, u32 clr_mask)
+{
+    atomic_or(set_mask, &gpio_fast_shadow);
+    atomic_andnot(clr_mask, &gpio_fast_shadow);
+    __gpio_fast_store(set_mask, clr_mask);
+}
+
+/* Returns the new state of the masked pins */
+static inline u32 gpio_fast_toggle(u32 mask)
+{
+    u32 prev = (u32) atomic_fetch_xor(mask, &gpio_fast_shadow);
+
+    __gpio_fast_store(~prev & mask, prev & mask);
+    return ~prev & mask;
+}
+
+static inline u32 gpio_fast_read_in(void)
+{
+    return readl_relaxed(gpio_fast_base + GPIO_FAST_DATA_IN_REG);
+}
+
+#endif